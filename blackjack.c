@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <time.h>
 #include <ctype.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
 
 // Used for cross-platform sleep. (Not mine)
 #ifdef _WIN32
@@ -10,8 +15,40 @@
 #include <unistd.h>
 #endif
 
+// Used for the multi-threaded simulation tools. Windows builds run them on a single thread.
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Used for sharing the table with spectators and other processes.
+#ifndef _WIN32
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+// Used for shuffling eight shoes at once. Chosen at run time, so the same build still runs without AVX2.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHUFFLE_AVX2
+#include <immintrin.h>
+#endif
+
+#include "blackjack_strategy.h"
+#include "libblackjack.h"
+
 // Defines to prevent magic numbers.
-#define MAX_HAND_COUNT 15
 #define MIN_DECK_COUNT 1
 #define MAX_DECK_COUNT 8
 #define MIN_DIFFICULTY 1
@@ -27,26 +64,49 @@
 #define STANDARD_SLEEP_TIME 500
 #define MAX_CARDS_IN_A_ROW 5
 #define NUMBER_OF_ROWS 3
+#define CARD_LINES 9
+#define CARD_SPRITE_SIZE 40
+#define HIDDEN_SPRITE CARDS_IN_A_DECK
+#define EMPTY_SPRITE (CARDS_IN_A_DECK + 1)
+#define SPRITE_COUNT (CARDS_IN_A_DECK + 2)
 #define MIN_BET 15
 #define DEALER_HOLD_VALUE 17
-
-typedef struct deck
-{
-	int *deck;
-	int total_cards;
-} deck;
-
-typedef struct hand
-{
-	int hand[MAX_HAND_COUNT];
-	int ace_count;
-	int hand_value;
-	int total_cards;
-} hand;
+#define GAME_ROUNDS_OVER 2
+#define DEALER_OUTCOME_COUNT (21 - DEALER_HOLD_VALUE + 2)
+#define RANK_COUNT 10
+#define ACE_RANK 0
+#define TEN_RANK 9
+#define DEFAULT_STAND_VALUE 17
+#define DEFAULT_SIMULATION_ROUNDS 2000000
+#define SIMULATION_CHUNK_ROUNDS 20000
+#define MEMO_INITIAL_CAPACITY 4096
+#define TABLE_RING_SIZE 64
+#define TABLE_BROADCAST_MAGIC 0x424A5442
+#define SPECTATOR_POLL_TIME 20
+#define CACHE_LINE_SIZE 64
+#define METRICS_MAGIC 0x424A4D54
+#define METRICS_NAME_PREFIX "/blackjack-metrics-"
+#define METRICS_WATCH_TIME 1000
+
+// Set by --script. Input comes from a file and nothing sleeps or clears the screen, so a session runs at full speed.
+int script_mode = 0;
+
+// Seed for the game's shuffles, from --seed. Zero means the clock picks one.
+uint64_t game_seed = 0;
+
+#ifndef _WIN32
+// Set by the Ctrl-C handler, which can't safely do anything more. The game checks it after every read.
+volatile sig_atomic_t shutdown_signal = 0;
+#endif
 
 // Cross-platform sleep-function. (Not mine)
 void slp(int milliseconds)
 {
+	if (script_mode)
+	{
+		return;
+	}
+
 	#ifdef _WIN32
  	Sleep(milliseconds);
  	#else
@@ -54,6 +114,20 @@ void slp(int milliseconds)
  	#endif
 }
 
+// Seconds from a monotonic clock.
+double get_seconds(void)
+{
+	#ifdef _WIN32
+	return GetTickCount64() / 1000.0;
+	#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+	#endif
+}
+
 // Clears the buffer for scanf. (I do not take credit for this code).
 void clear_scanf_buffer(void)
 {
@@ -61,10 +135,52 @@ void clear_scanf_buffer(void)
 	while ((c = getchar()) != '\n' && c != EOF) {};
 }
 
+// Exits if Ctrl-C was pressed while the game waited for input. exit() runs the atexit() handlers, which remove
+// the game's shared memory.
+void check_shutdown_signal(void)
+{
+	#ifndef _WIN32
+	if (shutdown_signal != 0)
+	{
+		exit(128 + shutdown_signal);
+	}
+	#endif
+}
+
+// Ends a scripted session once the script runs out, instead of asking it for more input forever.
+void check_script_end(int scanned)
+{
+	if (script_mode && scanned == EOF)
+	{
+		printf("\nThe script ended. Exiting the game...\n");
+		exit(0);
+	}
+}
+
+// Reads the next letter command from the player. Scripted sessions echo it so the transcript shows what was typed.
+char get_letter_input(void)
+{
+	int scanned;
+	char input = ' ';
+
+	// Checked before reading too, in case the signal came while the game was sleeping.
+	check_shutdown_signal();
+	scanned = scanf(" %c", &input);
+	check_shutdown_signal();
+	check_script_end(scanned);
+
+	if (script_mode)
+	{
+		printf("> %c\n", input);
+	}
+
+	return input;
+}
+
 // Gets any number input from the player.
 int get_number_input(char *message, int min_num, int max_num, int is_money)
 {
-	int input, input_loop = 1, iterations = 0;
+	int input, scanned, input_loop = 1, iterations = 0;
 
 	while (input_loop)
 	{
@@ -82,7 +198,21 @@ int get_number_input(char *message, int min_num, int max_num, int is_money)
 
 		iterations++;
 
-		scanf("%d", &input);
+		// Anything that isn't a number counts as out of bounds.
+		input = min_num - 1;
+		check_shutdown_signal();
+		scanned = scanf("%d", &input);
+		check_shutdown_signal();
+		check_script_end(scanned);
+
+		if (script_mode && scanned == 1)
+		{
+			printf("> %d\n", input);
+		}
+		else if (script_mode)
+		{
+			printf("> ?\n");
+		}
 
 		// If the player enters a number out of bounds, restarts the loop.
 		if (input >= (max_num + 1) || input <= (min_num - 1))
@@ -152,6 +282,81 @@ void shuffle_deck(deck *play_deck, int n)
 	}
 }
 
+// Rotates the bits of a 32-bit number to the left.
+uint32_t rotate_left(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+// Expands a 64-bit seed into the generator state using SplitMix64.
+void seed_rng(rng *r, uint64_t seed)
+{
+	int i;
+	uint64_t z;
+
+	for (i = 0; i < 4; i += 2)
+	{
+		seed += 0x9E3779B97F4A7C15ULL;
+		z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+
+		r->state[i] = (uint32_t)z;
+		r->state[i + 1] = (uint32_t)(z >> 32);
+	}
+}
+
+// Gets the next random 32-bit number from the generator.
+uint32_t rng_next(rng *r)
+{
+	uint32_t *s = r->state;
+	uint32_t result = rotate_left(s[1] * 5, 7) * 9;
+	uint32_t t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotate_left(s[3], 11);
+
+	return result;
+}
+
+// Gets an unbiased random number from 0 to (n - 1). (Lemire's multiply and reject method)
+uint32_t rng_bounded(rng *r, uint32_t n)
+{
+	uint64_t m = (uint64_t)rng_next(r) * n;
+	uint32_t low = (uint32_t)m, threshold;
+
+	if (low < n)
+	{
+		threshold = (0u - n) % n;
+
+		while (low < threshold)
+		{
+			m = (uint64_t)rng_next(r) * n;
+			low = (uint32_t)m;
+		}
+	}
+
+	return (uint32_t)(m >> 32);
+}
+
+// Fisher-Yates shuffle driven by a seedable generator instead of rand().
+// Only the top 'depth' cards are shuffled, which is all a round that starts from a fresh shoe needs.
+void shuffle_deck_rng(deck *play_deck, int n, int depth, rng *r)
+{
+	int *array = play_deck->deck, i, j;
+
+	for (i = (n - 1); i > 0 && i >= (n - depth); i--)
+	{
+		j = rng_bounded(r, i + 1);
+		swap_pointers(&array[i], &array[j]);
+	}
+}
+
 // Merges the used deck into the play deck.
 void recombine_decks(deck *play_deck, deck *used_deck)
 {
@@ -167,9 +372,59 @@ void recombine_decks(deck *play_deck, deck *used_deck)
 	}
 }
 
+// Gets the blackjack value of a single card. Aces are worth 11 here and are adjusted by get_hand_value().
+int get_card_value(int c_num)
+{
+	// Bring the range of card values between 0 - 51, then down to the position within a suite.
+	c_num = (c_num % CARDS_IN_A_DECK) % 13;
+
+	// Kings, queens, jacks and tens.
+	if ((c_num == 0) || (c_num >= 10))
+	{
+		return 10;
+	}
+	else if (c_num == 1)
+	{
+		return 11;
+	}
+
+	return c_num;
+}
+
+// Gets the suite of a card: 0 for clubs (1 - 13), 1 for diamonds (14 - 26), 2 for hearts (27 - 39) and 3 for
+// spades (40 - 51 and 0).
+int get_card_suit(int c_num)
+{
+	return ((c_num % CARDS_IN_A_DECK) + CARDS_IN_A_DECK - 1) % CARDS_IN_A_DECK / 13;
+}
+
+// Gets the rank index of a card: aces, 2 - 9, then every ten-valued card.
+int get_card_rank(int c_num)
+{
+	int value = get_card_value(c_num);
+
+	return (value == 11) ? ACE_RANK : (value - 1);
+}
+
+// Counts the cards left in a deck by rank.
+void count_shoe(deck *play_deck, int *counts)
+{
+	int i;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		counts[i] = 0;
+	}
+
+	for (i = 0; i < play_deck->total_cards; i++)
+	{
+		counts[get_card_rank(play_deck->deck[i])]++;
+	}
+}
+
 void get_hand_value(hand *hand)
 {
-	int i, c_num, temp;
+	int i, temp;
 
 	// Resets the hand and ace count in the deck to zero.
 	(hand->hand_value) = 0;
@@ -179,33 +434,10 @@ void get_hand_value(hand *hand)
 	// Also keeps track of all the aces that appear in the deck.
 	for (i = 0; i < hand->total_cards; i++)
 	{
-		c_num = hand->hand[i];
+		temp = get_card_value(hand->hand[i]);
 
-		c_num = c_num % CARDS_IN_A_DECK;
-
-		if ((c_num == 0) || (c_num >= 11 && c_num <= 13) || (c_num >= 24 && c_num <= 26) || (c_num >= 37 && c_num <= 39) || (c_num >= 50 && c_num <= 51))
-		{
-			temp = 10;
-		}
-		else if (c_num > 1 && c_num < 11)
-		{
-			temp = c_num;
-		}
-		else if (c_num > 14 && c_num < 24)
-		{
-			temp = (c_num - 13);
-		}
-		else if (c_num > 27 && c_num < 37)
-		{
-			temp = (c_num - 26);
-		}
-		else if (c_num > 40 && c_num < 50)
-		{
-			temp = (c_num - 39);
-		}
-		else
+		if (temp == 11)
 		{
-			temp = 11;
 			(hand->ace_count)++;
 		}
 
@@ -232,9 +464,10 @@ void get_hand_value(hand *hand)
 	}
 }
 
-void disgard_hands(deck *used_deck, hand *dealer, hand *player)
+// Moves the dealer's cards, then the cards of each of the 'spots' player hands, to the used deck.
+void disgard_hands(deck *used_deck, hand *dealer, hand *player, int spots)
 {
-	int i;
+	int i, spot;
 
 	// Moves all of the dealers cards over to the used deck.
 	for (i = 0; i < dealer->total_cards; i++)
@@ -246,823 +479,10932 @@ void disgard_hands(deck *used_deck, hand *dealer, hand *player)
 	(dealer->total_cards) = 0;
 
 	// Moves all of the players cards over to the used deck.
-	for (i = 0; i < player->total_cards; i++)
+	for (spot = 0; spot < spots; spot++)
 	{
-		used_deck->deck[used_deck->total_cards] = player->hand[i];
-		(used_deck->total_cards)++;
-		player->hand[i] = 0;
+		for (i = 0; i < player[spot].total_cards; i++)
+		{
+			used_deck->deck[used_deck->total_cards] = player[spot].hand[i];
+			(used_deck->total_cards)++;
+			player[spot].hand[i] = 0;
+		}
+		(player[spot].total_cards) = 0;
 	}
-	(player->total_cards) = 0;
 }
 
 /*==============================================================================
 --------------------------------------------------------------------------------
------------------- START OF GRAPHICS AND ASCII ART FUNCTIONS -------------------
+------------------------ START OF TABLE BROADCAST FUNCTIONS --------------------
 --------------------------------------------------------------------------------
 ==============================================================================*/
 
-// Clears the screen. May or may not work on all terminal interfaces.
-void cls(void)
+// Copy of everything shown on the table, published after every state change.
+typedef struct table_state
 {
-	#ifdef _WIN32
-	system("cls");
-	#else
-	printf("\e[1;1H\e[2J");
-	#endif
-}
-
-void print_blackjack_ascii_art(void)
+	int dealer_cards[MAX_HAND_COUNT];
+	int player_cards[MAX_SPOT_COUNT][MAX_HAND_COUNT];
+	int dealer_total_cards;
+	int player_total_cards[MAX_SPOT_COUNT];
+	int bets[MAX_SPOT_COUNT];
+	int spots;
+	int hidden;
+	int money;
+	int win_amount;
+} table_state;
+
+#ifndef _WIN32
+// A ring buffer slot. The sequence is odd while the writer is changing it (seqlock).
+typedef struct table_slot
 {
-	#ifdef _WIN32
-	printf("-------------------------------------\n");
-	printf("          Simple Blackjack\n");
-	printf("-------------------------------------\n");
-	#else
-	printf("  ____  _                 _        ____  _            _     _            _    \n");
-	printf(" / ___|(_)_ __ ___  _ __ | | ___  | __ )| | __ _  ___| | __(_) __ _  ___| | __\n");
-	printf(" \\___ \\| | '_ ` _ \\| '_ \\| |/ _ \\ |  _ \\| |/ _` |/ __| |/ /| |/ _` |/ __| |/ /\n");
-	printf("  ___) | | | | | | | |_) | |  __/ | |_) | | (_| | (__|   < | | (_| | (__|   < \n");
-	printf(" |____/|_|_| |_| |_| .__/|_|\\___| |____/|_|\\__,_|\\___|_|\\_\\/ |\\__,_|\\___|_|\\_\\\n");
-	printf("                   |_|                                   |__/                 \n\n");
-	#endif
-}
+	atomic_uint sequence;
+	table_state state;
+} table_slot;
 
-void print_game_win(void)
+// Shared memory layout. 'published' counts every state ever written, so the newest is in slot (published - 1).
+typedef struct table_broadcast
 {
-	#ifdef _WIN32
-	printf("-------------------------------------\n");
-	printf("              You Win!\n");
-	printf("-------------------------------------\n");
-	#else
-	printf(" __      __                          __       __  __           \n");
-	printf("|  \\    /  \\                        |  \\  _  |  \\|  \\          \n");
-	printf(" \\$$\\  /  $$______   __    __       | $$ / \\ | $$ \\$$ _______  \n");
-	printf("  \\$$\\/  $$/      \\ |  \\  |  \\      | $$/  $\\| $$|  \\|       \\ \n");
-	printf("   \\$$  $$|  $$$$$$\\| $$  | $$      | $$  $$$\\ $$| $$| $$$$$$$\\\n");
-	printf("    \\$$$$ | $$  | $$| $$  | $$      | $$ $$\\$$\\$$| $$| $$  | $$\n");
-	printf("    | $$  | $$__/ $$| $$__/ $$      | $$$$  \\$$$$| $$| $$  | $$\n");
-	printf("    | $$   \\$$    $$ \\$$    $$      | $$$    \\$$$| $$| $$  | $$\n");
-	printf("     \\$$    \\$$$$$$   \\$$$$$$        \\$$      \\$$ \\$$ \\$$   \\$$\n\n");
-	#endif
-}
-
-void print_game_lose(void)
+	uint32_t magic;
+	atomic_int closed;
+	atomic_uint published;
+	table_slot slots[TABLE_RING_SIZE];
+} table_broadcast;
+
+// The game's own broadcast, if it was started with --broadcast.
+table_broadcast *broadcast = NULL;
+char broadcast_name[64];
+
+// Gets the shared memory name for the table run by a process.
+void get_broadcast_name(char *name, size_t size, long pid)
 {
-	#ifdef _WIN32
-	printf("-------------------------------------\n");
-	printf("            Game Over!\n");
-	printf("-------------------------------------\n");
-	#else
-	printf("   ____                         ___                 \n");
-	printf("  / ___| __ _ _ __ ___   ___   / _ \\__   _____ _ __ \n");
-	printf(" | |  _ / _` | '_ ` _ \\ / _ \\ | | | \\ \\ / / _ \\ '__|\n");
-	printf(" | |_| | (_| | | | | | |  __/ | |_| |\\ V /  __/ |   \n");
-	printf("  \\____|\\__,_|_| |_| |_|\\___|  \\___/  \\_/ \\___|_|   \n\n");
-	#endif
+	snprintf(name, size, "/blackjack-table-%ld", pid);
 }
 
-// Gets the symbol shown in the middle of the card for the specific suite.
-char *get_suite_symbol(int c_num)
+// Removes the shared memory once the game closes. Spectators still attached keep their mapping.
+void close_table_broadcast(void)
 {
-	// Bring the range of card values between 0 - 51.
-	c_num = c_num % CARDS_IN_A_DECK;
-
-	// Returns the respective suite symbol in the 0 - 51 card value range.
-	if ((c_num == 0) || (c_num >= 41 && c_num <= 51))
-	{
-		#ifdef _WIN32
-		return "S";
-		#else
-		return "♠";
-		#endif
-	}
-	else if (c_num >= 1 && c_num <= 13)
-	{
-		#ifdef _WIN32
-		return "C";
-		#else
-		return "♣";
-		#endif
-	}
-	else if (c_num >= 14 && c_num <= 26)
-	{
-		#ifdef _WIN32
-		return "D";
-		#else
-		return "♦";
-		#endif
-	}
-	else if (c_num >= 27 && c_num <= 40)
-	{
-		#ifdef _WIN32
-		return "H";
-		#else
-		return "♥";
-		#endif
-	}
-	// Should never execute the else part of the block, but its here just in case.
-	else
+	if (broadcast != NULL)
 	{
-		return "ERR";
+		atomic_store_explicit(&broadcast->closed, 1, memory_order_release);
+		munmap(broadcast, sizeof(table_broadcast));
+		shm_unlink(broadcast_name);
+		broadcast = NULL;
 	}
 }
 
-// Gets the symbol that all cards have in the top left and bottom right of the card.
-void get_card_symbol(int c_num, char *symbol)
+// Creates the shared memory that spectators read the table from.
+int open_table_broadcast(void)
 {
-	int i;
+	int fd;
 
-	// Bring the range of card values between 0 - 51.
-	c_num = c_num % CARDS_IN_A_DECK;
+	get_broadcast_name(broadcast_name, sizeof(broadcast_name), (long)getpid());
 
-	if (c_num % 13 == 0)
-	{
-		symbol[0] = 'K';
-	}
-	else if (c_num % 13 == 12)
-	{
-		symbol[0] = 'Q';
-	}
-	else if (c_num % 13 == 11)
-	{
-		symbol[0] = 'J';
-	}
-	else if (c_num % 13 == 10)
-	{
-		symbol[0] = '1';
-		symbol[1] = '0';
-		symbol[2] = '\0';
-		return;
-	}
-	else if (c_num % 13 == 1)
+	fd = shm_open(broadcast_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(table_broadcast)) != 0)
 	{
-		symbol[0] = 'A';
+		printf("ERROR: Failed to create the table broadcast '%s'.\n", broadcast_name);
+		return 0;
 	}
-	else
+
+	broadcast = mmap(NULL, sizeof(table_broadcast), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (broadcast == MAP_FAILED)
 	{
-		symbol[0] = '0' + (c_num % 13);
+		broadcast = NULL;
+		shm_unlink(broadcast_name);
+		printf("ERROR: Failed to map the table broadcast '%s'.\n", broadcast_name);
+		return 0;
 	}
 
-	symbol[1] = '\0';
+	// ftruncate() zero fills the memory, so every slot and counter already starts at zero.
+	broadcast->magic = TABLE_BROADCAST_MAGIC;
+	atexit(close_table_broadcast);
+
+	return 1;
 }
+#endif
 
-// Prints the top segment of a card.
-void print_top_segment(int iterations)
+// Publishes the table to any spectators. The writer never waits on readers.
+void publish_table_state(hand *player, int *bets, int spots, hand *dealer, int money, int win_amount, int hidden)
 {
+	#ifdef _WIN32
+	(void)player;
+	(void)bets;
+	(void)spots;
+	(void)dealer;
+	(void)money;
+	(void)win_amount;
+	(void)hidden;
+	#else
 	int i;
+	unsigned int published, sequence;
+	table_slot *slot;
 
-	for (i = 0; i < iterations; i++)
+	if (broadcast == NULL)
 	{
-		#ifdef _WIN32
-		printf("-----------");
-		#else
-		printf("┌─────────┐");
-		#endif
+		return;
 	}
 
-	printf("\n");
-}
+	published = atomic_load_explicit(&broadcast->published, memory_order_relaxed);
+	slot = &broadcast->slots[published % TABLE_RING_SIZE];
+	sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
 
-// Prints a segment of the card with nothing special in it.
-void print_empty_segment(int iterations)
-{
-	int i;
+	// Marks the slot as being written before touching it.
+	atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
 
-	for (i = 0; i < iterations; i++)
+	memcpy(slot->state.dealer_cards, dealer->hand, sizeof(slot->state.dealer_cards));
+	slot->state.dealer_total_cards = dealer->total_cards;
+
+	for (i = 0; i < spots; i++)
 	{
-		#ifdef _WIN32
-		printf("|         |");
-		#else
-		printf("│         │");
-		#endif
+		memcpy(slot->state.player_cards[i], player[i].hand, sizeof(slot->state.player_cards[i]));
+		slot->state.player_total_cards[i] = player[i].total_cards;
+		slot->state.bets[i] = bets[i];
 	}
 
-	printf("\n");
+	slot->state.spots = spots;
+	slot->state.hidden = hidden;
+	slot->state.money = money;
+	slot->state.win_amount = win_amount;
+
+	atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+	atomic_store_explicit(&broadcast->published, published + 1, memory_order_release);
+	#endif
 }
 
-// Prints the segment of the card with a symbol in the middle.
-void print_suite_segment(hand *hand, int iterations, int start_index)
-{
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------------- START OF METRICS FUNCTIONS -------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+enum metric
+{
+	METRIC_HANDS,
+	METRIC_WINS,
+	METRIC_LOSSES,
+	METRIC_PUSHES,
+	METRIC_BLACKJACKS,
+	METRIC_RESHUFFLES,
+	METRIC_WAGERED,
+	METRIC_MONEY,
+	METRIC_WIN_AMOUNT,
+	METRIC_COUNT
+};
+
+char *metric_names[METRIC_COUNT] = {"Hands played", "Wins", "Losses", "Pushes", "Blackjacks", "Reshuffles", "Total wagered", "Current money", "Required money to win"};
+
+#ifndef _WIN32
+// Every counter sits on its own cache line so readers polling one never slow down updates to another.
+typedef struct metric_counter
+{
+	_Alignas(CACHE_LINE_SIZE) atomic_llong value;
+} metric_counter;
+
+// Shared memory layout. The sequence is odd while the game is in the middle of an update (seqlock).
+typedef struct metrics_page
+{
+	uint32_t magic;
+	atomic_int closed;
+	_Alignas(CACHE_LINE_SIZE) atomic_uint sequence;
+	metric_counter counters[METRIC_COUNT];
+} metrics_page;
+
+// The game's own metrics page, if it was started with --publish-metrics.
+metrics_page *metrics = NULL;
+char metrics_name[64];
+
+void get_metrics_name(char *name, size_t size, long pid)
+{
+	snprintf(name, size, "%s%ld", METRICS_NAME_PREFIX, pid);
+}
+
+void close_metrics_page(void)
+{
+	if (metrics != NULL)
+	{
+		atomic_store_explicit(&metrics->closed, 1, memory_order_release);
+		munmap(metrics, sizeof(metrics_page));
+		shm_unlink(metrics_name);
+		metrics = NULL;
+	}
+}
+
+// Only notes the signal, since almost nothing is safe to call from a handler. check_shutdown_signal() exits.
+void note_shutdown_signal(int signal_number)
+{
+	shutdown_signal = signal_number;
+}
+
+// Makes sure Ctrl-C doesn't leave any shared memory behind. Without SA_RESTART a read waiting on the terminal gives
+// up when the signal arrives, so the game sees the flag straight away and exits through its atexit() handlers.
+void catch_shutdown_signals(void)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = note_shutdown_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+}
+
+// Starts one of the game's threads with Ctrl-C and SIGTERM blocked, so they always interrupt the main thread's reads.
+int create_game_thread(pthread_t *thread, void *(*function)(void *), void *argument)
+{
+	int status;
+	sigset_t signals, old_signals;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+	status = pthread_create(thread, NULL, function, argument);
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+	return status;
+}
+
+// Creates the shared memory page that 'blackjack --metrics' reads.
+int open_metrics_page(void)
+{
+	int fd;
+
+	get_metrics_name(metrics_name, sizeof(metrics_name), (long)getpid());
+
+	fd = shm_open(metrics_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(metrics_page)) != 0)
+	{
+		printf("ERROR: Failed to create the metrics page '%s'.\n", metrics_name);
+		return 0;
+	}
+
+	metrics = mmap(NULL, sizeof(metrics_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (metrics == MAP_FAILED)
+	{
+		metrics = NULL;
+		shm_unlink(metrics_name);
+		printf("ERROR: Failed to map the metrics page '%s'.\n", metrics_name);
+		return 0;
+	}
+
+	metrics->magic = METRICS_MAGIC;
+	atexit(close_metrics_page);
+
+	return 1;
+}
+
+// Marks the start and end of a group of updates so readers never see half of one.
+// Only the game thread writes, so a plain increment of the sequence is enough.
+void begin_metrics_update(void)
+{
+	atomic_store_explicit(&metrics->sequence, atomic_load_explicit(&metrics->sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void end_metrics_update(void)
+{
+	atomic_store_explicit(&metrics->sequence, atomic_load_explicit(&metrics->sequence, memory_order_relaxed) + 1, memory_order_release);
+}
+
+void add_metric(int metric, long long amount)
+{
+	atomic_fetch_add_explicit(&metrics->counters[metric].value, amount, memory_order_relaxed);
+}
+
+void set_metric(int metric, long long value)
+{
+	atomic_store_explicit(&metrics->counters[metric].value, value, memory_order_relaxed);
+}
+#endif
+
+// Records a new bet. Does nothing unless the game is publishing metrics.
+void record_bet_metrics(int bet, int money, int win_amount)
+{
+	#ifdef _WIN32
+	(void)bet;
+	(void)money;
+	(void)win_amount;
+	#else
+	if (metrics == NULL)
+	{
+		return;
+	}
+
+	begin_metrics_update();
+	add_metric(METRIC_WAGERED, bet);
+	set_metric(METRIC_MONEY, money);
+	set_metric(METRIC_WIN_AMOUNT, win_amount);
+	end_metrics_update();
+	#endif
+}
+
+// Records a finished hand. 'outcome' is 1 for a win, 0 for a push and -1 for a loss.
+void record_round_metrics(int outcome, int blackjack, int money)
+{
+	#ifdef _WIN32
+	(void)outcome;
+	(void)blackjack;
+	(void)money;
+	#else
+	if (metrics == NULL)
+	{
+		return;
+	}
+
+	begin_metrics_update();
+	add_metric(METRIC_HANDS, 1);
+	add_metric((outcome > 0) ? METRIC_WINS : ((outcome < 0) ? METRIC_LOSSES : METRIC_PUSHES), 1);
+	add_metric(METRIC_BLACKJACKS, (blackjack != 0));
+	set_metric(METRIC_MONEY, money);
+	end_metrics_update();
+	#endif
+}
+
+void record_reshuffle_metrics(void)
+{
+	#ifndef _WIN32
+	if (metrics == NULL)
+	{
+		return;
+	}
+
+	begin_metrics_update();
+	add_metric(METRIC_RESHUFFLES, 1);
+	end_metrics_update();
+	#endif
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------- START OF HAND HISTORY FUNCTIONS -----------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+Every round settled by blackjack() is appended to the hand history file as a
+HISTORY_RECORD_SIZE byte record. Numbers are little-endian.
+
+	 0  time the round ended (i64, seconds since 1970)
+	 8  bet (u32)
+	12  payout, the money handed back with the bet included (u32)
+	16  player's total (u8)
+	17  dealer's total (u8)
+	18  dealer's up card value, 2 - 11 (u8)
+	19  outcome, a round_outcome (u8)
+	20  flags, HISTORY_PLAYER_BLACKJACK and HISTORY_DEALER_BLACKJACK (u8)
+	21  player's card count (u8)
+	22  dealer's card count (u8)
+	23  unused
+
+==============================================================================*/
+
+#define HISTORY_FILE_NAME "blackjack-history.bin"
+#define HISTORY_RECORD_SIZE 24
+#define HISTORY_PLAYER_BLACKJACK 1
+#define HISTORY_DEALER_BLACKJACK 2
+
+// What a round ended in, as stored in hand histories and results files.
+enum round_outcome
+{
+	OUTCOME_LOSS,
+	OUTCOME_PUSH,
+	OUTCOME_WIN,
+	OUTCOME_BLACKJACK
+};
+
+// The file the game appends its rounds to. NULL if it couldn't be opened.
+FILE *history = NULL;
+
+void put_u32(unsigned char *buffer, uint32_t value)
+{
+	buffer[0] = (unsigned char)value;
+	buffer[1] = (unsigned char)(value >> 8);
+	buffer[2] = (unsigned char)(value >> 16);
+	buffer[3] = (unsigned char)(value >> 24);
+}
+
+uint32_t get_u32(const unsigned char *buffer)
+{
+	return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+void put_u64(unsigned char *buffer, uint64_t value)
+{
+	put_u32(buffer, (uint32_t)value);
+	put_u32(buffer + 4, (uint32_t)(value >> 32));
+}
+
+uint64_t get_u64(const unsigned char *buffer)
+{
+	return (uint64_t)get_u32(buffer) | ((uint64_t)get_u32(buffer + 4) << 32);
+}
+
+void close_hand_history(void)
+{
+	if (history != NULL)
+	{
+		fclose(history);
+		history = NULL;
+	}
+}
+
+// Opens the hand history for appending. The game still runs if it can't be opened.
+void open_hand_history(const char *path)
+{
+	history = fopen(path, "ab");
+
+	if (history == NULL)
+	{
+		printf("Could not open the hand history '%s'. Rounds will not be recorded.\n", path);
+		slp(STANDARD_SLEEP_TIME * 4);
+		return;
+	}
+
+	atexit(close_hand_history);
+}
+
+// Appends a settled round. Must be called before the hands are disgarded.
+void record_round_history(hand *player, hand *dealer, int bet, int payout)
+{
+	unsigned char record[HISTORY_RECORD_SIZE];
+	int flags = 0, outcome;
+
+	if (history == NULL)
+	{
+		return;
+	}
+
+	if (player->total_cards == 2 && player->hand_value == 21)
+	{
+		flags |= HISTORY_PLAYER_BLACKJACK;
+	}
+
+	if (dealer->total_cards == 2 && dealer->hand_value == 21)
+	{
+		flags |= HISTORY_DEALER_BLACKJACK;
+	}
+
+	if (payout == 0)
+	{
+		outcome = OUTCOME_LOSS;
+	}
+	else if (payout == bet)
+	{
+		outcome = OUTCOME_PUSH;
+	}
+	else
+	{
+		outcome = (flags & HISTORY_PLAYER_BLACKJACK) ? OUTCOME_BLACKJACK : OUTCOME_WIN;
+	}
+
+	memset(record, 0, sizeof(record));
+	put_u64(record, (uint64_t)time(NULL));
+	put_u32(record + 8, (uint32_t)bet);
+	put_u32(record + 12, (uint32_t)payout);
+	record[16] = (unsigned char)player->hand_value;
+	record[17] = (unsigned char)dealer->hand_value;
+	record[18] = (unsigned char)get_card_value(dealer->hand[1]);
+	record[19] = (unsigned char)outcome;
+	record[20] = (unsigned char)flags;
+	record[21] = (unsigned char)player->total_cards;
+	record[22] = (unsigned char)dealer->total_cards;
+
+	// Whole records only, so a reader never sees half a round.
+	fwrite(record, 1, sizeof(record), history);
+	fflush(history);
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+---------------------- START OF STRATEGY PLUG-IN FUNCTIONS ---------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+typedef struct strategy
+{
+	const char *name;
+	strategy_decide_function decide;
+	void *library;
+} strategy;
+
+// The strategy playing the hands when the game is started with --autoplay.
+strategy *autoplay = NULL;
+strategy autoplay_strategy;
+
+// Built-in strategy used when no plug-in is given: hit below 17, just like the dealer.
+void default_strategy_decide(const strategy_request *requests, int *decisions, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		decisions[i] = (requests[i].hand_total < DEFAULT_STAND_VALUE) ? STRATEGY_HIT : STRATEGY_STAND;
+	}
+}
+
+// Loads a strategy plug-in, or the built-in strategy if 'path' is NULL. Returns 0 if it can't be loaded.
+int load_strategy(strategy *loaded, const char *path)
+{
+	strategy_name_function get_name;
+
+	loaded->name = "Hit below 17";
+	loaded->decide = default_strategy_decide;
+	loaded->library = NULL;
+
+	if (path == NULL)
+	{
+		return 1;
+	}
+
+	#ifdef _WIN32
+	loaded->library = LoadLibraryA(path);
+	if (loaded->library == NULL)
+	{
+		printf("ERROR: Failed to load the strategy '%s'.\n", path);
+		return 0;
+	}
+
+	loaded->decide = (strategy_decide_function)GetProcAddress(loaded->library, "blackjack_strategy_decide");
+	get_name = (strategy_name_function)GetProcAddress(loaded->library, "blackjack_strategy_name");
+	#else
+	loaded->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (loaded->library == NULL)
+	{
+		printf("ERROR: Failed to load the strategy '%s': %s\n", path, dlerror());
+		return 0;
+	}
+
+	loaded->decide = (strategy_decide_function)dlsym(loaded->library, "blackjack_strategy_decide");
+	get_name = (strategy_name_function)dlsym(loaded->library, "blackjack_strategy_name");
+	#endif
+
+	if (loaded->decide == NULL)
+	{
+		printf("ERROR: '%s' does not export blackjack_strategy_decide().\n", path);
+		return 0;
+	}
+
+	loaded->name = (get_name != NULL) ? get_name() : path;
+
+	return 1;
+}
+
+void unload_strategy(strategy *loaded)
+{
+	if (loaded->library != NULL)
+	{
+		#ifdef _WIN32
+		FreeLibrary(loaded->library);
+		#else
+		dlclose(loaded->library);
+		#endif
+		loaded->library = NULL;
+	}
+}
+
+// Describes the player's situation to a strategy.
+// 'counts' holds the ranks left in the play deck. The dealer's hidden card is added since the player hasn't seen it.
+void fill_strategy_request(strategy_request *request, hand *player, hand *dealer, int *counts)
+{
+	int i, total = 0;
+
+	for (i = 0; i < player->total_cards; i++)
+	{
+		total += get_card_value(player->hand[i]);
+	}
+
+	request->hand_total = player->hand_value;
+	request->soft = (player->ace_count > 0) && (player->hand_value == total);
+	request->dealer_up_card = get_card_value(dealer->hand[1]);
+	request->cards_left = 1;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		request->shoe_counts[i] = counts[i];
+		request->cards_left += counts[i];
+	}
+
+	request->shoe_counts[get_card_rank(dealer->hand[0])]++;
+}
+
+// Asks the autoplay strategy what to do at the hit or stand prompt. Returns 'h' or 's'.
+char get_autoplay_input(hand *player, hand *dealer, deck *play_deck)
+{
+	int counts[RANK_COUNT], decision;
+	strategy_request request;
+
+	count_shoe(play_deck, counts);
+	fill_strategy_request(&request, player, dealer, counts);
+	autoplay->decide(&request, &decision, 1);
+
+	return (decision == STRATEGY_HIT) ? 'h' : 's';
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------------- START OF ROUND ENGINE ------------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+The rules of a round, as the state machine declared in libblackjack.h. The
+console game in blackjack() is one front-end for it. It draws after each call
+and asks the player when the table needs an action.
+
+A round moves through these phases, one step (or action) at a time:
+
+	PHASE_BET          Waiting for blackjack_start_spots().
+	PHASE_DEAL         One step per starting card: every spot, dealer, every
+	                   spot, dealer.
+	PHASE_DEALT        Works out every hand. A dealer blackjack ends the round,
+	                   and spots with a blackjack don't get a turn.
+	PHASE_PLAYER       Waiting for blackjack_apply() on the hand in 'spot'.
+	                   Standing, busting or reaching 21 moves to the next spot.
+	                   Once every spot busted, the round ends.
+	PHASE_DEALER       Turns the hole card over.
+	PHASE_DEALER_DRAW  One step per dealer card, settling once the dealer holds.
+	PHASE_SETTLE       Settles a round that ended early.
+	PHASE_OVER         Waiting for a step to move the cards to the used deck,
+	                   or straight back into the table's continuous shuffler.
+
+==============================================================================*/
+
+// The largest power of two up to CSM_CARD_COUNT.
+#define CSM_TREE_STEP 32
+
+enum round_phase
+{
+	PHASE_BET,
+	PHASE_DEAL,
+	PHASE_DEALT,
+	PHASE_PLAYER,
+	PHASE_DEALER,
+	PHASE_DEALER_DRAW,
+	PHASE_SETTLE,
+	PHASE_OVER
+};
+
+// Net result of a finished round in units of the bet, using the game's payouts.
+// The bet has already been taken from the player, so a dealer bust pays back 2x and a blackjack 1.5x.
+double get_round_result(int player_value, int dealer_value, int player_blackjack)
+{
+	if (player_value > 21)
+	{
+		return -1.0;
+	}
+	else if (dealer_value > 21)
+	{
+		return 1.0;
+	}
+	else if (dealer_value == player_value)
+	{
+		return 0.0;
+	}
+	else if (dealer_value > player_value)
+	{
+		return -1.0;
+	}
+	else if (player_blackjack)
+	{
+		return 0.5;
+	}
+
+	return 1.0;
+}
+
+// Moves the top card of the play deck into a hand.
+// Recombines and reshuffles the used deck into the play deck once it runs out.
+// If 'counts' isn't NULL it is kept up to date with the ranks left in the play deck.
+void draw_card(deck *play_deck, deck *used_deck, hand *hand, int *counts, rng *r)
+{
+	int top = play_deck->total_cards - 1;
+
+	if (counts != NULL)
+	{
+		counts[get_card_rank(play_deck->deck[top])]--;
+	}
+
+	hand->hand[hand->total_cards] = play_deck->deck[top];
+	(hand->total_cards)++;
+	play_deck->deck[top] = 0;
+	(play_deck->total_cards)--;
+
+	if (play_deck->total_cards == 0)
+	{
+		recombine_decks(play_deck, used_deck);
+		shuffle_deck_rng(play_deck, play_deck->total_cards, play_deck->total_cards, r);
+
+		if (counts != NULL)
+		{
+			count_shoe(play_deck, counts);
+		}
+	}
+}
+
+// Adds 'amount' copies of a card to a continuous shuffler. (A negative amount takes them out)
+void csm_add(csm *shuffler, int card, int amount)
+{
+	shuffler->total_cards += amount;
+
+	for (; card <= CSM_CARD_COUNT; card += card & -card)
+	{
+		shuffler->tree[card] += amount;
+	}
+}
+
+void blackjack_csm_init(csm *shuffler, int decks)
+{
+	int card;
+
+	memset(shuffler, 0, sizeof(csm));
+
+	for (card = 1; card <= CSM_CARD_COUNT; card++)
+	{
+		csm_add(shuffler, card, decks);
+	}
+}
+
+// Takes a uniformly random card out of a continuous shuffler.
+// Walks down the tree to the card holding the k-th copy, halving the range each step.
+int csm_draw(csm *shuffler, rng *r)
+{
+	int k = (int)rng_bounded(r, (uint32_t)shuffler->total_cards), card = 0, step;
+
+	for (step = CSM_TREE_STEP; step > 0; step /= 2)
+	{
+		if (card + step <= CSM_CARD_COUNT && shuffler->tree[card + step] <= k)
+		{
+			card += step;
+			k -= shuffler->tree[card];
+		}
+	}
+
+	csm_add(shuffler, card + 1, -1);
+
+	return card + 1;
+}
+
+// disgard_hands() for a continuous shuffler. The cards go straight back in.
+void return_hands_to_csm(csm *shuffler, hand *dealer, hand *player, int spots)
+{
+	int i, spot;
+
+	for (i = 0; i < dealer->total_cards; i++)
+	{
+		csm_add(shuffler, dealer->hand[i], 1);
+		dealer->hand[i] = 0;
+	}
+	dealer->total_cards = 0;
+
+	for (spot = 0; spot < spots; spot++)
+	{
+		for (i = 0; i < player[spot].total_cards; i++)
+		{
+			csm_add(shuffler, player[spot].hand[i], 1);
+			player[spot].hand[i] = 0;
+		}
+		player[spot].total_cards = 0;
+	}
+}
+
+void blackjack_table_init(blackjack_table *table, deck *play_deck, deck *used_deck, hand *player, hand *dealer, uint64_t seed)
+{
+	table->play_deck = play_deck;
+	table->used_deck = used_deck;
+	table->player = player;
+	table->dealer = dealer;
+	table->shuffler = NULL;
+	table->phase = PHASE_BET;
+	table->event = BLACKJACK_EVENT_NONE;
+	table->spots = 0;
+	table->spot = 0;
+	table->hidden = 1;
+	table->reshuffles = 0;
+	table->payout = 0;
+
+	seed_rng(&table->r, seed);
+}
+
+void blackjack_table_use_csm(blackjack_table *table, csm *shuffler)
+{
+	table->shuffler = shuffler;
+}
+
+// What the table needs, going by its phase.
+int get_table_status(blackjack_table *table)
+{
+	if (table->phase == PHASE_BET)
+	{
+		return BLACKJACK_NEED_BET;
+	}
+	else if (table->phase == PHASE_PLAYER)
+	{
+		return BLACKJACK_NEED_ACTION;
+	}
+	else if (table->phase == PHASE_OVER)
+	{
+		return BLACKJACK_ROUND_OVER;
+	}
+
+	return BLACKJACK_RUNNING;
+}
+
+// Draws a card into one of the table's hands, counting the reshuffle if it used up the play deck.
+void draw_table_card(blackjack_table *table, hand *hand)
+{
+	if (table->shuffler != NULL)
+	{
+		hand->hand[hand->total_cards] = csm_draw(table->shuffler, &table->r);
+		(hand->total_cards)++;
+		get_hand_value(hand);
+		return;
+	}
+
+	if (table->play_deck->total_cards == 1)
+	{
+		(table->reshuffles)++;
+	}
+
+	draw_card(table->play_deck, table->used_deck, hand, NULL, &table->r);
+	get_hand_value(hand);
+}
+
+// Moves on to the first spot from 'spot' onwards that has a decision to make. Once there are none left, the dealer
+// plays, unless every spot busted.
+void move_to_next_spot(blackjack_table *table, int spot)
+{
+	for (; spot < table->spots; spot++)
+	{
+		if (!table->blackjacks[spot])
+		{
+			table->spot = spot;
+			table->phase = PHASE_PLAYER;
+			return;
+		}
+	}
+
+	for (spot = 0; spot < table->spots && table->player[spot].hand_value > 21; spot++);
+
+	table->phase = (spot == table->spots) ? PHASE_SETTLE : PHASE_DEALER;
+}
+
+// Works out the result and payout of every spot in a finished round.
+void settle_table(blackjack_table *table)
+{
+	int spot;
+	hand *player, *dealer = table->dealer;
+
+	table->hidden = 0;
+	table->payout = 0;
+
+	for (spot = 0; spot < table->spots; spot++)
+	{
+		player = &table->player[spot];
+		table->payouts[spot] = (int)(table->bets[spot] * (1.0 + get_round_result(player->hand_value, dealer->hand_value, table->blackjacks[spot])));
+		table->payout += table->payouts[spot];
+
+		if (dealer->total_cards == 2 && dealer->hand_value == 21 && player->total_cards == 2)
+		{
+			table->results[spot] = (player->hand_value == 21) ? BLACKJACK_RESULT_BOTH_BLACKJACK : BLACKJACK_RESULT_DEALER_BLACKJACK;
+		}
+		else if (player->hand_value > 21)
+		{
+			table->results[spot] = BLACKJACK_RESULT_PLAYER_BUST;
+		}
+		else if (dealer->hand_value > 21)
+		{
+			table->results[spot] = BLACKJACK_RESULT_DEALER_BUST;
+		}
+		else if (dealer->hand_value == player->hand_value)
+		{
+			table->results[spot] = BLACKJACK_RESULT_PUSH;
+		}
+		else
+		{
+			table->results[spot] = (dealer->hand_value > player->hand_value) ? BLACKJACK_RESULT_DEALER_WINS : BLACKJACK_RESULT_PLAYER_WINS;
+		}
+	}
+
+	table->event = BLACKJACK_EVENT_SETTLED;
+	table->phase = PHASE_OVER;
+}
+
+int blackjack_start_round(blackjack_table *table, int bet)
+{
+	return blackjack_start_spots(table, &bet, 1);
+}
+
+int blackjack_start_spots(blackjack_table *table, const int *bets, int spots)
+{
+	int spot;
+
+	if (table->phase != PHASE_BET || spots < 1 || spots > MAX_SPOT_COUNT)
+	{
+		return get_table_status(table);
+	}
+
+	for (spot = 0; spot < spots; spot++)
+	{
+		table->bets[spot] = bets[spot];
+		table->blackjacks[spot] = 0;
+		table->payouts[spot] = 0;
+	}
+
+	table->spots = spots;
+	table->spot = 0;
+	table->hidden = 1;
+	table->payout = 0;
+	table->reshuffles = 0;
+	table->event = BLACKJACK_EVENT_NONE;
+	table->phase = PHASE_DEAL;
+
+	return BLACKJACK_RUNNING;
+}
+
+int blackjack_apply(blackjack_table *table, int action)
+{
+	hand *player = &table->player[table->spot];
+
+	if (table->phase != PHASE_PLAYER)
+	{
+		return get_table_status(table);
+	}
+
+	table->reshuffles = 0;
+	table->event = BLACKJACK_EVENT_NONE;
+
+	if (action == BLACKJACK_HIT)
+	{
+		draw_table_card(table, player);
+		table->event = BLACKJACK_EVENT_PLAYER_CARD;
+
+		// The player can't draw past 21.
+		if (player->hand_value >= 21)
+		{
+			move_to_next_spot(table, table->spot + 1);
+		}
+	}
+	else
+	{
+		move_to_next_spot(table, table->spot + 1);
+	}
+
+	return get_table_status(table);
+}
+
+int blackjack_step(blackjack_table *table)
+{
+	int spot, dealt;
+	hand *dealer = table->dealer;
+
+	table->reshuffles = 0;
+	table->event = BLACKJACK_EVENT_NONE;
+
+	if (table->phase == PHASE_DEAL)
+	{
+		for (spot = 0, dealt = dealer->total_cards; spot < table->spots; spot++)
+		{
+			dealt += table->player[spot].total_cards;
+		}
+
+		// Goes round the spots and then the dealer, so the dealer's first card is the hole card.
+		spot = dealt % (table->spots + 1);
+		draw_table_card(table, (spot < table->spots) ? &table->player[spot] : dealer);
+		table->event = BLACKJACK_EVENT_CARD;
+
+		if (dealt + 1 == (INITIAL_CARD_DRAW / 2) * (table->spots + 1))
+		{
+			table->phase = PHASE_DEALT;
+		}
+	}
+	else if (table->phase == PHASE_DEALT)
+	{
+		table->event = BLACKJACK_EVENT_DEALT;
+
+		for (spot = 0; spot < table->spots; spot++)
+		{
+			table->blackjacks[spot] = (table->player[spot].hand_value == 21);
+		}
+
+		if (dealer->hand_value == 21)
+		{
+			table->phase = PHASE_SETTLE;
+		}
+		else
+		{
+			move_to_next_spot(table, 0);
+		}
+	}
+	else if (table->phase == PHASE_DEALER)
+	{
+		table->hidden = 0;
+		table->event = BLACKJACK_EVENT_REVEAL;
+		table->phase = PHASE_DEALER_DRAW;
+	}
+	else if (table->phase == PHASE_DEALER_DRAW && dealer->hand_value < DEALER_HOLD_VALUE)
+	{
+		draw_table_card(table, dealer);
+		table->event = BLACKJACK_EVENT_DEALER_CARD;
+	}
+	else if (table->phase == PHASE_DEALER_DRAW || table->phase == PHASE_SETTLE)
+	{
+		settle_table(table);
+	}
+	else if (table->phase == PHASE_OVER && table->shuffler != NULL)
+	{
+		return_hands_to_csm(table->shuffler, dealer, table->player, table->spots);
+		table->phase = PHASE_BET;
+	}
+	else if (table->phase == PHASE_OVER)
+	{
+		disgard_hands(table->used_deck, dealer, table->player, table->spots);
+		table->phase = PHASE_BET;
+	}
+
+	return get_table_status(table);
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------------- START OF SIDE BET FUNCTIONS ------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+Side bets are settled from the player's first two cards and the dealer's up
+card, right after the initial draw. Lucky Ladies also looks at whether the
+dealer has a blackjack.
+
+	Perfect Pairs  Same rank and suit 25:1, same colour 12:1, any pair 6:1.
+	21+3           Suited three of a kind 100:1, straight flush 40:1,
+	               three of a kind 30:1, straight 10:1, flush 5:1.
+	               Aces are high or low, but straights don't wrap around.
+	Lucky Ladies   Two queens of hearts with a dealer blackjack 1000:1,
+	               two queens of hearts 200:1, a 20 of the same rank and
+	               suit 25:1, a suited 20 10:1, any 20 4:1.
+
+get_side_bet_odds() works out the exact expected value of all three from the
+number of each card left in the shoe. Every hand is counted with sums over
+suit and rank totals, so it takes a few hundred operations however many
+decks are in the shoe.
+
+==============================================================================*/
+
+#define SUIT_COUNT 4
+#define FACE_COUNT 13
+#define QUEEN_FACE 12
+#define HEARTS 2
+#define STRAIGHT_COUNT 12
+#define PERFECT_PAIR_PAYS 25
+#define COLORED_PAIR_PAYS 12
+#define MIXED_PAIR_PAYS 6
+#define SUITED_TRIPS_PAYS 100
+#define STRAIGHT_FLUSH_PAYS 40
+#define THREE_OF_A_KIND_PAYS 30
+#define STRAIGHT_PAYS 10
+#define FLUSH_PAYS 5
+#define LADIES_JACKPOT_PAYS 1000
+#define QUEEN_OF_HEARTS_PAIR_PAYS 200
+#define MATCHED_TWENTY_PAYS 25
+#define SUITED_TWENTY_PAYS 10
+#define ANY_TWENTY_PAYS 4
+
+enum side_bet
+{
+	SIDE_PERFECT_PAIRS,
+	SIDE_21_PLUS_3,
+	SIDE_LUCKY_LADIES,
+	SIDE_BET_COUNT
+};
+
+char *side_bet_names[SIDE_BET_COUNT] = {"Perfect Pairs", "21+3", "Lucky Ladies"};
+
+// Set when the game is started with --side-bets.
+int side_bets_enabled = 0;
+
+// Gets the face of a card: 1 for an ace, 2 - 10, then 11 - 13 for jacks, queens and kings.
+int get_card_face(int c_num)
+{
+	c_num = (c_num % CARDS_IN_A_DECK) % FACE_COUNT;
+
+	return (c_num == 0) ? FACE_COUNT : c_num;
+}
+
+// Diamonds and hearts are red.
+int is_red_suit(int suit)
+{
+	return (suit == 1) || (suit == HEARTS);
+}
+
+// Gets the index of a card in a single deck, suits in the same order as get_card_suit().
+int get_card_index(int suit, int face)
+{
+	return (suit * FACE_COUNT + face) % CARDS_IN_A_DECK;
+}
+
+// Counts the cards left in a deck by suit and face, indexed like get_card_index().
+void count_shoe_cards(deck *play_deck, int *cards)
+{
+	int i;
+
+	for (i = 0; i < CARDS_IN_A_DECK; i++)
+	{
+		cards[i] = 0;
+	}
+
+	for (i = 0; i < play_deck->total_cards; i++)
+	{
+		cards[play_deck->deck[i] % CARDS_IN_A_DECK]++;
+	}
+}
+
+// Checks whether three faces make a straight. The lowest face goes from aces (A-2-3) up to queens (Q-K-A).
+int is_straight(int a, int b, int c)
+{
+	int low;
+
+	for (low = 1; low <= STRAIGHT_COUNT; low++)
+	{
+		int has_low = (a == low || b == low || c == low);
+		int has_middle = (a == low + 1 || b == low + 1 || c == low + 1);
+		int has_high = (a == low + 2 || b == low + 2 || c == low + 2) || ((low + 2) == FACE_COUNT + 1 && (a == 1 || b == 1 || c == 1));
+
+		if (has_low && has_middle && has_high)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Settles a side bet from the player's first two cards, the dealer's hole card and up card.
+// Returns what it pays to one, or 0 if it lost. 'name' is set to the hand that won.
+int get_side_bet_payout(int side_bet, int first, int second, int hole, int up, const char **name)
+{
+	int suited = (get_card_suit(first) == get_card_suit(second)), pair = (get_card_face(first) == get_card_face(second));
+	int queen_of_hearts = get_card_index(HEARTS, QUEEN_FACE);
+
+	*name = "";
+
+	if (side_bet == SIDE_PERFECT_PAIRS && pair)
+	{
+		if (suited)
+		{
+			*name = "Perfect pair";
+			return PERFECT_PAIR_PAYS;
+		}
+		else if (is_red_suit(get_card_suit(first)) == is_red_suit(get_card_suit(second)))
+		{
+			*name = "Colored pair";
+			return COLORED_PAIR_PAYS;
+		}
+
+		*name = "Mixed pair";
+		return MIXED_PAIR_PAYS;
+	}
+	else if (side_bet == SIDE_21_PLUS_3)
+	{
+		int flush = suited && (get_card_suit(up) == get_card_suit(first));
+		int trips = pair && (get_card_face(up) == get_card_face(first));
+		int straight = is_straight(get_card_face(first), get_card_face(second), get_card_face(up));
+
+		if (trips)
+		{
+			*name = flush ? "Suited three of a kind" : "Three of a kind";
+			return flush ? SUITED_TRIPS_PAYS : THREE_OF_A_KIND_PAYS;
+		}
+		else if (straight)
+		{
+			*name = flush ? "Straight flush" : "Straight";
+			return flush ? STRAIGHT_FLUSH_PAYS : STRAIGHT_PAYS;
+		}
+		else if (flush)
+		{
+			*name = "Flush";
+			return FLUSH_PAYS;
+		}
+	}
+	else if (side_bet == SIDE_LUCKY_LADIES && get_card_value(first) + get_card_value(second) == 20)
+	{
+		if (first % CARDS_IN_A_DECK == queen_of_hearts && second % CARDS_IN_A_DECK == queen_of_hearts)
+		{
+			if (get_card_value(hole) + get_card_value(up) == 21)
+			{
+				*name = "Queen of hearts pair with a dealer blackjack";
+				return LADIES_JACKPOT_PAYS;
+			}
+
+			*name = "Queen of hearts pair";
+			return QUEEN_OF_HEARTS_PAIR_PAYS;
+		}
+		else if (suited && pair)
+		{
+			*name = "Matched 20";
+			return MATCHED_TWENTY_PAYS;
+		}
+		else if (suited)
+		{
+			*name = "Suited 20";
+			return SUITED_TWENTY_PAYS;
+		}
+
+		*name = "Any 20";
+		return ANY_TWENTY_PAYS;
+	}
+
+	return 0;
+}
+
+// Works out the expected net result of one unit on each side bet when the next cards come from a shoe holding
+// 'cards' of each card. (Indexed like get_card_index()) Needs at least four cards.
+void get_side_bet_odds(const int *cards, double *values)
+{
+	int s, f, i, suits[SUIT_COUNT] = {0}, faces[FACE_COUNT + 1] = {0}, tens[SUIT_COUNT] = {0};
+	double n = 0.0, pairs, triples, perfect = 0.0, colored = 0.0, mixed = 0.0;
+	double suited_trips = 0.0, trips = 0.0, straight_flush = 0.0, straight = 0.0, flush = 0.0;
+	double any_twenty, suited_twenty = 0.0, matched = 0.0, queens, jackpot, all_tens = 0.0, aces, nines;
+	int queen_of_hearts = cards[get_card_index(HEARTS, QUEEN_FACE)];
+
+	for (s = 0; s < SUIT_COUNT; s++)
+	{
+		for (f = 1; f <= FACE_COUNT; f++)
+		{
+			double c = cards[get_card_index(s, f)];
+
+			suits[s] += (int)c;
+			faces[f] += (int)c;
+			n += c;
+
+			// Ordered draws of the same card: two for the pair bets, three for 21+3.
+			perfect += c * (c - 1);
+			suited_trips += c * (c - 1) * (c - 2);
+
+			if (f >= 10)
+			{
+				tens[s] += (int)c;
+				matched += c * (c - 1);
+			}
+		}
+	}
+
+	pairs = n * (n - 1);
+	triples = pairs * (n - 2);
+
+	for (f = 1; f <= FACE_COUNT; f++)
+	{
+		double c[SUIT_COUNT];
+
+		for (s = 0; s < SUIT_COUNT; s++)
+		{
+			c[s] = cards[get_card_index(s, f)];
+		}
+
+		// Clubs and spades are black, diamonds and hearts red. Both orders of each two cards count.
+		colored += 2.0 * (c[0] * c[3] + c[1] * c[2]);
+		mixed += (double)faces[f] * (faces[f] - 1);
+		trips += (double)faces[f] * (faces[f] - 1) * (faces[f] - 2);
+	}
+
+	mixed -= perfect + colored;
+	trips -= suited_trips;
+
+	// Three different cards in a row can come out in six orders.
+	for (i = 1; i <= STRAIGHT_COUNT; i++)
+	{
+		int low = i, middle = i + 1, high = (i + 2 > FACE_COUNT) ? 1 : i + 2;
+
+		straight += 6.0 * faces[low] * faces[middle] * faces[high];
+
+		for (s = 0; s < SUIT_COUNT; s++)
+		{
+			straight_flush += 6.0 * cards[get_card_index(s, low)] * cards[get_card_index(s, middle)] * cards[get_card_index(s, high)];
+		}
+	}
+
+	straight -= straight_flush;
+
+	for (s = 0; s < SUIT_COUNT; s++)
+	{
+		flush += (double)suits[s] * (suits[s] - 1) * (suits[s] - 2);
+	}
+
+	flush -= suited_trips + straight_flush;
+
+	// Lucky Ladies: two ten-valued cards, or an ace and a nine.
+	for (s = 0; s < SUIT_COUNT; s++)
+	{
+		double suit_aces = cards[get_card_index(s, 1)], suit_nines = cards[get_card_index(s, 9)];
+
+		suited_twenty += (double)tens[s] * (tens[s] - 1) + 2.0 * suit_aces * suit_nines;
+		all_tens += tens[s];
+	}
+
+	aces = faces[1];
+	nines = faces[9];
+	any_twenty = all_tens * (all_tens - 1) + 2.0 * aces * nines;
+	queens = (double)queen_of_hearts * (queen_of_hearts - 1);
+
+	// After two queens of hearts the dealer needs an ace and one of the ten-valued cards left, in either order.
+	jackpot = queens * (2.0 * aces * (all_tens - 2)) / ((n - 2) * (n - 3));
+
+	any_twenty -= suited_twenty;
+	suited_twenty -= matched;
+	matched -= queens;
+	queens -= jackpot;
+
+	values[SIDE_PERFECT_PAIRS] = (PERFECT_PAIR_PAYS * perfect + COLORED_PAIR_PAYS * colored + MIXED_PAIR_PAYS * mixed) / pairs;
+	values[SIDE_PERFECT_PAIRS] -= 1.0 - (perfect + colored + mixed) / pairs;
+
+	values[SIDE_21_PLUS_3] = (SUITED_TRIPS_PAYS * suited_trips + STRAIGHT_FLUSH_PAYS * straight_flush + THREE_OF_A_KIND_PAYS * trips + STRAIGHT_PAYS * straight + FLUSH_PAYS * flush) / triples;
+	values[SIDE_21_PLUS_3] -= 1.0 - (suited_trips + straight_flush + trips + straight + flush) / triples;
+
+	values[SIDE_LUCKY_LADIES] = (LADIES_JACKPOT_PAYS * jackpot + QUEEN_OF_HEARTS_PAIR_PAYS * queens + MATCHED_TWENTY_PAYS * matched + SUITED_TWENTY_PAYS * suited_twenty + ANY_TWENTY_PAYS * any_twenty) / pairs;
+	values[SIDE_LUCKY_LADIES] -= 1.0 - (jackpot + queens + matched + suited_twenty + any_twenty) / pairs;
+}
+
+// Works out the side bets by going through every order the first four cards can be dealt in. Much slower than
+// get_side_bet_odds(), but it settles each deal with get_side_bet_payout(), so it checks the counting.
+void enumerate_side_bet_odds(const int *cards, double *values)
+{
+	int a, b, c, d, i, left[CARDS_IN_A_DECK], n = 0;
+	double weight_a, weight_b, weight_c, total, chance;
+	const char *name;
+
+	for (i = 0; i < CARDS_IN_A_DECK; i++)
+	{
+		left[i] = cards[i];
+		n += cards[i];
+	}
+
+	for (i = 0; i < SIDE_BET_COUNT; i++)
+	{
+		values[i] = 0.0;
+	}
+
+	total = (double)n * (n - 1) * (n - 2) * (n - 3);
+
+	// Dealt in the same order as blackjack(): player, dealer's hole card, player, dealer's up card.
+	for (a = 0; a < CARDS_IN_A_DECK; a++)
+	{
+		if (left[a] == 0)
+		{
+			continue;
+		}
+
+		weight_a = left[a]--;
+
+		for (b = 0; b < CARDS_IN_A_DECK; b++)
+		{
+			if (left[b] == 0)
+			{
+				continue;
+			}
+
+			weight_b = weight_a * left[b]--;
+
+			for (c = 0; c < CARDS_IN_A_DECK; c++)
+			{
+				if (left[c] == 0)
+				{
+					continue;
+				}
+
+				weight_c = weight_b * left[c]--;
+
+				for (d = 0; d < CARDS_IN_A_DECK; d++)
+				{
+					if (left[d] == 0)
+					{
+						continue;
+					}
+
+					chance = weight_c * left[d] / total;
+
+					for (i = 0; i < SIDE_BET_COUNT; i++)
+					{
+						int pays = get_side_bet_payout(i, a, c, b, d, &name);
+
+						values[i] += chance * ((pays > 0) ? pays : -1.0);
+					}
+				}
+
+				left[c]++;
+			}
+
+			left[b]++;
+		}
+
+		left[a]++;
+	}
+}
+
+// Asks for each side bet before the cards are dealt, showing how much it is expected to return on the cards left.
+void place_side_bets(deck *play_deck, deck *used_deck, int *money, int *side_bets)
+{
+	int i, cards[CARDS_IN_A_DECK];
+	double values[SIDE_BET_COUNT];
+	char message[128];
+
+	// The deal reshuffles if the shoe runs out, so with fewer than four cards left the whole shoe is used.
+	count_shoe_cards(play_deck, cards);
+
+	if (play_deck->total_cards < INITIAL_CARD_DRAW)
+	{
+		for (i = 0; i < used_deck->total_cards; i++)
+		{
+			cards[used_deck->deck[i] % CARDS_IN_A_DECK]++;
+		}
+	}
+
+	get_side_bet_odds(cards, values);
+
+	for (i = 0; i < SIDE_BET_COUNT; i++)
+	{
+		side_bets[i] = 0;
+
+		if (*money <= 0)
+		{
+			continue;
+		}
+
+		snprintf(message, sizeof(message), "%s returns %+.2f%% on this shoe. How much do you want on it?", side_bet_names[i], values[i] * 100.0);
+		side_bets[i] = get_number_input(message, 0, *money, 1);
+		clear_scanf_buffer();
+
+		*money -= side_bets[i];
+	}
+}
+
+// Pays out the side bets once the first four cards are down. Writes a line about each one placed into 'text'.
+// A settled bet is cleared, so calling this again for the same deal pays nothing. Returns 0 if none were placed.
+int settle_side_bets(hand *player, hand *dealer, int *money, int *side_bets, char *text, size_t size)
+{
+	int i, pays, placed = 0;
+	size_t length = 0;
+	const char *name;
+
+	text[0] = '\0';
+
+	for (i = 0; i < SIDE_BET_COUNT; i++)
+	{
+		if (side_bets[i] == 0)
+		{
+			continue;
+		}
+
+		placed = 1;
+		pays = get_side_bet_payout(i, player->hand[0], player->hand[1], dealer->hand[0], dealer->hand[1], &name);
+
+		if (pays > 0)
+		{
+			snprintf(text + length, size - length, "%s: %s pays %d to 1! You won $%d!\n", side_bet_names[i], name, pays, side_bets[i] * pays);
+			*money += side_bets[i] * (pays + 1);
+		}
+		else
+		{
+			snprintf(text + length, size - length, "%s: You lost the side bet of $%d.\n", side_bet_names[i], side_bets[i]);
+		}
+
+		length += strlen(text + length);
+		side_bets[i] = 0;
+	}
+
+	return placed;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+---------------------------- START OF EV ADVISOR -------------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+With --advisor the hit or stand prompt shows what standing and hitting are
+expected to return, worked out exactly from the cards the player hasn't seen.
+(The play deck and the dealer's hole card)
+
+The sums run on a thread of their own, started as soon as the cards are down
+and again after every hit. The game only ever reads what the thread has
+finished. If the answer isn't ready the prompt says so, and (a)dvice asks again
+without using up a turn. When the player acts first, the answer that was being
+worked on is thrown away. Every finished answer also goes in a cache keyed on
+the hand and the unseen cards, so a situation seen before is answered without
+waking the thread at all.
+
+==============================================================================*/
+
+#define ADVICE_STAND 0
+#define ADVICE_HIT 1
+#define ADVICE_VALUES 2
+#define ADVICE_CACHE_SIZE 4096
+
+// Everything an answer depends on. Only unsigned chars, so requests can be compared with memcmp().
+typedef struct advice_request
+{
+	unsigned char counts[RANK_COUNT];
+	unsigned char total;
+	unsigned char ace_count;
+	unsigned char up_rank;
+} advice_request;
+
+typedef struct advice_entry
+{
+	advice_request request;
+	unsigned char used;
+	double values[ADVICE_VALUES];
+} advice_entry;
+
+// Fills values[ADVICE_STAND] and values[ADVICE_HIT] for a request. 'new_shoe' is set when the request doesn't follow
+// on from the last one, (A new round, or a reshuffle) so anything the solver kept about the old shoe has to go.
+typedef void (*advice_solver)(const advice_request *request, int new_shoe, double *values);
+
+typedef struct ev_advisor
+{
+	advice_solver solve;
+	// Everything below is only touched with the lock held. The thread never holds it while solving.
+	advice_entry *cache;
+	advice_request pending;
+	int waiting;
+	int new_shoe;
+	// Requests are numbered. The answer in 'values' belongs to the newest one when 'answered' has caught up.
+	long long posted;
+	long long answered;
+	double values[ADVICE_VALUES];
+	#ifndef _WIN32
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	#endif
+} ev_advisor;
+
+// The advisor shown at the prompt when the game is started with --advisor.
+ev_advisor *advisor = NULL;
+ev_advisor advisor_state;
+
+// Gets the cache slot for a request. A new answer replaces whatever was in its slot.
+advice_entry *get_advice_slot(ev_advisor *advisor, const advice_request *request)
+{
+	size_t i, hash = 14695981039346656037ULL;
+	const unsigned char *bytes = (const unsigned char *)request;
+
+	for (i = 0; i < sizeof(advice_request); i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	return &advisor->cache[hash & (ADVICE_CACHE_SIZE - 1)];
+}
+
+#ifndef _WIN32
+void *advisor_thread(void *argument)
+{
+	ev_advisor *advisor = argument;
+	advice_request request;
+	advice_entry *entry;
+	long long number;
+	int new_shoe;
+	double values[ADVICE_VALUES];
+
+	pthread_mutex_lock(&advisor->lock);
+
+	while (1)
+	{
+		while (!advisor->waiting)
+		{
+			pthread_cond_wait(&advisor->wake, &advisor->lock);
+		}
+
+		request = advisor->pending;
+		number = advisor->posted;
+		new_shoe = advisor->new_shoe;
+		advisor->waiting = 0;
+		advisor->new_shoe = 0;
+
+		pthread_mutex_unlock(&advisor->lock);
+		advisor->solve(&request, new_shoe, values);
+		pthread_mutex_lock(&advisor->lock);
+
+		entry = get_advice_slot(advisor, &request);
+		entry->request = request;
+		entry->used = 1;
+		memcpy(entry->values, values, sizeof(values));
+
+		// The player may have acted while this was being worked out. Then it only goes in the cache.
+		if (advisor->posted == number)
+		{
+			memcpy(advisor->values, values, sizeof(values));
+			advisor->answered = number;
+		}
+	}
+
+	return NULL;
+}
+
+// Starts the advisor thread. Returns 0 if it couldn't be started.
+int start_advisor(advice_solver solve)
+{
+	advisor_state.solve = solve;
+	advisor_state.cache = calloc(ADVICE_CACHE_SIZE, sizeof(advice_entry));
+	advisor_state.waiting = 0;
+	advisor_state.new_shoe = 1;
+	advisor_state.posted = 0;
+	advisor_state.answered = 0;
+
+	if (advisor_state.cache == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'advisor' - 01.\n");
+		return 0;
+	}
+
+	pthread_mutex_init(&advisor_state.lock, NULL);
+	pthread_cond_init(&advisor_state.wake, NULL);
+
+	// The thread is never joined. It holds nothing the game needs, so it just goes away with the process.
+	if (create_game_thread(&advisor_state.thread, advisor_thread, &advisor_state) != 0)
+	{
+		printf("The advisor thread could not be started.\n");
+		free(advisor_state.cache);
+		return 0;
+	}
+
+	advisor = &advisor_state;
+
+	return 1;
+}
+#endif
+
+// Asks the advisor about the player's hand as it stands. Answers straight from the cache when it can, otherwise
+// hands the request to the thread, replacing any request it hasn't started on yet.
+void post_advice(hand *player, hand *dealer, deck *play_deck, int new_shoe)
+{
+	#ifndef _WIN32
+	int i, value, counts[RANK_COUNT];
+	advice_request request;
+	advice_entry *entry;
+
+	if (advisor == NULL)
+	{
+		return;
+	}
+
+	// The player hasn't seen the dealer's hole card, so it is still one of the cards that could come.
+	count_shoe(play_deck, counts);
+	counts[get_card_rank(dealer->hand[0])]++;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		request.counts[i] = (unsigned char)counts[i];
+	}
+
+	request.total = 0;
+	request.ace_count = 0;
+	request.up_rank = (unsigned char)get_card_rank(dealer->hand[1]);
+
+	for (i = 0; i < player->total_cards; i++)
+	{
+		value = get_card_value(player->hand[i]);
+		request.total += (unsigned char)value;
+		request.ace_count += (value == 11);
+	}
+
+	pthread_mutex_lock(&advisor->lock);
+
+	(advisor->posted)++;
+	advisor->new_shoe |= new_shoe;
+	entry = get_advice_slot(advisor, &request);
+
+	if (entry->used && memcmp(&entry->request, &request, sizeof(request)) == 0)
+	{
+		memcpy(advisor->values, entry->values, sizeof(advisor->values));
+		advisor->answered = advisor->posted;
+		advisor->waiting = 0;
+	}
+	else
+	{
+		advisor->pending = request;
+		advisor->waiting = 1;
+		pthread_cond_signal(&advisor->wake);
+	}
+
+	pthread_mutex_unlock(&advisor->lock);
+	#else
+	(void)player;
+	(void)dealer;
+	(void)play_deck;
+	(void)new_shoe;
+	#endif
+}
+
+// Drops the current request once the player has acted. If the thread is still on it, its answer only goes in the cache.
+void cancel_advice(void)
+{
+	#ifndef _WIN32
+	if (advisor == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&advisor->lock);
+	(advisor->posted)++;
+	advisor->waiting = 0;
+	pthread_mutex_unlock(&advisor->lock);
+	#endif
+}
+
+// Writes the advisor's line for the hit or stand prompt into 'text'. Never waits for the thread.
+// Returns 0 without an advisor.
+int get_advice_text(char *text, size_t size)
+{
+	#ifndef _WIN32
+	int ready;
+	double values[ADVICE_VALUES];
+
+	if (advisor == NULL)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&advisor->lock);
+	ready = (advisor->answered == advisor->posted);
+	memcpy(values, advisor->values, sizeof(values));
+	pthread_mutex_unlock(&advisor->lock);
+
+	if (ready)
+	{
+		snprintf(text, size, "Advisor: standing returns %+.3f, hitting returns %+.3f. %s is better.\n", values[ADVICE_STAND], values[ADVICE_HIT], (values[ADVICE_HIT] > values[ADVICE_STAND]) ? "Hitting" : "Standing");
+	}
+	else
+	{
+		snprintf(text, size, "Advisor: still working it out. Press (a) to ask again.\n");
+	}
+
+	return 1;
+	#else
+	(void)text;
+	(void)size;
+
+	return 0;
+	#endif
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------ START OF GRAPHICS AND ASCII ART FUNCTIONS -------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Text drawn while rendering a tile of the multi-table view instead of going straight to the screen.
+typedef struct canvas
+{
+	char *text;
+	size_t length;
+	size_t capacity;
+} canvas;
+
+// Where draw_text() sends its output. NULL means the screen.
+canvas *render_target = NULL;
+
+// One line of a pre-rendered card. Unicode borders take several bytes per character, so lengths vary.
+typedef struct card_sprite
+{
+	char text[CARD_SPRITE_SIZE];
+	int length;
+} card_sprite;
+
+// Every card face, the hidden back and the empty slot, line by line. Built by build_card_atlas().
+card_sprite card_atlas[SPRITE_COUNT][CARD_LINES];
+int card_atlas_built = 0;
+
+#ifdef _WIN32
+#define CARD_TOP "-----------"
+#define CARD_BOTTOM "-----------"
+#define CARD_SIDE "|"
+#define CARD_BACK "XXXXXXXXX"
+#define EMPTY_SLOT_TOP "- - - - - -"
+#define EMPTY_SLOT_BOTTOM "- - - - - -"
+#else
+#define CARD_TOP "┌─────────┐"
+#define CARD_BOTTOM "└─────────┘"
+#define CARD_SIDE "│"
+#define CARD_BACK "░░░░░░░░░"
+#define EMPTY_SLOT_TOP "┌ ─ ─ ─ ─ ┐"
+#define EMPTY_SLOT_BOTTOM "└ ─ ─ ─ ─ ┘"
+#endif
+
+// Makes room for 'length' more bytes and the null terminator in a canvas.
+void grow_canvas(canvas *target, size_t length)
+{
+	if (target->length + length + 1 <= target->capacity)
+	{
+		return;
+	}
+
+	while (target->length + length + 1 > target->capacity)
+	{
+		target->capacity = (target->capacity == 0) ? 4096 : (target->capacity * 2);
+	}
+
+	target->text = realloc(target->text, target->capacity);
+	if (target->text == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'canvas' - 01.\n");
+		exit(1);
+	}
+}
+
+// printf() for everything that draws the table, so the same layout code can render into a canvas.
+void draw_text(const char *format, ...)
+{
+	int needed;
+	va_list args;
+
+	va_start(args, format);
+
+	if (render_target == NULL)
+	{
+		vprintf(format, args);
+		va_end(args);
+		return;
+	}
+
+	needed = vsnprintf(render_target->text + render_target->length, render_target->capacity - render_target->length, format, args);
+	va_end(args);
+
+	// The canvas was too small, so grow it and draw again.
+	if (render_target->length + needed + 1 > render_target->capacity)
+	{
+		grow_canvas(render_target, needed);
+
+		va_start(args, format);
+		vsnprintf(render_target->text + render_target->length, render_target->capacity - render_target->length, format, args);
+		va_end(args);
+	}
+
+	render_target->length += needed;
+}
+
+// Draws text that is already laid out, without going through a format string.
+void draw_bytes(const char *text, size_t length)
+{
+	if (render_target == NULL)
+	{
+		fwrite(text, 1, length, stdout);
+		return;
+	}
+
+	grow_canvas(render_target, length);
+	memcpy(render_target->text + render_target->length, text, length);
+	render_target->length += length;
+	render_target->text[render_target->length] = '\0';
+}
+
+// Clears the screen. May or may not work on all terminal interfaces.
+void cls(void)
+{
+	// Tiles rendered into a canvas are placed by the multi-table view, so there's nothing to clear.
+	// A transcript keeps every screen one after the other.
+	if (render_target != NULL || script_mode)
+	{
+		return;
+	}
+
+	#ifdef _WIN32
+	system("cls");
+	#else
+	printf("\e[1;1H\e[2J");
+	#endif
+}
+
+void print_blackjack_ascii_art(void)
+{
+	#ifdef _WIN32
+	printf("-------------------------------------\n");
+	printf("          Simple Blackjack\n");
+	printf("-------------------------------------\n");
+	#else
+	printf("  ____  _                 _        ____  _            _     _            _    \n");
+	printf(" / ___|(_)_ __ ___  _ __ | | ___  | __ )| | __ _  ___| | __(_) __ _  ___| | __\n");
+	printf(" \\___ \\| | '_ ` _ \\| '_ \\| |/ _ \\ |  _ \\| |/ _` |/ __| |/ /| |/ _` |/ __| |/ /\n");
+	printf("  ___) | | | | | | | |_) | |  __/ | |_) | | (_| | (__|   < | | (_| | (__|   < \n");
+	printf(" |____/|_|_| |_| |_| .__/|_|\\___| |____/|_|\\__,_|\\___|_|\\_\\/ |\\__,_|\\___|_|\\_\\\n");
+	printf("                   |_|                                   |__/                 \n\n");
+	#endif
+}
+
+void print_game_win(void)
+{
+	#ifdef _WIN32
+	printf("-------------------------------------\n");
+	printf("              You Win!\n");
+	printf("-------------------------------------\n");
+	#else
+	printf(" __      __                          __       __  __           \n");
+	printf("|  \\    /  \\                        |  \\  _  |  \\|  \\          \n");
+	printf(" \\$$\\  /  $$______   __    __       | $$ / \\ | $$ \\$$ _______  \n");
+	printf("  \\$$\\/  $$/      \\ |  \\  |  \\      | $$/  $\\| $$|  \\|       \\ \n");
+	printf("   \\$$  $$|  $$$$$$\\| $$  | $$      | $$  $$$\\ $$| $$| $$$$$$$\\\n");
+	printf("    \\$$$$ | $$  | $$| $$  | $$      | $$ $$\\$$\\$$| $$| $$  | $$\n");
+	printf("    | $$  | $$__/ $$| $$__/ $$      | $$$$  \\$$$$| $$| $$  | $$\n");
+	printf("    | $$   \\$$    $$ \\$$    $$      | $$$    \\$$$| $$| $$  | $$\n");
+	printf("     \\$$    \\$$$$$$   \\$$$$$$        \\$$      \\$$ \\$$ \\$$   \\$$\n\n");
+	#endif
+}
+
+void print_game_lose(void)
+{
+	#ifdef _WIN32
+	printf("-------------------------------------\n");
+	printf("            Game Over!\n");
+	printf("-------------------------------------\n");
+	#else
+	printf("   ____                         ___                 \n");
+	printf("  / ___| __ _ _ __ ___   ___   / _ \\__   _____ _ __ \n");
+	printf(" | |  _ / _` | '_ ` _ \\ / _ \\ | | | \\ \\ / / _ \\ '__|\n");
+	printf(" | |_| | (_| | | | | | |  __/ | |_| |\\ V /  __/ |   \n");
+	printf("  \\____|\\__,_|_| |_| |_|\\___|  \\___/  \\_/ \\___|_|   \n\n");
+	#endif
+}
+
+// Gets the symbol shown in the middle of the card for the specific suite.
+char *get_suite_symbol(int c_num)
+{
+	#ifdef _WIN32
+	char *symbols[4] = {"C", "D", "H", "S"};
+	#else
+	char *symbols[4] = {"♣", "♦", "♥", "♠"};
+	#endif
+
+	return symbols[get_card_suit(c_num)];
+}
+
+// Gets the symbol that all cards have in the top left and bottom right of the card.
+void get_card_symbol(int c_num, char *symbol)
+{
+	int i;
+
+	// Bring the range of card values between 0 - 51.
+	c_num = c_num % CARDS_IN_A_DECK;
+
+	if (c_num % 13 == 0)
+	{
+		symbol[0] = 'K';
+	}
+	else if (c_num % 13 == 12)
+	{
+		symbol[0] = 'Q';
+	}
+	else if (c_num % 13 == 11)
+	{
+		symbol[0] = 'J';
+	}
+	else if (c_num % 13 == 10)
+	{
+		symbol[0] = '1';
+		symbol[1] = '0';
+		symbol[2] = '\0';
+		return;
+	}
+	else if (c_num % 13 == 1)
+	{
+		symbol[0] = 'A';
+	}
+	else
+	{
+		symbol[0] = '0' + (c_num % 13);
+	}
+
+	symbol[1] = '\0';
+}
+
+// Formats one line of a sprite into the atlas. Only called while the atlas is built.
+void set_card_sprite(int sprite, int line, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	card_atlas[sprite][line].length = vsnprintf(card_atlas[sprite][line].text, CARD_SPRITE_SIZE, format, args);
+	va_end(args);
+}
+
+// Pre-renders every card face, the hidden back and the empty slot once, so drawing a row is only copying bytes.
+void build_card_atlas(void)
+{
+	int c, line;
+	char symbol[MAX_SYMBOL_LENGTH];
+	const char *suite;
+
+	for (c = 0; c < CARDS_IN_A_DECK; c++)
+	{
+		get_card_symbol(c, symbol);
+		suite = get_suite_symbol(c);
+
+		for (line = 0; line < CARD_LINES; line++)
+		{
+			if (line == 0)
+			{
+				set_card_sprite(c, line, "%s", CARD_TOP);
+			}
+			else if (line == 1)
+			{
+				set_card_sprite(c, line, "%s%-9s%s", CARD_SIDE, symbol, CARD_SIDE);
+			}
+			else if (line == CARD_LINES / 2)
+			{
+				set_card_sprite(c, line, "%s    %s    %s", CARD_SIDE, suite, CARD_SIDE);
+			}
+			else if (line == CARD_LINES - 2)
+			{
+				set_card_sprite(c, line, "%s%9s%s", CARD_SIDE, symbol, CARD_SIDE);
+			}
+			else if (line == CARD_LINES - 1)
+			{
+				set_card_sprite(c, line, "%s", CARD_BOTTOM);
+			}
+			else
+			{
+				set_card_sprite(c, line, "%s         %s", CARD_SIDE, CARD_SIDE);
+			}
+		}
+	}
+
+	// The back shares the face's borders.
+	for (line = 0; line < CARD_LINES; line++)
+	{
+		if (line == 0 || line == CARD_LINES - 1)
+		{
+			memcpy(&card_atlas[HIDDEN_SPRITE][line], &card_atlas[0][line], sizeof(card_sprite));
+		}
+		else
+		{
+			set_card_sprite(HIDDEN_SPRITE, line, "%s%s%s", CARD_SIDE, CARD_BACK, CARD_SIDE);
+		}
+	}
+
+	// The dashed outline shown while a hand has no cards.
+	for (line = 0; line < CARD_LINES; line++)
+	{
+		if (line == 0)
+		{
+			set_card_sprite(EMPTY_SPRITE, line, "%s", EMPTY_SLOT_TOP);
+		}
+		else if (line == CARD_LINES - 1)
+		{
+			set_card_sprite(EMPTY_SPRITE, line, "%s", EMPTY_SLOT_BOTTOM);
+		}
+		else if (line % 2 == 0)
+		{
+			set_card_sprite(EMPTY_SPRITE, line, "%s         %s", CARD_SIDE, CARD_SIDE);
+		}
+		else
+		{
+			set_card_sprite(EMPTY_SPRITE, line, "           ");
+		}
+	}
+
+	card_atlas_built = 1;
+}
+
+// Draws up to MAX_CARDS_IN_A_ROW sprites side by side, starting at 'start_index' of the hand.
+void print_card_row(hand *hand, int start_index, int count, int first_card_hidden)
+{
+	int i, line, sprite;
+	size_t length = 0;
+	char row[CARD_LINES * (MAX_CARDS_IN_A_ROW * CARD_SPRITE_SIZE + 1)];
+	card_sprite *slice;
+
+	for (line = 0; line < CARD_LINES; line++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (first_card_hidden && i == 0)
+			{
+				sprite = HIDDEN_SPRITE;
+			}
+			else if (hand == NULL)
+			{
+				sprite = EMPTY_SPRITE;
+			}
+			else
+			{
+				sprite = hand->hand[start_index + i] % CARDS_IN_A_DECK;
+			}
+
+			slice = &card_atlas[sprite][line];
+			memcpy(row + length, slice->text, slice->length);
+			length += slice->length;
+		}
+
+		row[length++] = '\n';
+	}
+
+	draw_bytes(row, length);
+}
+
+// Draws one hand's cards, wrapping to a new row every MAX_CARDS_IN_A_ROW cards.
+void print_hand(hand *hand, int first_card_hidden)
+{
+	int i, row, temp_card_total, cards[NUMBER_OF_ROWS];
+
+	// Prints the "no cards" element to the screen.
+	if (hand->total_cards == 0)
+	{
+		print_card_row(NULL, 0, 1, 0);
+		return;
+	}
+
+	// Initializes all the rows in the cards array to 0.
+	for (i = 0; i < NUMBER_OF_ROWS; i++)
+	{
+		cards[i] = 0;
+	}
+
+	// Adds cards to each row until the row surpasses the maximum number of cards allowed in the row.
+	// Wraps to another row when one becomes full.
+	for (temp_card_total = (hand->total_cards), row = 0; temp_card_total > 0; temp_card_total--)
+	{
+		if (cards[row] > (MAX_CARDS_IN_A_ROW - 1))
+		{
+			row++;
+		}
+
+		cards[row]++;
+	}
+
+	// Add 1 to the row variable to get the total number of rows instead of the highest row index.
+	row++;
+
+	// Only the first card of the first row can be hidden.
+	for (i = 0; i < row; i++)
+	{
+		print_card_row(hand, i * MAX_CARDS_IN_A_ROW, cards[i], first_card_hidden && (i == 0));
+	}
+}
+
+// Main function that handles the printing of cards to the screen.
+// Draws 'hand_count' hands one under the other. When there's more than one, each is labelled with its spot, its bet
+// from 'bets' and its value.
+void print_cards(hand *hands, int hand_count, int *bets, int first_card_hidden)
+{
+	int i;
+
+	// main() builds the atlas at startup. This covers anything that draws without going through it.
+	if (!card_atlas_built)
+	{
+		build_card_atlas();
+	}
+
+	for (i = 0; i < hand_count; i++)
+	{
+		if (hand_count > 1 && hands[i].total_cards > 0)
+		{
+			draw_text("Spot %d - $%d bet - value %d\n", i + 1, bets[i], hands[i].hand_value);
+		}
+		else if (hand_count > 1)
+		{
+			draw_text("Spot %d - $%d bet\n", i + 1, bets[i]);
+		}
+
+		print_hand(&hands[i], first_card_hidden);
+	}
+}
+
+// Draws the table with every spot's hand in 'player', which has 'spots' hands with the bets in 'bets'.
+void blackjack_ui(hand *player, int *bets, int spots, hand *dealer, int money, int win_amount, int hidden)
+{
+	int i, bet = 0;
+
+	for (i = 0; i < spots; i++)
+	{
+		bet += bets[i];
+	}
+
+	// Every state change redraws the UI, so this is where spectators get their copy.
+	publish_table_state(player, bets, spots, dealer, money, win_amount, hidden);
+
+	cls();
+
+	draw_text("Money: $%d\n", money);
+	draw_text("Minimum bet: $%d\n", MIN_BET);
+	draw_text("Current bet: $%d\n", bet);
+	draw_text("Required money to win: $%d\n", win_amount);
+	draw_text("\n");
+	draw_text("Note: You will lose if your money drops below the minimum bet.\n\n");
+	#ifdef _WIN32
+	draw_text("==============================================================\n\n");
+	#else
+	draw_text("♠============================================================♣\n\n");
+	#endif
+	draw_text("Dealer's cards:\n");
+
+	// Dealer's cards.
+	print_cards(dealer, 1, NULL, hidden);
+
+	// To prevent the first player card from being hidden.
+	hidden = 0;
+
+	draw_text("\n");
+	draw_text("Your cards:\n");
+
+	// Player's cards.
+	print_cards(player, spots, bets, hidden);
+
+	draw_text("\n");
+
+	#ifdef _WIN32
+	draw_text("==============================================================\n\n");
+	#else
+	draw_text("♦============================================================♥\n\n");
+	#endif
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------ END OF GRAPHICS AND ASCII ART FUNCTIONS ---------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------- START OF TABLE PIPELINE ------------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+blackjack() only works out what happens. Everything it used to draw, print,
+sleep on or record is sent as an event instead:
+
+	Render queue   Frames, text and pauses. The render thread draws them and
+	               does the pauses, so the dealing animation is paced there.
+	Log queue      Bets, settled rounds and reshuffles. The log thread updates
+	               the metrics page and writes the hand history.
+
+Each queue has one producer (the game) and one consumer, so both ends only
+need an atomic index each. An event is a copy of everything its consumer
+needs, taken when it was sent, so the game can carry on changing its own hands.
+The game only waits for the render queue to empty before reading input, so
+the player sees the table before being asked anything, and for both queues
+before blackjack() returns.
+
+Windows builds, and sessions played from a script, handle every event as it
+is sent, on the game's thread.
+
+==============================================================================*/
+
+// Must be a power of two.
+#define EVENT_QUEUE_SIZE 1024
+#define EVENT_TEXT_LENGTH 256
+#define EVENT_POLL_TIME 1
+
+enum table_event_type
+{
+	EVENT_FRAME,
+	EVENT_TEXT,
+	EVENT_PAUSE,
+	EVENT_BET,
+	EVENT_ROUND,
+	EVENT_RESHUFFLE
+};
+
+typedef struct table_event
+{
+	int type;
+	// Frames copy every spot. A round only needs the first hand.
+	hand player[MAX_SPOT_COUNT];
+	int bets[MAX_SPOT_COUNT];
+	int spots;
+	hand dealer;
+	int money;
+	int win_amount;
+	int hidden;
+	int bet;
+	int payout;
+	int outcome;
+	int blackjack;
+	int milliseconds;
+	char text[EVENT_TEXT_LENGTH];
+} table_event;
+
+typedef struct event_queue
+{
+	// Only the game moves the tail, once an event is filled in. Only the consumer moves the head, once it is done with one.
+	#ifndef _WIN32
+	_Atomic unsigned int tail;
+	_Atomic unsigned int head;
+	#endif
+	table_event events[EVENT_QUEUE_SIZE];
+} event_queue;
+
+event_queue render_queue;
+event_queue log_queue;
+int table_pipeline_started = 0;
+
+void handle_render_event(table_event *event)
+{
+	if (event->type == EVENT_FRAME)
+	{
+		blackjack_ui(event->player, event->bets, event->spots, &event->dealer, event->money, event->win_amount, event->hidden);
+	}
+	else if (event->type == EVENT_TEXT)
+	{
+		fputs(event->text, stdout);
+	}
+	else if (event->type == EVENT_PAUSE)
+	{
+		fflush(stdout);
+		slp(event->milliseconds);
+	}
+}
+
+void handle_log_event(table_event *event)
+{
+	if (event->type == EVENT_BET)
+	{
+		record_bet_metrics(event->bet, event->money, event->win_amount);
+	}
+	else if (event->type == EVENT_ROUND)
+	{
+		record_round_metrics(event->outcome, event->blackjack, event->money);
+		record_round_history(&event->player[0], &event->dealer, event->bet, event->payout);
+	}
+	else if (event->type == EVENT_RESHUFFLE)
+	{
+		record_reshuffle_metrics();
+	}
+}
+
+#ifndef _WIN32
+// Hands every event in a queue to its handler, in order, and sleeps while the queue is empty.
+void run_event_queue(event_queue *queue, void (*handle)(table_event *event))
+{
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+	while (1)
+	{
+		if (head == atomic_load_explicit(&queue->tail, memory_order_acquire))
+		{
+			// Anything drawn goes out before the thread sleeps.
+			fflush(stdout);
+			slp(EVENT_POLL_TIME);
+			continue;
+		}
+
+		handle(&queue->events[head & (EVENT_QUEUE_SIZE - 1)]);
+
+		head++;
+		atomic_store_explicit(&queue->head, head, memory_order_release);
+	}
+}
+
+void *render_thread(void *argument)
+{
+	(void)argument;
+	run_event_queue(&render_queue, handle_render_event);
+
+	return NULL;
+}
+
+void *log_thread(void *argument)
+{
+	(void)argument;
+	run_event_queue(&log_queue, handle_log_event);
+
+	return NULL;
+}
+
+// Starts the render and log threads. If either can't be started, events are handled as they are sent.
+void start_table_pipeline(void)
+{
+	pthread_t thread;
+
+	table_pipeline_started = 1;
+
+	atomic_store(&render_queue.head, 0);
+	atomic_store(&render_queue.tail, 0);
+	atomic_store(&log_queue.head, 0);
+	atomic_store(&log_queue.tail, 0);
+
+	// The threads are never joined. blackjack() waits for both queues to empty before returning.
+	if (create_game_thread(&thread, render_thread, NULL) != 0 || create_game_thread(&thread, log_thread, NULL) != 0)
+	{
+		printf("The render and log threads could not be started.\n");
+		exit(1);
+	}
+}
+
+// Waits until the consumer has finished with every event sent to a queue.
+void wait_for_queue(event_queue *queue)
+{
+	while (atomic_load_explicit(&queue->head, memory_order_acquire) != atomic_load_explicit(&queue->tail, memory_order_relaxed))
+	{
+		slp(EVENT_POLL_TIME);
+	}
+}
+#endif
+
+// Handles an event on the game's own thread, as it is sent.
+void handle_event_now(event_queue *queue, table_event *event)
+{
+	if (queue == &render_queue)
+	{
+		handle_render_event(event);
+	}
+	else
+	{
+		handle_log_event(event);
+	}
+}
+
+// Sends a copy of an event to a queue. Only waits if the consumer has fallen a whole queue behind.
+void send_event(event_queue *queue, table_event *event)
+{
+	#ifdef _WIN32
+	handle_event_now(queue, event);
+	#else
+	unsigned int tail;
+
+	// Scripted sessions keep everything on one thread, so the transcript comes out the same every run.
+	if (script_mode)
+	{
+		handle_event_now(queue, event);
+		return;
+	}
+
+	if (!table_pipeline_started)
+	{
+		start_table_pipeline();
+	}
+
+	tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+	while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == EVENT_QUEUE_SIZE)
+	{
+		slp(EVENT_POLL_TIME);
+	}
+
+	queue->events[tail & (EVENT_QUEUE_SIZE - 1)] = *event;
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	#endif
+}
+
+// Waits until everything sent to the render thread is on the screen. Called before reading any input.
+void wait_for_render(void)
+{
+	#ifndef _WIN32
+	if (table_pipeline_started)
+	{
+		wait_for_queue(&render_queue);
+		fflush(stdout);
+	}
+	#endif
+}
+
+// Waits until both threads have caught up with the game.
+void wait_for_table_pipeline(void)
+{
+	#ifndef _WIN32
+	if (table_pipeline_started)
+	{
+		wait_for_queue(&log_queue);
+	}
+	#endif
+
+	wait_for_render();
+}
+
+// Draws the table with 'spots' hands from 'player' and their bets.
+void emit_frame(hand *player, int *bets, int spots, hand *dealer, int money, int win_amount, int hidden)
+{
+	int i;
+	table_event event;
+
+	event.type = EVENT_FRAME;
+
+	for (i = 0; i < spots; i++)
+	{
+		event.player[i] = player[i];
+		event.bets[i] = bets[i];
+	}
+
+	event.spots = spots;
+	event.dealer = *dealer;
+	event.money = money;
+	event.win_amount = win_amount;
+	event.hidden = hidden;
+
+	send_event(&render_queue, &event);
+}
+
+// printf() for the game. The text is drawn after any frames sent before it.
+void emit_text(const char *format, ...)
+{
+	table_event event;
+	va_list args;
+
+	event.type = EVENT_TEXT;
+
+	va_start(args, format);
+	vsnprintf(event.text, sizeof(event.text), format, args);
+	va_end(args);
+
+	send_event(&render_queue, &event);
+}
+
+// Pauses the render thread, not the game.
+void emit_pause(int milliseconds)
+{
+	table_event event;
+
+	event.type = EVENT_PAUSE;
+	event.milliseconds = milliseconds;
+
+	send_event(&render_queue, &event);
+}
+
+void emit_bet(int bet, int money, int win_amount)
+{
+	table_event event;
+
+	event.type = EVENT_BET;
+	event.bet = bet;
+	event.money = money;
+	event.win_amount = win_amount;
+
+	send_event(&log_queue, &event);
+}
+
+// Records one spot of a settled round. 'outcome' and 'blackjack' are as record_round_metrics() takes them.
+void emit_round(hand *player, hand *dealer, int bet, int payout, int outcome, int blackjack, int money)
+{
+	table_event event;
+
+	event.type = EVENT_ROUND;
+	event.player[0] = *player;
+	event.dealer = *dealer;
+	event.bet = bet;
+	event.payout = payout;
+	event.outcome = outcome;
+	event.blackjack = blackjack;
+	event.money = money;
+
+	send_event(&log_queue, &event);
+}
+
+void emit_reshuffle(void)
+{
+	table_event event;
+
+	event.type = EVENT_RESHUFFLE;
+
+	send_event(&log_queue, &event);
+}
+
+// Spots the player plays each round, from --spots.
+int spot_count = 1;
+
+// Set by --csm. The game deals from a continuous shuffler instead of its decks.
+int csm_enabled = 0;
+
+// Main game function. 'player' needs 'hand_count' hands, one for each spot played every round.
+// Returns 1 if the player reached the win amount, 0 if they fell below the minimum bet, -1 if they exited,
+// or GAME_ROUNDS_OVER once '*rounds_left' is down to zero. Every round counts it down. (NULL means no limit)
+int blackjack(deck *play_deck, deck *used_deck, hand *player, int hand_count, hand *dealer, int *money, int win_amount, int num_decks, int *rounds_left)
+{
+	char input;
+	int spot, spots, acting, status, outcome, player_active, reshuffled, all_busted;
+	int bets[MAX_SPOT_COUNT] = {0};
+	int side_bets[SIDE_BET_COUNT] = {0};
+	char text[EVENT_TEXT_LENGTH];
+	blackjack_table table;
+	csm shuffler;
+
+	// The rules are played by the round engine. Everything here is drawing it and asking the player.
+	// With a game seed, the reshuffles use the next seed along so they don't repeat the opening shuffle.
+	blackjack_table_init(&table, play_deck, used_deck, player, dealer, (game_seed != 0) ? game_seed + 1 : (uint64_t)time(NULL));
+
+	if (csm_enabled)
+	{
+		blackjack_csm_init(&shuffler, num_decks);
+		blackjack_table_use_csm(&table, &shuffler);
+	}
+
+	while (1)
+	{
+		// Set up variables for this turn.
+		reshuffled = 0;
+
+		for (spot = 0; spot < hand_count; spot++)
+		{
+			bets[spot] = 0;
+		}
+
+		// Player loses if he has no more money to bet.
+		if (*money < MIN_BET)
+		{
+			wait_for_table_pipeline();
+			return 0;
+		}
+
+		// Tournaments only give the player a set number of rounds.
+		if (rounds_left != NULL && *rounds_left <= 0)
+		{
+			wait_for_table_pipeline();
+			return GAME_ROUNDS_OVER;
+		}
+
+		if (rounds_left != NULL)
+		{
+			(*rounds_left)--;
+		}
+
+		// Any call to this function will update the UI.
+		emit_frame(player, bets, hand_count, dealer, *money, win_amount, table.hidden);
+
+		// Gets the player's bet amount for each spot. Spots the player can't afford the minimum bet on sit out the round.
+		for (spots = 0; spots < hand_count && *money >= MIN_BET; spots++)
+		{
+			if (hand_count > 1)
+			{
+				snprintf(text, sizeof(text), "How much money do you want to bet on spot %d? There is no need for a dollar sign.", spots + 1);
+			}
+			else
+			{
+				snprintf(text, sizeof(text), "How much money do you want to bet? There is no need for a dollar sign.");
+			}
+
+			for (player_active = 1; player_active; )
+			{
+				wait_for_render();
+				bets[spots] = get_number_input(text, MIN_BET, (MAX_MONEY * DIFFICULTY_MULTIPLIER_3), 1);
+
+				if (bets[spots] > *money)
+				{
+					emit_text("You don't have that much money!\n");
+				}
+				else
+				{
+					player_active = 0;
+				}
+
+				clear_scanf_buffer();
+			}
+
+			*money = *money - bets[spots];
+			emit_bet(bets[spots], *money, win_amount);
+		}
+
+		// Side bets go down with the main bets, before any cards are dealt. They're settled on the first spot.
+		if (side_bets_enabled)
+		{
+			place_side_bets(play_deck, used_deck, money, side_bets);
+		}
+
+		emit_frame(player, bets, spots, dealer, *money, win_amount, table.hidden);
+
+		status = blackjack_start_spots(&table, bets, spots);
+
+		while (status != BLACKJACK_ROUND_OVER)
+		{
+			acting = table.spot;
+
+			// Player gets to choose what to do.
+			if (status == BLACKJACK_NEED_ACTION)
+			{
+				// The advice is read once the pause after the deal is over, which is the advisor's head start.
+				if (advisor != NULL)
+				{
+					wait_for_render();
+				}
+
+				if (get_advice_text(text, sizeof(text)))
+				{
+					emit_text("%s", text);
+				}
+
+				if (spots > 1)
+				{
+					emit_text("Playing spot %d.\n", acting + 1);
+				}
+
+				emit_text((advisor != NULL) ? "Commands: (h)it (s)tand (a)dvice (e)xit\n\n" : "Commands: (h)it (s)tand (e)xit\n\n");
+				emit_text("What would you like to do?\n");
+
+				// The strategy plug-in plays the hand when the game was started with --autoplay.
+				if (autoplay != NULL)
+				{
+					input = get_autoplay_input(&player[acting], dealer, play_deck);
+					emit_text("%s chose to %s.\n", autoplay->name, (input == 'h') ? "hit" : "stand");
+					emit_pause(STANDARD_SLEEP_TIME * 2);
+				}
+				else
+				{
+					wait_for_render();
+					input = get_letter_input();
+					clear_scanf_buffer();
+				}
+
+				if (!isalpha(input))
+				{
+					emit_text("Please input an alphabetical letter.\n");
+					continue;
+				}
+
+				input = tolower(input);
+
+				// Whatever the advisor was working on is out of date once the player acts.
+				if (input == 'h' || input == 's' || input == 'e')
+				{
+					cancel_advice();
+				}
+
+				if (input == 'e')
+				{
+					emit_text("Exiting the game...\n");
+					wait_for_table_pipeline();
+					return -1;
+				}
+				else if (input == 'h' || input == 's')
+				{
+					status = blackjack_apply(&table, (input == 'h') ? BLACKJACK_HIT : BLACKJACK_STAND);
+				}
+				else
+				{
+					// With 'a' the prompt comes round again with whatever the advisor has finished.
+					// Going straight back to the prompt skips the event below, so the deal is never handled twice.
+					if (input != 'a' || advisor == NULL)
+					{
+						emit_text("Letter '%c' is not a recognized command.\n", input);
+					}
+
+					continue;
+				}
+			}
+			else
+			{
+				status = blackjack_step(&table);
+			}
+
+			reshuffled |= (table.reshuffles > 0);
+
+			if (table.reshuffles > 0)
+			{
+				emit_reshuffle();
+			}
+
+			// Any call to this function will sleep for the standard sleep time defined at the top.
+			// Only reason for this is to add some effect of card drawing.
+			// Otherwise, the cards would appear instantly.
+			if (table.event == BLACKJACK_EVENT_CARD)
+			{
+				emit_pause(STANDARD_SLEEP_TIME);
+				emit_frame(player, bets, spots, dealer, *money, win_amount, table.hidden);
+			}
+			else if (table.event == BLACKJACK_EVENT_REVEAL || table.event == BLACKJACK_EVENT_DEALER_CARD)
+			{
+				emit_frame(player, bets, spots, dealer, *money, win_amount, table.hidden);
+				emit_pause(STANDARD_SLEEP_TIME);
+			}
+			else if (table.event == BLACKJACK_EVENT_DEALT)
+			{
+				if (reshuffled)
+				{
+					emit_text("The deck was reshuffled during the initial draw.\n\n");
+					reshuffled = 0;
+				}
+
+				// The advisor starts on the hand now, so it has the pause below as a head start.
+				if (status == BLACKJACK_NEED_ACTION)
+				{
+					post_advice(&player[table.spot], dealer, play_deck, 1);
+				}
+
+				emit_pause(STANDARD_SLEEP_TIME);
+
+				if (side_bets_enabled && settle_side_bets(player, dealer, money, side_bets, text, sizeof(text)))
+				{
+					emit_text("%s\n", text);
+					emit_pause(STANDARD_SLEEP_TIME * 4);
+				}
+			}
+			else if (table.event == BLACKJACK_EVENT_PLAYER_CARD)
+			{
+				emit_frame(player, bets, spots, dealer, *money, win_amount, table.hidden);
+
+				if (status == BLACKJACK_NEED_ACTION)
+				{
+					post_advice(&player[table.spot], dealer, play_deck, reshuffled);
+				}
+
+				// A bust shows the reshuffle with the result.
+				if (reshuffled && player[acting].hand_value <= 21)
+				{
+					emit_text("The deck has been reshuffled.\n\n");
+					reshuffled = 0;
+				}
+			}
+			// Standing moved on to the next spot.
+			else if (status == BLACKJACK_NEED_ACTION)
+			{
+				post_advice(&player[table.spot], dealer, play_deck, 0);
+			}
+		}
+
+		emit_frame(player, bets, spots, dealer, *money, win_amount, table.hidden);
+
+		for (spot = 0, all_busted = 1; spot < spots; spot++)
+		{
+			all_busted &= (table.results[spot] == BLACKJACK_RESULT_PLAYER_BUST);
+		}
+
+		if (reshuffled)
+		{
+			emit_text(all_busted ? "The deck has been reshuffled.\n\n" : "The deck was reshuffled during the dealers draw.\n\n");
+		}
+
+		for (spot = 0; spot < spots; spot++)
+		{
+			if (spots > 1)
+			{
+				emit_text("\nSpot %d:\n", spot + 1);
+			}
+
+			if (table.results[spot] == BLACKJACK_RESULT_BOTH_BLACKJACK)
+			{
+				emit_text("Both the dealer and player got blackjacks! You get your $%d back!\n", bets[spot]);
+			}
+			// The dealer got 21 and player did not, automatic win for him.
+			else if (table.results[spot] == BLACKJACK_RESULT_DEALER_BLACKJACK)
+			{
+				emit_text("Dealer got a blackjack! You lost the bet of $%d!\n", bets[spot]);
+			}
+			else if (table.results[spot] == BLACKJACK_RESULT_PLAYER_BUST)
+			{
+				emit_text("Dealer's total cards value: %d\n", dealer->hand_value);
+				emit_text("Your total cards value: %d\n\n", player[spot].hand_value);
+				emit_text("You busted and lost the bet of $%d!\n", bets[spot]);
+			}
+			// Push, both hand values were the same. Player gets origional bet money back.
+			else if (table.results[spot] == BLACKJACK_RESULT_PUSH)
+			{
+				emit_pause(STANDARD_SLEEP_TIME);
+				emit_text("Push! You get your $%d back!\n", bets[spot]);
+			}
+			else
+			{
+				emit_pause(STANDARD_SLEEP_TIME);
+				emit_text("Dealer hand value: %d\n", dealer->hand_value);
+				emit_text("Player hand value: %d\n\n", player[spot].hand_value);
+
+				if (table.results[spot] == BLACKJACK_RESULT_DEALER_BUST)
+				{
+					emit_text("The dealer busted! You won $%d!\n", table.payouts[spot]);
+				}
+				else if (table.results[spot] == BLACKJACK_RESULT_DEALER_WINS)
+				{
+					emit_text("You lost $%d!\n", bets[spot]);
+				}
+				else
+				{
+					emit_text("You won $%d!\n", table.payouts[spot]);
+				}
+			}
+		}
+
+		// If the player gets a blackjack, he gets 1.5x his bet money. Otherwise a win pays 2x.
+		*money = *money + table.payout;
+
+		// Every spot is recorded as a hand of its own. The metrics only count a blackjack on a hand that wasn't lost.
+		for (spot = 0; spot < spots; spot++)
+		{
+			outcome = (table.payouts[spot] > bets[spot]) - (table.payouts[spot] < bets[spot]);
+			emit_round(&player[spot], dealer, bets[spot], table.payouts[spot], outcome, (outcome >= 0) && table.blackjacks[spot], *money);
+		}
+
+		emit_pause(STANDARD_SLEEP_TIME * 8);
+
+		// Disgard the cards of the player and dealer into the used deck.
+		blackjack_step(&table);
+
+		// Player achieved the amount of money required to win.
+		if (*money >= win_amount)
+		{
+			wait_for_table_pipeline();
+			return 1;
+		}
+	}
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------- START OF SIMULATION FUNCTIONS ----------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Deals the starting cards of a headless round, alternating between the player and dealer.
+// Returns 0 if the dealer's blackjack ends the round before the player gets to act. The round still has to be settled.
+int deal_headless_round(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int *counts, rng *r)
+{
+	int i;
+
+	for (i = INITIAL_CARD_DRAW; i > 0; i--)
+	{
+		draw_card(play_deck, used_deck, (i % 2 == 0) ? player : dealer, counts, r);
+	}
+
+	get_hand_value(dealer);
+	get_hand_value(player);
+
+	return (dealer->hand_value != 21);
+}
+
+// Draws the dealer's cards once the player is done. The dealer does not draw if the player busted.
+void play_dealer_hand(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int *counts, rng *r)
+{
+	if (player->hand_value <= 21)
+	{
+		while (dealer->hand_value < DEALER_HOLD_VALUE)
+		{
+			draw_card(play_deck, used_deck, dealer, counts, r);
+			get_hand_value(dealer);
+		}
+	}
+}
+
+// Works out the result of a finished round and moves the cards to the used deck.
+// Returns the net result in units of the bet.
+double settle_headless_round(deck *used_deck, hand *player, hand *dealer)
+{
+	// Only a 21 from the first two cards counts as a blackjack.
+	int player_blackjack = (player->total_cards == 2) && (player->hand_value == 21);
+	double result = get_round_result(player->hand_value, dealer->hand_value, player_blackjack);
+
+	disgard_hands(used_deck, dealer, player, 1);
+
+	return result;
+}
+
+// Plays the dealer's hand once the player is done and settles the round.
+// Returns the net result in units of the bet.
+double finish_headless_round(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int *counts, rng *r)
+{
+	play_dealer_hand(play_deck, used_deck, player, dealer, counts, r);
+
+	return settle_headless_round(used_deck, player, dealer);
+}
+
+// Plays one round of the game's rules without any input, output or sleeping.
+// The player hits until their hand is worth at least 'stand_value'.
+// Returns the net result in units of the bet.
+double play_headless_round(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int stand_value, rng *r)
+{
+	if (!deal_headless_round(play_deck, used_deck, player, dealer, NULL, r))
+	{
+		return settle_headless_round(used_deck, player, dealer);
+	}
+
+	while (player->hand_value < stand_value && player->hand_value < 21)
+	{
+		draw_card(play_deck, used_deck, player, NULL, r);
+		get_hand_value(player);
+	}
+
+	return finish_headless_round(play_deck, used_deck, player, dealer, NULL, r);
+}
+
+// Reads "--name value" from the command line. Returns the default value if the option is missing.
+long long get_option(int argc, char *argv[], char *name, long long default_value)
+{
+	int i;
+
+	for (i = 1; i < (argc - 1); i++)
+	{
+		if (strcmp(argv[i], name) == 0)
+		{
+			return strtoll(argv[i + 1], NULL, 10);
+		}
+	}
+
+	return default_value;
+}
+
+// Reads "--name value" from the command line as a decimal number. Returns the default value if the option is missing.
+double get_decimal_option(int argc, char *argv[], char *name, double default_value)
+{
+	int i;
+
+	for (i = 1; i < (argc - 1); i++)
+	{
+		if (strcmp(argv[i], name) == 0)
+		{
+			return strtod(argv[i + 1], NULL);
+		}
+	}
+
+	return default_value;
+}
+
+// Gets the number of threads to use when none is given on the command line.
+int get_default_thread_count(void)
+{
+	#ifdef _WIN32
+	return 1;
+	#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? (int)count : 1;
+	#endif
+}
+
+// A task run by the work pool. Each worker has its own index so tasks can keep per-thread state.
+typedef void (*pool_task)(void *context, int task, int worker);
+
+typedef struct work_queue
+{
+	int *tasks;
+	int head;
+	int tail;
+	#ifndef _WIN32
+	pthread_mutex_t lock;
+	#endif
+} work_queue;
+
+typedef struct work_pool
+{
+	work_queue *queues;
+	int thread_count;
+	pool_task run_task;
+	void *context;
+} work_pool;
+
+typedef struct pool_worker
+{
+	work_pool *pool;
+	int worker;
+} pool_worker;
+
+#ifndef _WIN32
+// Takes the newest task from the worker's own queue, or steals the oldest task from another worker.
+int take_task(work_pool *pool, int worker)
+{
+	int i, task = -1;
+	work_queue *queue = &pool->queues[worker];
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail > queue->head)
+	{
+		(queue->tail)--;
+		task = queue->tasks[queue->tail];
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	// The queue is empty, so go looking through the other workers' queues.
+	for (i = 1; (task < 0) && (i < pool->thread_count); i++)
+	{
+		queue = &pool->queues[(worker + i) % pool->thread_count];
+
+		pthread_mutex_lock(&queue->lock);
+		if (queue->tail > queue->head)
+		{
+			task = queue->tasks[queue->head];
+			(queue->head)++;
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return task;
+}
+
+void *work_pool_thread(void *argument)
+{
+	pool_worker *worker = argument;
+	int task;
+
+	while ((task = take_task(worker->pool, worker->worker)) >= 0)
+	{
+		worker->pool->run_task(worker->pool->context, task, worker->worker);
+	}
+
+	return NULL;
+}
+#endif
+
+// Runs tasks 0 to (task_count - 1) on a work-stealing thread pool and waits for all of them to finish.
+// Each worker starts with a contiguous block of tasks so neighbouring tasks share per-thread caches.
+void run_work_pool(int task_count, int thread_count, pool_task run_task, void *context)
+{
+	#ifdef _WIN32
+	int i;
+
+	(void)thread_count;
+
+	for (i = 0; i < task_count; i++)
+	{
+		run_task(context, i, 0);
+	}
+	#else
+	int i, j, start, end;
+	work_pool pool;
+	pool_worker *workers;
+	pthread_t *threads;
+
+	pool.thread_count = thread_count;
+	pool.run_task = run_task;
+	pool.context = context;
+	pool.queues = malloc(sizeof(work_queue) * thread_count);
+	workers = malloc(sizeof(pool_worker) * thread_count);
+	threads = malloc(sizeof(pthread_t) * thread_count);
+
+	if (pool.queues == NULL || workers == NULL || threads == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'pool' - 01.\n");
+		exit(1);
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		start = (int)(((long long)task_count * i) / thread_count);
+		end = (int)(((long long)task_count * (i + 1)) / thread_count);
+
+		pool.queues[i].tasks = malloc(sizeof(int) * ((end - start) + 1));
+		if (pool.queues[i].tasks == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'pool' - 02.\n");
+			exit(1);
+		}
+
+		// The owner pops from the tail, so the lowest task is placed last to run first.
+		for (j = start; j < end; j++)
+		{
+			pool.queues[i].tasks[end - 1 - j] = j;
+		}
+
+		pool.queues[i].head = 0;
+		pool.queues[i].tail = end - start;
+		pthread_mutex_init(&pool.queues[i].lock, NULL);
+
+		workers[i].pool = &pool;
+		workers[i].worker = i;
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		pthread_create(&threads[i], NULL, work_pool_thread, &workers[i]);
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&pool.queues[i].lock);
+		free(pool.queues[i].tasks);
+	}
+
+	free(threads);
+	free(workers);
+	free(pool.queues);
+	#endif
+}
+
+// Usage: blackjack --engine-benchmark [--tables n] [--rounds n] [--decks 1-8] [--seed n]
+// Keeps every table going from one thread through the round engine, one call per table at a time, with the player
+// hitting below 17. Then plays the same shoes with play_headless_round() to check both come out the same.
+#define ENGINE_BENCHMARK_BET 2
+#define DEFAULT_ENGINE_TABLES 10000
+#define DEFAULT_ENGINE_ROUNDS 100
+
+int run_engine_benchmark(int argc, char *argv[])
+{
+	int t, i, table_count, rounds, shoe_size, active, *status, *played, *cards;
+	long long calls = 0, engine_net = 0, headless_net = 0;
+	uint64_t seed;
+	double start, seconds;
+	blackjack_table *tables;
+	deck *play_decks, *used_decks;
+	hand *hands;
+	rng r;
+
+	table_count = (int)get_option(argc, argv, "--tables", DEFAULT_ENGINE_TABLES);
+	rounds = (int)get_option(argc, argv, "--rounds", DEFAULT_ENGINE_ROUNDS);
+	shoe_size = (int)get_option(argc, argv, "--decks", MIN_DECK_COUNT) * CARDS_IN_A_DECK;
+	seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+
+	if (table_count < 1 || rounds < 1 || shoe_size < MIN_DECK_COUNT * CARDS_IN_A_DECK || shoe_size > MAX_DECK_COUNT * CARDS_IN_A_DECK)
+	{
+		printf("Usage: blackjack --engine-benchmark [--tables n] [--rounds n] [--decks %d-%d] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	tables = malloc(sizeof(blackjack_table) * table_count);
+	play_decks = malloc(sizeof(deck) * table_count);
+	used_decks = malloc(sizeof(deck) * table_count);
+	hands = malloc(sizeof(hand) * table_count * 2);
+	cards = malloc(sizeof(int) * (size_t)table_count * shoe_size * 2);
+	status = malloc(sizeof(int) * table_count);
+	played = calloc(table_count, sizeof(int));
+
+	if (tables == NULL || play_decks == NULL || used_decks == NULL || hands == NULL || cards == NULL || status == NULL || played == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'tables' - 01.\n");
+		return 1;
+	}
+
+	// Every table gets its own shoe, shuffled by the generator its reshuffles carry on with.
+	for (t = 0; t < table_count; t++)
+	{
+		play_decks[t].deck = cards + (size_t)t * shoe_size * 2;
+		used_decks[t].deck = play_decks[t].deck + shoe_size;
+		create_decks(&play_decks[t], &used_decks[t], shoe_size);
+		play_decks[t].total_cards = shoe_size;
+		used_decks[t].total_cards = 0;
+		hands[t * 2].total_cards = 0;
+		hands[t * 2 + 1].total_cards = 0;
+
+		blackjack_table_init(&tables[t], &play_decks[t], &used_decks[t], &hands[t * 2], &hands[t * 2 + 1], seed + (uint64_t)t);
+		shuffle_deck_rng(&play_decks[t], shoe_size, shoe_size, &tables[t].r);
+		status[t] = BLACKJACK_NEED_BET;
+	}
+
+	start = get_seconds();
+
+	for (active = table_count; active > 0; )
+	{
+		for (t = 0; t < table_count; t++)
+		{
+			if (played[t] == rounds)
+			{
+				continue;
+			}
+
+			if (status[t] == BLACKJACK_NEED_BET)
+			{
+				status[t] = blackjack_start_round(&tables[t], ENGINE_BENCHMARK_BET);
+			}
+			else if (status[t] == BLACKJACK_NEED_ACTION)
+			{
+				status[t] = blackjack_apply(&tables[t], (tables[t].player[tables[t].spot].hand_value < DEALER_HOLD_VALUE) ? BLACKJACK_HIT : BLACKJACK_STAND);
+			}
+			else
+			{
+				if (status[t] == BLACKJACK_ROUND_OVER)
+				{
+					engine_net += tables[t].payout - ENGINE_BENCHMARK_BET;
+
+					if (++played[t] == rounds)
+					{
+						active--;
+					}
+				}
+
+				status[t] = blackjack_step(&tables[t]);
+			}
+
+			calls++;
+		}
+	}
+
+	seconds = get_seconds() - start;
+
+	// The same shoes again, played a round at a time by the headless simulation's rules.
+	for (t = 0; t < table_count; t++)
+	{
+		create_decks(&play_decks[t], &used_decks[t], shoe_size);
+		play_decks[t].total_cards = shoe_size;
+		used_decks[t].total_cards = 0;
+		hands[t * 2].total_cards = 0;
+		hands[t * 2 + 1].total_cards = 0;
+		seed_rng(&r, seed + (uint64_t)t);
+		shuffle_deck_rng(&play_decks[t], shoe_size, shoe_size, &r);
+
+		for (i = 0; i < rounds; i++)
+		{
+			headless_net += (long long)(ENGINE_BENCHMARK_BET * play_headless_round(&play_decks[t], &used_decks[t], &hands[t * 2], &hands[t * 2 + 1], DEALER_HOLD_VALUE, &r));
+		}
+	}
+
+	printf("Tables on one thread: %d, %d rounds each.\n", table_count, rounds);
+	printf("Engine: %lld rounds in %.2f seconds. (%.0f rounds and %.0f calls a second)\n", (long long)table_count * rounds, seconds, table_count * (double)rounds / seconds, calls / seconds);
+	printf("Table state: %d bytes, plus %d for the hands and %d for the shoe.\n", (int)sizeof(blackjack_table), (int)sizeof(hand) * 2, (int)(sizeof(int) * shoe_size * 2));
+	printf("Net result: %lld from the engine, %lld from the headless rounds on the same shoes. %s\n", engine_net, headless_net, (engine_net == headless_net) ? "They match." : "They DON'T match.");
+
+	free(tables);
+	free(play_decks);
+	free(used_decks);
+	free(hands);
+	free(cards);
+	free(status);
+	free(played);
+
+	return (engine_net == headless_net) ? 0 : 1;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------------- START OF BATCH SHUFFLING ---------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+#define SHUFFLE_LANES 8
+#define DEFAULT_BENCHMARK_SHOES 1000000
+#define BENCHMARK_BATCH_SHOES 4096
+
+// Many shoes shuffled together by shuffle_shoes(). Cards take one byte each and are stored shoe after shoe.
+// A card is its number in create_decks() modulo CARDS_IN_A_DECK, which is all the card functions look at.
+typedef struct shoe_batch
+{
+	unsigned char *cards;
+	rng *generators;
+	int shoe_count;
+	int shoe_size;
+} shoe_batch;
+
+// Puts every shoe back in the order create_decks() leaves a play deck in.
+void reset_shoe_batch(shoe_batch *batch)
+{
+	int s, i;
+
+	for (i = 0; i < batch->shoe_size; i++)
+	{
+		batch->cards[i] = (unsigned char)((i + 1) % CARDS_IN_A_DECK);
+	}
+
+	// The rest are copies of the first.
+	for (s = 1; s < batch->shoe_count; s++)
+	{
+		memcpy(batch->cards + (size_t)s * batch->shoe_size, batch->cards, batch->shoe_size);
+	}
+}
+
+// shuffle_deck_rng() for a shoe of one-byte cards.
+void shuffle_shoe_bytes(unsigned char *cards, int n, int depth, rng *r)
+{
+	int i, j;
+	unsigned char card;
+
+	for (i = (n - 1); i > 0 && i >= (n - depth); i--)
+	{
+		j = rng_bounded(r, i + 1);
+		card = cards[i];
+		cards[i] = cards[j];
+		cards[j] = card;
+	}
+}
+
+#ifdef SHUFFLE_AVX2
+#define ROTATE_LEFT_LANES(x, k) _mm256_or_si256(_mm256_slli_epi32((x), (k)), _mm256_srli_epi32((x), 32 - (k)))
+
+// Shuffles eight shoes at once, one per 32-bit lane. Every lane draws exactly the numbers its own generator would
+// give rng_bounded(), so each shoe matches shuffle_shoe_bytes() card for card.
+__attribute__((target("avx2")))
+void shuffle_eight_shoes(unsigned char *cards, int n, int depth, rng *generators)
+{
+	int i, lane, k;
+	uint32_t state[4][SHUFFLE_LANES], low[SHUFFLE_LANES], high[SHUFFLE_LANES], threshold;
+	uint64_t m;
+	rng lane_rng;
+	__m256i s[4], t, x, bound, even, odd;
+	__m256i five = _mm256_set1_epi32(5), nine = _mm256_set1_epi32(9), sign = _mm256_set1_epi32(INT32_MIN);
+
+	for (k = 0; k < 4; k++)
+	{
+		for (lane = 0; lane < SHUFFLE_LANES; lane++)
+		{
+			state[k][lane] = generators[lane].state[k];
+		}
+
+		s[k] = _mm256_loadu_si256((__m256i *)state[k]);
+	}
+
+	for (i = (n - 1); i > 0 && i >= (n - depth); i--)
+	{
+		// rng_next() on every lane.
+		x = _mm256_mullo_epi32(ROTATE_LEFT_LANES(_mm256_mullo_epi32(s[1], five), 7), nine);
+		t = _mm256_slli_epi32(s[1], 9);
+		s[2] = _mm256_xor_si256(s[2], s[0]);
+		s[3] = _mm256_xor_si256(s[3], s[1]);
+		s[1] = _mm256_xor_si256(s[1], s[2]);
+		s[0] = _mm256_xor_si256(s[0], s[3]);
+		s[2] = _mm256_xor_si256(s[2], t);
+		s[3] = ROTATE_LEFT_LANES(s[3], 11);
+
+		// Lemire's method. The 64-bit products of the even and odd lanes are split into their high and low halves.
+		bound = _mm256_set1_epi32(i + 1);
+		even = _mm256_mul_epu32(x, bound);
+		odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), bound);
+		_mm256_storeu_si256((__m256i *)high, _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA));
+
+		// Only a lane whose low half is below the bound can need another draw. For shoe-sized bounds that almost never happens.
+		x = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_xor_si256(bound, sign), _mm256_xor_si256(x, sign)))) != 0)
+		{
+			_mm256_storeu_si256((__m256i *)low, x);
+			threshold = (0u - (uint32_t)(i + 1)) % (uint32_t)(i + 1);
+
+			for (k = 0; k < 4; k++)
+			{
+				_mm256_storeu_si256((__m256i *)state[k], s[k]);
+			}
+
+			for (lane = 0; lane < SHUFFLE_LANES; lane++)
+			{
+				if (low[lane] >= threshold)
+				{
+					continue;
+				}
+
+				for (k = 0; k < 4; k++)
+				{
+					lane_rng.state[k] = state[k][lane];
+				}
+
+				while (low[lane] < threshold)
+				{
+					m = (uint64_t)rng_next(&lane_rng) * (uint32_t)(i + 1);
+					low[lane] = (uint32_t)m;
+					high[lane] = (uint32_t)(m >> 32);
+				}
+
+				for (k = 0; k < 4; k++)
+				{
+					state[k][lane] = lane_rng.state[k];
+				}
+			}
+
+			for (k = 0; k < 4; k++)
+			{
+				s[k] = _mm256_loadu_si256((__m256i *)state[k]);
+			}
+		}
+
+		for (lane = 0; lane < SHUFFLE_LANES; lane++)
+		{
+			unsigned char *shoe = cards + (size_t)lane * n, card = shoe[i];
+
+			shoe[i] = shoe[high[lane]];
+			shoe[high[lane]] = card;
+		}
+	}
+
+	for (k = 0; k < 4; k++)
+	{
+		_mm256_storeu_si256((__m256i *)state[k], s[k]);
+
+		for (lane = 0; lane < SHUFFLE_LANES; lane++)
+		{
+			generators[lane].state[k] = state[k][lane];
+		}
+	}
+}
+#endif
+
+// Shuffles the top 'depth' cards of every shoe with the shoe's own generator.
+// Each shoe comes out exactly as shuffle_deck_rng() would leave it for the same generator.
+void shuffle_shoes(shoe_batch *batch, int depth)
+{
+	int s = 0;
+
+	#ifdef SHUFFLE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+	{
+		for (; s + SHUFFLE_LANES <= batch->shoe_count; s += SHUFFLE_LANES)
+		{
+			shuffle_eight_shoes(batch->cards + (size_t)s * batch->shoe_size, batch->shoe_size, depth, &batch->generators[s]);
+		}
+	}
+	#endif
+
+	for (; s < batch->shoe_count; s++)
+	{
+		shuffle_shoe_bytes(batch->cards + (size_t)s * batch->shoe_size, batch->shoe_size, depth, &batch->generators[s]);
+	}
+}
+
+// Times shuffle_deck_rng() against shuffle_shoes() on the same generators and checks every shoe comes out the same.
+// Shoes go through one batch of BENCHMARK_BATCH_SHOES at a time, the way a simulation reshuffling its tables would.
+// Usage: blackjack --shuffle-benchmark [--decks n] [--shoes n] [--depth n] [--seed n]
+int run_shuffle_benchmark(int argc, char *argv[])
+{
+	int s, i, first, shoes, shoe_size, depth, mismatches = 0;
+	uint64_t seed;
+	double start, scalar_seconds, batch_seconds;
+	unsigned int checksum = 0;
+	deck play_deck, used_deck;
+	shoe_batch batch;
+	rng r;
+
+	shoe_size = (int)get_option(argc, argv, "--decks", MIN_DECK_COUNT) * CARDS_IN_A_DECK;
+	shoes = (int)get_option(argc, argv, "--shoes", DEFAULT_BENCHMARK_SHOES);
+	depth = (int)get_option(argc, argv, "--depth", shoe_size);
+	seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+
+	if (shoe_size < MIN_DECK_COUNT * CARDS_IN_A_DECK || shoe_size > MAX_DECK_COUNT * CARDS_IN_A_DECK || shoes < 1 || depth < 1 || depth > shoe_size)
+	{
+		printf("Usage: blackjack --shuffle-benchmark [--decks %d-%d] [--shoes n] [--depth 1-cards] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	batch.shoe_size = shoe_size;
+	batch.cards = malloc((size_t)BENCHMARK_BATCH_SHOES * shoe_size);
+	batch.generators = malloc(sizeof(rng) * BENCHMARK_BATCH_SHOES);
+	play_deck.deck = malloc(sizeof(int) * shoe_size);
+	used_deck.deck = malloc(sizeof(int) * shoe_size);
+
+	if (batch.cards == NULL || batch.generators == NULL || play_deck.deck == NULL || used_deck.deck == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'batch' - 01.\n");
+		return 1;
+	}
+
+	// The way the tools shuffle today: one shoe of ints at a time.
+	start = get_seconds();
+
+	for (s = 0; s < shoes; s++)
+	{
+		seed_rng(&r, seed + (uint64_t)s);
+		create_decks(&play_deck, &used_deck, shoe_size);
+		shuffle_deck_rng(&play_deck, shoe_size, depth, &r);
+		checksum += (unsigned int)play_deck.deck[shoe_size - 1];
+	}
+
+	scalar_seconds = get_seconds() - start;
+	batch_seconds = 0.0;
+
+	for (first = 0; first < shoes; first += BENCHMARK_BATCH_SHOES)
+	{
+		batch.shoe_count = (shoes - first < BENCHMARK_BATCH_SHOES) ? (shoes - first) : BENCHMARK_BATCH_SHOES;
+		start = get_seconds();
+
+		for (s = 0; s < batch.shoe_count; s++)
+		{
+			seed_rng(&batch.generators[s], seed + (uint64_t)(first + s));
+		}
+
+		reset_shoe_batch(&batch);
+		shuffle_shoes(&batch, depth);
+
+		batch_seconds += get_seconds() - start;
+
+		// Checked outside the timing.
+		for (s = 0; s < batch.shoe_count; s++)
+		{
+			seed_rng(&r, seed + (uint64_t)(first + s));
+			create_decks(&play_deck, &used_deck, shoe_size);
+			shuffle_deck_rng(&play_deck, shoe_size, depth, &r);
+
+			for (i = 0; i < shoe_size; i++)
+			{
+				if (batch.cards[(size_t)s * shoe_size + i] != play_deck.deck[i] % CARDS_IN_A_DECK)
+				{
+					mismatches++;
+					break;
+				}
+			}
+		}
+	}
+
+	printf("%d shoes of %d cards, top %d shuffled, seed %llu.\n", shoes, shoe_size, depth, (unsigned long long)seed);
+	#ifdef SHUFFLE_AVX2
+	printf("Batch shuffle: %s.\n\n", __builtin_cpu_supports("avx2") ? "8 lanes with AVX2" : "one shoe at a time, this processor has no AVX2");
+	#else
+	printf("Batch shuffle: one shoe at a time, this build has no AVX2 path.\n\n");
+	#endif
+	printf("shuffle_deck_rng(): %.3f seconds, %.0f shoes per second. (checksum %u)\n", scalar_seconds, shoes / scalar_seconds, checksum);
+	printf("shuffle_shoes():    %.3f seconds, %.0f shoes per second. %.1fx faster.\n", batch_seconds, shoes / batch_seconds, scalar_seconds / batch_seconds);
+	printf("%d of %d shoes differ from shuffle_deck_rng().\n", mismatches, shoes);
+
+	free(used_deck.deck);
+	free(play_deck.deck);
+	free(batch.generators);
+	free(batch.cards);
+
+	return (mismatches != 0);
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+---------------------------- START OF PACKED TABLES ----------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+A packed table keeps a whole headless table in a few cache lines instead of two
+full shoes of ints. With tens of thousands of tables every round is a trip to
+memory, so bytes per table is what sets the speed.
+
+	Line 0:  both hands (one-byte cards), the generator and the counters.
+	Then:    the used pile as one byte per card of the deck, followed by
+	         the cards left to draw, one byte each.
+
+Cards are their number in create_decks() modulo CARDS_IN_A_DECK, the same as
+a shoe_batch. Copies of a card are interchangeable, so the used pile only has
+to know how many of each are in it: bit k of used[c] is set when the k-th
+copy of card c is. Eight decks fill the byte.
+
+Rounds follow play_headless_round(), so a packed table deals exactly the same
+cards as a deck of ints shuffled with the same generator, up to the first
+reshuffle. After that the used pile goes back in card order rather than the
+order it was discarded in, which shuffles to different shoes.
+
+==============================================================================*/
+
+#define DEFAULT_LAYOUT_ROUNDS 2000000
+#define LAYOUT_SIZES 3
+#define LAYOUT_CHECK_TABLES 1000
+
+typedef struct packed_hand
+{
+	uint8_t cards[MAX_HAND_COUNT];
+	uint8_t total_cards;
+	uint8_t hand_value;
+	uint8_t ace_count;
+} packed_hand;
+
+typedef struct packed_table
+{
+	_Alignas(CACHE_LINE_SIZE) packed_hand player;
+	packed_hand dealer;
+	rng r;
+	uint16_t play_cards;
+	uint16_t shoe_size;
+	uint16_t reshuffles;
+	int32_t money;
+	uint8_t used[CARDS_IN_A_DECK];
+	// Cards left to draw, dealt from the end. Sized by get_packed_table_size().
+	uint8_t shoe[];
+} packed_table;
+
+// Bytes between one packed table and the next, rounded up to whole cache lines.
+size_t get_packed_table_size(int shoe_size)
+{
+	size_t size = offsetof(packed_table, shoe) + (size_t)shoe_size;
+
+	return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+packed_table *get_packed_table(packed_table *tables, size_t table_size, int t)
+{
+	return (packed_table *)((char *)tables + table_size * (size_t)t);
+}
+
+// Gets the tables on cache line boundaries. Free them with free_packed_tables().
+packed_table *allocate_packed_tables(int table_count, int shoe_size)
+{
+	size_t size = get_packed_table_size(shoe_size) * (size_t)table_count;
+
+	#ifdef _WIN32
+	return _aligned_malloc(size, CACHE_LINE_SIZE);
+	#else
+	return aligned_alloc(CACHE_LINE_SIZE, size);
+	#endif
+}
+
+void free_packed_tables(packed_table *tables)
+{
+	#ifdef _WIN32
+	_aligned_free(tables);
+	#else
+	free(tables);
+	#endif
+}
+
+// Fills the shoe the way create_decks() does and shuffles it with a generator seeded with 'seed'.
+void init_packed_table(packed_table *table, int shoe_size, uint64_t seed)
+{
+	int i;
+
+	memset(table, 0, offsetof(packed_table, shoe));
+
+	for (i = 0; i < shoe_size; i++)
+	{
+		table->shoe[i] = (uint8_t)((i + 1) % CARDS_IN_A_DECK);
+	}
+
+	table->shoe_size = (uint16_t)shoe_size;
+	table->play_cards = (uint16_t)shoe_size;
+	seed_rng(&table->r, seed);
+	shuffle_shoe_bytes(table->shoe, shoe_size, shoe_size, &table->r);
+}
+
+// get_hand_value() for a packed hand.
+void get_packed_hand_value(packed_hand *hand)
+{
+	int i, temp, value = 0, aces = 0;
+
+	for (i = 0; i < hand->total_cards; i++)
+	{
+		temp = get_card_value(hand->cards[i]);
+
+		if (temp == 11)
+		{
+			aces++;
+		}
+
+		value += temp;
+	}
+
+	// Like get_hand_value(), only one ace is ever lowered.
+	if ((value > 21) && (aces > 0))
+	{
+		value -= 10;
+	}
+
+	hand->hand_value = (uint8_t)value;
+	hand->ace_count = (uint8_t)aces;
+}
+
+// Shuffles the used pile back into the shoe once it runs out.
+void reshuffle_packed_table(packed_table *table)
+{
+	int c;
+	unsigned int copies;
+
+	for (c = 0; c < CARDS_IN_A_DECK; c++)
+	{
+		for (copies = table->used[c]; copies != 0; copies &= copies - 1)
+		{
+			table->shoe[table->play_cards] = (uint8_t)c;
+			(table->play_cards)++;
+		}
+
+		table->used[c] = 0;
+	}
+
+	shuffle_shoe_bytes(table->shoe, table->play_cards, table->play_cards, &table->r);
+	(table->reshuffles)++;
+}
+
+// draw_card() for a packed table.
+void draw_packed_card(packed_table *table, packed_hand *hand)
+{
+	(table->play_cards)--;
+	hand->cards[hand->total_cards] = table->shoe[table->play_cards];
+	(hand->total_cards)++;
+
+	if (table->play_cards == 0)
+	{
+		reshuffle_packed_table(table);
+	}
+}
+
+// disgard_hands() for a packed table. Each card sets the lowest copy bit that isn't set yet.
+void discard_packed_hands(packed_table *table)
+{
+	int i;
+
+	for (i = 0; i < table->dealer.total_cards; i++)
+	{
+		table->used[table->dealer.cards[i]] = (uint8_t)((table->used[table->dealer.cards[i]] << 1) | 1);
+	}
+
+	for (i = 0; i < table->player.total_cards; i++)
+	{
+		table->used[table->player.cards[i]] = (uint8_t)((table->used[table->player.cards[i]] << 1) | 1);
+	}
+
+	table->dealer.total_cards = 0;
+	table->player.total_cards = 0;
+}
+
+// play_headless_round() on a packed table.
+// Returns the net result in units of the bet.
+double play_packed_round(packed_table *table, int stand_value)
+{
+	int i, player_blackjack;
+	double result;
+
+	for (i = INITIAL_CARD_DRAW; i > 0; i--)
+	{
+		draw_packed_card(table, (i % 2 == 0) ? &table->player : &table->dealer);
+	}
+
+	get_packed_hand_value(&table->dealer);
+	get_packed_hand_value(&table->player);
+
+	if (table->dealer.hand_value != 21)
+	{
+		while (table->player.hand_value < stand_value && table->player.hand_value < 21)
+		{
+			draw_packed_card(table, &table->player);
+			get_packed_hand_value(&table->player);
+		}
+
+		while (table->player.hand_value <= 21 && table->dealer.hand_value < DEALER_HOLD_VALUE)
+		{
+			draw_packed_card(table, &table->dealer);
+			get_packed_hand_value(&table->dealer);
+		}
+	}
+
+	player_blackjack = (table->player.total_cards == 2) && (table->player.hand_value == 21);
+	result = get_round_result(table->player.hand_value, table->dealer.hand_value, player_blackjack);
+
+	discard_packed_hands(table);
+
+	return result;
+}
+
+// Gets the size of the level 2 or 3 cache in bytes, or 0 if the system doesn't say.
+long get_cache_size(int level)
+{
+	#if !defined(_WIN32) && defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+	long size = sysconf((level == 2) ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+
+	return (size > 0) ? size : 0;
+	#else
+	(void)level;
+
+	return 0;
+	#endif
+}
+
+// Prints how many tables of 'table_size' bytes fit in a cache.
+void print_tables_in_cache(long cache_size, size_t table_size)
+{
+	if (cache_size > 0)
+	{
+		printf("%14lld", (long long)(cache_size / (long)table_size));
+	}
+	else
+	{
+		printf("%14s", "unknown");
+	}
+}
+
+// Usage: blackjack --layout-benchmark [--tables n] [--rounds n] [--decks 1-8] [--seed n]
+// Plays the same number of rounds on the headless simulation's decks of ints and on packed tables, one round per table
+// at a time so every table is touched before any is touched again. Without --tables it tries 1,000, 10,000 and
+// 100,000 tables, with --rounds rounds between them. (2,000,000 by default)
+int run_layout_benchmark(int argc, char *argv[])
+{
+	int s, t, i, size_count, shoe_size, decks, rounds, table_rounds, checked = 0, mismatches = 0;
+	int sizes[LAYOUT_SIZES] = {1000, 10000, 100000};
+	uint64_t seed;
+	long l2, l3;
+	size_t int_size, packed_size;
+	double start, int_seconds, packed_seconds, int_net, packed_net, int_result, packed_result;
+	deck *play_decks, *used_decks;
+	hand *hands;
+	rng *generators;
+	int *cards;
+	packed_table *tables, *table;
+
+	decks = (int)get_option(argc, argv, "--decks", 6);
+	shoe_size = decks * CARDS_IN_A_DECK;
+	rounds = (int)get_option(argc, argv, "--rounds", DEFAULT_LAYOUT_ROUNDS);
+	seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	size_count = LAYOUT_SIZES;
+
+	if (get_option(argc, argv, "--tables", 0) != 0)
+	{
+		sizes[0] = (int)get_option(argc, argv, "--tables", 0);
+		size_count = 1;
+	}
+
+	if (decks < MIN_DECK_COUNT || decks > MAX_DECK_COUNT || rounds < 1 || sizes[0] < 1)
+	{
+		printf("Usage: blackjack --layout-benchmark [--tables n] [--rounds n] [--decks %d-%d] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	// What the headless simulation keeps for a table: two deck headers, two hands, a generator and two shoes of ints.
+	int_size = sizeof(deck) * 2 + sizeof(hand) * 2 + sizeof(rng) + sizeof(int) * shoe_size * 2;
+	packed_size = get_packed_table_size(shoe_size);
+	l2 = get_cache_size(2);
+	l3 = get_cache_size(3);
+
+	printf("%d decks, seed %llu. L2 cache: %ld KB, L3 cache: %ld KB.\n\n", decks, (unsigned long long)seed, l2 / 1024, l3 / 1024);
+	printf("Layout    Bytes a table  Tables in L2  Tables in L3\n");
+	printf("Ints      %13d", (int)int_size);
+	print_tables_in_cache(l2, int_size);
+	print_tables_in_cache(l3, int_size);
+	printf("\nPacked    %13d", (int)packed_size);
+	print_tables_in_cache(l2, packed_size);
+	print_tables_in_cache(l3, packed_size);
+	printf("\n\n   Tables   Ints (MB)  Packed (MB)  Ints rounds/s  Packed rounds/s  Speed-up\n");
+
+	for (s = 0; s < size_count; s++)
+	{
+		table_rounds = (rounds + sizes[s] - 1) / sizes[s];
+
+		play_decks = malloc(sizeof(deck) * sizes[s]);
+		used_decks = malloc(sizeof(deck) * sizes[s]);
+		hands = malloc(sizeof(hand) * sizes[s] * 2);
+		generators = malloc(sizeof(rng) * sizes[s]);
+		cards = malloc(sizeof(int) * (size_t)sizes[s] * shoe_size * 2);
+		tables = allocate_packed_tables(sizes[s], shoe_size);
+
+		if (play_decks == NULL || used_decks == NULL || hands == NULL || generators == NULL || cards == NULL || tables == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'tables' - 01.\n");
+			return 1;
+		}
+
+		for (t = 0; t < sizes[s]; t++)
+		{
+			play_decks[t].deck = cards + (size_t)t * shoe_size * 2;
+			used_decks[t].deck = play_decks[t].deck + shoe_size;
+			create_decks(&play_decks[t], &used_decks[t], shoe_size);
+			play_decks[t].total_cards = shoe_size;
+			used_decks[t].total_cards = 0;
+			hands[t * 2].total_cards = 0;
+			hands[t * 2 + 1].total_cards = 0;
+			seed_rng(&generators[t], seed + (uint64_t)t);
+			shuffle_deck_rng(&play_decks[t], shoe_size, shoe_size, &generators[t]);
+
+			init_packed_table(get_packed_table(tables, packed_size, t), shoe_size, seed + (uint64_t)t);
+		}
+
+		int_net = 0.0;
+		start = get_seconds();
+
+		for (i = 0; i < table_rounds; i++)
+		{
+			for (t = 0; t < sizes[s]; t++)
+			{
+				int_net += play_headless_round(&play_decks[t], &used_decks[t], &hands[t * 2], &hands[t * 2 + 1], DEALER_HOLD_VALUE, &generators[t]);
+			}
+		}
+
+		int_seconds = get_seconds() - start;
+		packed_net = 0.0;
+		start = get_seconds();
+
+		for (i = 0; i < table_rounds; i++)
+		{
+			for (t = 0; t < sizes[s]; t++)
+			{
+				packed_net += play_packed_round(get_packed_table(tables, packed_size, t), DEALER_HOLD_VALUE);
+			}
+		}
+
+		packed_seconds = get_seconds() - start;
+
+		printf("%9d %11.1f %12.1f %14.0f %16.0f %8.2fx\n", sizes[s], int_size * (double)sizes[s] / 1048576.0, packed_size * (double)sizes[s] / 1048576.0,
+			sizes[s] * (double)table_rounds / int_seconds, sizes[s] * (double)table_rounds / packed_seconds, int_seconds / packed_seconds);
+
+		// Fresh shoes for the check, played round by round on both layouts until either one reshuffles.
+		for (t = 0; t < sizes[s] && t < LAYOUT_CHECK_TABLES; t++)
+		{
+			table = get_packed_table(tables, packed_size, t);
+			init_packed_table(table, shoe_size, seed + (uint64_t)t);
+			create_decks(&play_decks[t], &used_decks[t], shoe_size);
+			play_decks[t].total_cards = shoe_size;
+			used_decks[t].total_cards = 0;
+			hands[t * 2].total_cards = 0;
+			hands[t * 2 + 1].total_cards = 0;
+			seed_rng(&generators[t], seed + (uint64_t)t);
+			shuffle_deck_rng(&play_decks[t], shoe_size, shoe_size, &generators[t]);
+
+			while (table->reshuffles == 0)
+			{
+				int_result = play_headless_round(&play_decks[t], &used_decks[t], &hands[t * 2], &hands[t * 2 + 1], DEALER_HOLD_VALUE, &generators[t]);
+				packed_result = play_packed_round(table, DEALER_HOLD_VALUE);
+
+				// Both reshuffle in the same round, but into different shoes, so that round isn't compared.
+				if (table->reshuffles == 0)
+				{
+					mismatches += (packed_result != int_result);
+					checked++;
+				}
+			}
+		}
+
+		free(play_decks);
+		free(used_decks);
+		free(hands);
+		free(generators);
+		free(cards);
+		free_packed_tables(tables);
+	}
+
+	printf("\nAverage return: %.3f%% on ints, %.3f%% on packed tables. (the last size)\n", 100.0 * int_net / ((double)sizes[size_count - 1] * table_rounds), 100.0 * packed_net / ((double)sizes[size_count - 1] * table_rounds));
+	printf("%d rounds checked against the ints before the first reshuffle, %d differ.\n", checked, mismatches);
+
+	return (mismatches != 0);
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------------- START OF RESULTS FILES -----------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+A results file stores one row per round in blocks of up to RESULTS_BLOCK_ROWS
+rows. Inside a block every column is stored on its own, so a reader only
+decodes what it needs and similar values sit next to each other.
+
+	Header:  "BJRS", version (u32), column count (u32),
+	         then for each column: type (u8), name length (u8), name.
+	Block:   "BLCK", row count (u32),
+	         then for each column: byte count (u32), encoding (u8), data.
+
+Cards are stored as their value (2 - 11, aces are 11), the outcome as a
+round_outcome and the payout as the money handed back, bet included, the
+same way blackjack() pays out. 'natural' is 1 when the player's first two
+cards were a blackjack. A natural that wins is a blackjack outcome, even
+against a dealer bust, where it pays the same as any other win. Numbers in the header and block headers are
+little-endian. Column data is
+whichever of these is smallest for that column in that block:
+
+	RESULTS_DELTA   zigzag varints of the difference from the row before.
+	RESULTS_RUNS    zigzag varint value, varint run length, repeated.
+	RESULTS_PACKED  zigzag varint minimum, bit width (u8), then every
+	                value minus the minimum in that many bits, low bits
+	                first.
+
+`blackjack --read-results file --csv` turns a file back into plain CSV for
+spreadsheets, pandas, DuckDB and the like.
+
+==============================================================================*/
+
+#define RESULTS_MAGIC "BJRS"
+#define RESULTS_BLOCK_MAGIC "BLCK"
+#define RESULTS_VERSION 2
+#define RESULTS_BLOCK_ROWS 16384
+#define RESULTS_MAX_VARINT 10
+#define RESULTS_MAX_PACKED_WIDTH 56
+#define RESULTS_COLUMN_BOUND (1 + (size_t)RESULTS_BLOCK_ROWS * RESULTS_MAX_VARINT * 2)
+
+enum result_column
+{
+	RESULT_TABLE,
+	RESULT_ROUND,
+	RESULT_SHOE_POSITION,
+	RESULT_RUNNING_COUNT,
+	RESULT_BET,
+	RESULT_PLAYER_CARD_1,
+	RESULT_PLAYER_CARD_2,
+	RESULT_DEALER_UP_CARD,
+	RESULT_DEALER_HOLE_CARD,
+	RESULT_PLAYER_TOTAL,
+	RESULT_DEALER_TOTAL,
+	RESULT_PLAYER_CARDS,
+	RESULT_NATURAL,
+	RESULT_OUTCOME,
+	RESULT_PAYOUT,
+	RESULT_COLUMN_COUNT
+};
+
+enum result_type
+{
+	RESULT_INT8 = 1,
+	RESULT_INT16 = 2,
+	RESULT_INT32 = 4,
+	RESULT_INT64 = 8
+};
+
+enum result_encoding
+{
+	RESULTS_DELTA,
+	RESULTS_RUNS,
+	RESULTS_PACKED
+};
+
+char *result_column_names[RESULT_COLUMN_COUNT] =
+{
+	"table", "round", "shoe_position", "running_count", "bet",
+	"player_card_1", "player_card_2", "dealer_up_card", "dealer_hole_card",
+	"player_total", "dealer_total", "player_cards", "natural", "outcome", "payout"
+};
+
+int result_column_types[RESULT_COLUMN_COUNT] =
+{
+	RESULT_INT32, RESULT_INT64, RESULT_INT16, RESULT_INT16, RESULT_INT32,
+	RESULT_INT8, RESULT_INT8, RESULT_INT8, RESULT_INT8,
+	RESULT_INT8, RESULT_INT8, RESULT_INT8, RESULT_INT8, RESULT_INT8, RESULT_INT32
+};
+
+typedef struct results_block
+{
+	int rows;
+	long long values[RESULT_COLUMN_COUNT][RESULTS_BLOCK_ROWS];
+} results_block;
+
+// A results file being written. Rows go into one block while the flusher thread encodes and writes the other.
+typedef struct results_file
+{
+	FILE *file;
+	results_block *blocks;
+	results_block *filling;
+	results_block *writing;
+	unsigned char *encoded;
+	long long rows;
+	long long bytes;
+	// Set once a write fails. Nothing more is written after that.
+	int failed;
+	#ifndef _WIN32
+	int closing;
+	pthread_t flusher;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	#endif
+} results_file;
+
+// Maps small negative and positive numbers to small unsigned ones: 0, -1, 1, -2, 2 -> 0, 1, 2, 3, 4.
+uint64_t zigzag_encode(long long value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+long long zigzag_decode(uint64_t value)
+{
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// Writes 7 bits per byte, with the top bit set on every byte but the last.
+size_t put_varint(unsigned char *buffer, uint64_t value)
+{
+	size_t length = 0;
+
+	while (value >= 0x80)
+	{
+		buffer[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+
+	buffer[length++] = (unsigned char)value;
+
+	return length;
+}
+
+// Reads a varint. Returns the number of bytes used, or 0 if the data ends first.
+size_t get_varint(const unsigned char *buffer, size_t size, uint64_t *value)
+{
+	size_t length = 0;
+	int shift = 0;
+
+	*value = 0;
+
+	while (length < size && length < RESULTS_MAX_VARINT)
+	{
+		*value |= (uint64_t)(buffer[length] & 0x7F) << shift;
+
+		if ((buffer[length++] & 0x80) == 0)
+		{
+			return length;
+		}
+
+		shift += 7;
+	}
+
+	return 0;
+}
+
+// Bit-packs 'value - minimum' for every row at the smallest width that holds the largest. Returns the bytes written.
+size_t pack_result_column(const long long *values, int rows, unsigned char *out)
+{
+	int i, width = 0, bits = 0;
+	size_t length = 1;
+	long long minimum = values[0], maximum = values[0];
+	uint64_t buffer = 0;
+
+	for (i = 1; i < rows; i++)
+	{
+		minimum = (values[i] < minimum) ? values[i] : minimum;
+		maximum = (values[i] > maximum) ? values[i] : maximum;
+	}
+
+	while (width < 64 && (((uint64_t)maximum - (uint64_t)minimum) >> width) != 0)
+	{
+		width++;
+	}
+
+	// Wider values would overflow the bit buffer, and varints do just as well on them.
+	if (width > RESULTS_MAX_PACKED_WIDTH)
+	{
+		return 0;
+	}
+
+	out[0] = RESULTS_PACKED;
+	length += put_varint(out + length, zigzag_encode(minimum));
+	out[length++] = (unsigned char)width;
+
+	for (i = 0; i < rows; i++)
+	{
+		buffer |= ((uint64_t)values[i] - (uint64_t)minimum) << bits;
+		bits += width;
+
+		while (bits >= 8)
+		{
+			out[length++] = (unsigned char)buffer;
+			buffer >>= 8;
+			bits -= 8;
+		}
+	}
+
+	if (bits > 0)
+	{
+		out[length++] = (unsigned char)buffer;
+	}
+
+	return length;
+}
+
+// Encodes one column of a block every way and keeps the smallest. Returns the number of bytes written to 'out'.
+// 'scratch' needs room for two more encoded columns.
+size_t encode_result_column(const long long *values, int rows, unsigned char *out, unsigned char *scratch)
+{
+	int i, run;
+	size_t delta_length = 1, runs_length = 1, packed_length;
+	long long previous = 0;
+	unsigned char *runs = scratch, *packed = scratch + RESULTS_COLUMN_BOUND;
+
+	out[0] = RESULTS_DELTA;
+	runs[0] = RESULTS_RUNS;
+
+	for (i = 0; i < rows; i++)
+	{
+		delta_length += put_varint(out + delta_length, zigzag_encode(values[i] - previous));
+		previous = values[i];
+	}
+
+	for (i = 0; i < rows; i += run)
+	{
+		for (run = 1; i + run < rows && values[i + run] == values[i]; run++);
+
+		runs_length += put_varint(runs + runs_length, zigzag_encode(values[i]));
+		runs_length += put_varint(runs + runs_length, (uint64_t)run);
+	}
+
+	packed_length = pack_result_column(values, rows, packed);
+
+	if (packed_length > 0 && packed_length < delta_length && packed_length <= runs_length)
+	{
+		memcpy(out, packed, packed_length);
+		return packed_length;
+	}
+
+	if (runs_length < delta_length)
+	{
+		memcpy(out, runs, runs_length);
+		return runs_length;
+	}
+
+	return delta_length;
+}
+
+// Unpacks a column written by pack_result_column(). Returns 0 if the data is damaged.
+int unpack_result_column(const unsigned char *data, size_t size, int rows, long long *values)
+{
+	int i, width, bits = 0;
+	size_t position = 1, used;
+	uint64_t minimum, buffer = 0;
+
+	used = get_varint(data + position, size - position, &minimum);
+	if (used == 0 || position + used >= size)
+	{
+		return 0;
+	}
+
+	position += used;
+	width = data[position++];
+
+	if (width > RESULTS_MAX_PACKED_WIDTH || size - position != ((size_t)rows * width + 7) / 8)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < rows; i++)
+	{
+		while (bits < width)
+		{
+			buffer |= (uint64_t)data[position++] << bits;
+			bits += 8;
+		}
+
+		values[i] = (long long)((uint64_t)zigzag_decode(minimum) + (buffer & ((1ULL << width) - 1)));
+		buffer >>= width;
+		bits -= width;
+	}
+
+	return 1;
+}
+
+// Decodes one column of a block. Returns 0 if the data is damaged.
+int decode_result_column(const unsigned char *data, size_t size, int rows, long long *values)
+{
+	int i = 0, run;
+	size_t position = 1, used;
+	uint64_t value, length;
+	long long previous = 0;
+
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	if (data[0] == RESULTS_PACKED)
+	{
+		return unpack_result_column(data, size, rows, values);
+	}
+
+	while (i < rows)
+	{
+		used = get_varint(data + position, size - position, &value);
+		if (used == 0)
+		{
+			return 0;
+		}
+
+		position += used;
+
+		if (data[0] == RESULTS_DELTA)
+		{
+			previous += zigzag_decode(value);
+			values[i++] = previous;
+			continue;
+		}
+
+		used = get_varint(data + position, size - position, &length);
+		if (data[0] != RESULTS_RUNS || used == 0 || length > (uint64_t)(rows - i))
+		{
+			return 0;
+		}
+
+		position += used;
+
+		for (run = 0; run < (int)length; run++)
+		{
+			values[i++] = zigzag_decode(value);
+		}
+	}
+
+	return (position == size);
+}
+
+// Encodes a full block and writes it out. Runs on the flusher thread.
+void write_results_block(results_file *results, results_block *block)
+{
+	int column;
+	size_t length;
+	unsigned char header[8];
+
+	if (results->failed)
+	{
+		return;
+	}
+
+	memcpy(header, RESULTS_BLOCK_MAGIC, 4);
+	put_u32(header + 4, (uint32_t)block->rows);
+
+	if (fwrite(header, 1, sizeof(header), results->file) != sizeof(header))
+	{
+		results->failed = 1;
+		return;
+	}
+
+	results->bytes += sizeof(header);
+
+	for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+	{
+		length = encode_result_column(block->values[column], block->rows, results->encoded + 4, results->encoded + 4 + RESULTS_COLUMN_BOUND);
+		put_u32(results->encoded, (uint32_t)length);
+
+		if (fwrite(results->encoded, 1, length + 4, results->file) != length + 4)
+		{
+			results->failed = 1;
+			return;
+		}
+
+		results->bytes += length + 4;
+	}
+}
+
+#ifndef _WIN32
+// Waits for full blocks and writes them, so the simulation never waits on the disk unless it gets two blocks ahead.
+void *results_flusher_thread(void *argument)
+{
+	results_file *results = argument;
+	results_block *block;
+
+	pthread_mutex_lock(&results->lock);
+
+	while (1)
+	{
+		while (results->writing == NULL && !results->closing)
+		{
+			pthread_cond_wait(&results->changed, &results->lock);
+		}
+
+		if (results->writing == NULL)
+		{
+			break;
+		}
+
+		block = results->writing;
+		pthread_mutex_unlock(&results->lock);
+
+		write_results_block(results, block);
+
+		pthread_mutex_lock(&results->lock);
+		results->writing = NULL;
+		pthread_cond_broadcast(&results->changed);
+	}
+
+	pthread_mutex_unlock(&results->lock);
+
+	return NULL;
+}
+#endif
+
+// Gives the block being filled to the flusher and starts filling the other one.
+void hand_off_results_block(results_file *results)
+{
+	results_block *full = results->filling;
+
+	#ifdef _WIN32
+	write_results_block(results, full);
+	#else
+	pthread_mutex_lock(&results->lock);
+
+	while (results->writing != NULL)
+	{
+		pthread_cond_wait(&results->changed, &results->lock);
+	}
+
+	results->writing = full;
+	pthread_cond_broadcast(&results->changed);
+	pthread_mutex_unlock(&results->lock);
+
+	results->filling = (full == &results->blocks[0]) ? &results->blocks[1] : &results->blocks[0];
+	#endif
+
+	results->filling->rows = 0;
+}
+
+// Creates a results file and starts its flusher thread. Returns NULL if the file can't be created.
+results_file *open_results_file(const char *path)
+{
+	int column;
+	unsigned char header[12];
+	results_file *results = malloc(sizeof(results_file));
+
+	if (results == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'results' - 01.\n");
+		exit(1);
+	}
+
+	results->blocks = malloc(sizeof(results_block) * 2);
+	results->encoded = malloc(4 + 3 * RESULTS_COLUMN_BOUND);
+
+	if (results->blocks == NULL || results->encoded == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'results' - 02.\n");
+		exit(1);
+	}
+
+	results->file = fopen(path, "wb");
+	if (results->file == NULL)
+	{
+		printf("ERROR: Failed to create the results file '%s'.\n", path);
+		free(results->encoded);
+		free(results->blocks);
+		free(results);
+		return NULL;
+	}
+
+	memcpy(header, RESULTS_MAGIC, 4);
+	put_u32(header + 4, RESULTS_VERSION);
+	put_u32(header + 8, RESULT_COLUMN_COUNT);
+	results->failed = (fwrite(header, 1, sizeof(header), results->file) != sizeof(header));
+	results->bytes = sizeof(header);
+
+	for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+	{
+		if (fputc(result_column_types[column], results->file) == EOF || fputc((int)strlen(result_column_names[column]), results->file) == EOF ||
+			fputs(result_column_names[column], results->file) == EOF)
+		{
+			results->failed = 1;
+		}
+
+		results->bytes += 2 + strlen(result_column_names[column]);
+	}
+
+	results->filling = &results->blocks[0];
+	results->filling->rows = 0;
+	results->writing = NULL;
+	results->rows = 0;
+
+	#ifndef _WIN32
+	results->closing = 0;
+	pthread_mutex_init(&results->lock, NULL);
+	pthread_cond_init(&results->changed, NULL);
+	pthread_create(&results->flusher, NULL, results_flusher_thread, results);
+	#endif
+
+	return results;
+}
+
+// Adds one round to the file. 'row' holds a value for every column in result_column order.
+void add_result_row(results_file *results, const long long *row)
+{
+	int column;
+	results_block *block = results->filling;
+
+	for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+	{
+		block->values[column][block->rows] = row[column];
+	}
+
+	block->rows++;
+	results->rows++;
+
+	if (block->rows == RESULTS_BLOCK_ROWS)
+	{
+		hand_off_results_block(results);
+	}
+}
+
+// Writes out the last partial block, stops the flusher and closes the file.
+// Returns 0 if any of the file couldn't be written, such as when the disk is full.
+int close_results_file(results_file *results)
+{
+	int written;
+
+	if (results->filling->rows > 0)
+	{
+		hand_off_results_block(results);
+	}
+
+	#ifndef _WIN32
+	pthread_mutex_lock(&results->lock);
+	results->closing = 1;
+	pthread_cond_broadcast(&results->changed);
+	pthread_mutex_unlock(&results->lock);
+
+	pthread_join(results->flusher, NULL);
+	pthread_cond_destroy(&results->changed);
+	pthread_mutex_destroy(&results->lock);
+	#endif
+
+	written = !results->failed;
+
+	if (fclose(results->file) != 0)
+	{
+		written = 0;
+	}
+
+	free(results->encoded);
+	free(results->blocks);
+	free(results);
+
+	return written;
+}
+
+// The Hi-Lo running count of the cards dealt so far, worked out from the cards left in the shoe.
+int get_running_count(int *counts)
+{
+	int rank, count = 0;
+
+	for (rank = 1; rank <= 5; rank++)
+	{
+		count -= counts[rank];
+	}
+
+	return count + counts[ACE_RANK] + counts[TEN_RANK];
+}
+
+// Prints a summary of a results file, or the whole file as CSV with --csv.
+// Usage: blackjack --read-results <file> [--csv]
+int run_read_results(int argc, char *argv[])
+{
+	int i, column, csv = 0, rows, types[RESULT_COLUMN_COUNT];
+	long long outcomes[OUTCOME_BLACKJACK + 1] = {0}, total_rows = 0, blocks = 0, raw_bytes = 0, file_bytes, wagered = 0, returned = 0;
+	long long minimum[RESULT_COLUMN_COUNT], maximum[RESULT_COLUMN_COUNT];
+	size_t size;
+	char names[RESULT_COLUMN_COUNT][256];
+	unsigned char header[12], *data = NULL;
+	long long *values[RESULT_COLUMN_COUNT];
+	FILE *file;
+
+	for (i = 3; i < argc; i++)
+	{
+		csv |= (strcmp(argv[i], "--csv") == 0);
+	}
+
+	if (argc < 3)
+	{
+		printf("Usage: blackjack --read-results <file> [--csv]\n");
+		return 1;
+	}
+
+	file = fopen(argv[2], "rb");
+	if (file == NULL)
+	{
+		printf("ERROR: Failed to open the results file '%s'.\n", argv[2]);
+		return 1;
+	}
+
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, RESULTS_MAGIC, 4) != 0 || get_u32(header + 4) != RESULTS_VERSION || get_u32(header + 8) != RESULT_COLUMN_COUNT)
+	{
+		printf("ERROR: '%s' is not a results file this version can read.\n", argv[2]);
+		fclose(file);
+		return 1;
+	}
+
+	for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+	{
+		types[column] = fgetc(file);
+		size = (size_t)fgetc(file);
+
+		if (types[column] == EOF || size >= sizeof(names[column]) || fread(names[column], 1, size, file) != size)
+		{
+			printf("ERROR: The header of '%s' is damaged.\n", argv[2]);
+			fclose(file);
+			return 1;
+		}
+
+		names[column][size] = '\0';
+		minimum[column] = INT64_MAX;
+		maximum[column] = INT64_MIN;
+
+		values[column] = malloc(sizeof(long long) * RESULTS_BLOCK_ROWS);
+		if (values[column] == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'values' - 01.\n");
+			exit(1);
+		}
+
+		if (csv)
+		{
+			printf("%s%s", names[column], (column + 1 < RESULT_COLUMN_COUNT) ? "," : "\n");
+		}
+	}
+
+	data = malloc(RESULTS_COLUMN_BOUND);
+	if (data == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'data' - 01.\n");
+		exit(1);
+	}
+
+	while (fread(header, 1, 8, file) == 8)
+	{
+		rows = (int)get_u32(header + 4);
+
+		if (memcmp(header, RESULTS_BLOCK_MAGIC, 4) != 0 || rows < 1 || rows > RESULTS_BLOCK_ROWS)
+		{
+			printf("ERROR: Block %lld of '%s' is damaged.\n", blocks + 1, argv[2]);
+			break;
+		}
+
+		for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+		{
+			if (fread(header, 1, 4, file) != 4 || (size = get_u32(header)) > RESULTS_COLUMN_BOUND || fread(data, 1, size, file) != size || !decode_result_column(data, size, rows, values[column]))
+			{
+				break;
+			}
+		}
+
+		if (column < RESULT_COLUMN_COUNT)
+		{
+			printf("ERROR: Block %lld of '%s' is damaged.\n", blocks + 1, argv[2]);
+			break;
+		}
+
+		for (i = 0; i < rows; i++)
+		{
+			for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+			{
+				if (csv)
+				{
+					printf("%lld%s", values[column][i], (column + 1 < RESULT_COLUMN_COUNT) ? "," : "\n");
+				}
+
+				if (values[column][i] < minimum[column])
+				{
+					minimum[column] = values[column][i];
+				}
+
+				if (values[column][i] > maximum[column])
+				{
+					maximum[column] = values[column][i];
+				}
+			}
+
+			if (values[RESULT_OUTCOME][i] >= OUTCOME_LOSS && values[RESULT_OUTCOME][i] <= OUTCOME_BLACKJACK)
+			{
+				outcomes[values[RESULT_OUTCOME][i]]++;
+			}
+
+			wagered += values[RESULT_BET][i];
+			returned += values[RESULT_PAYOUT][i];
+		}
+
+		total_rows += rows;
+		blocks++;
+	}
+
+	file_bytes = ftell(file);
+	fclose(file);
+
+	if (!csv)
+	{
+		for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+		{
+			raw_bytes += types[column] * total_rows;
+		}
+
+		printf("%lld rounds in %lld blocks. %lld bytes on disk, %lld bytes as fixed-width columns (%.1fx smaller).\n\n", total_rows, blocks, file_bytes, raw_bytes, (file_bytes > 0) ? (double)raw_bytes / file_bytes : 0.0);
+		printf("Column            | Type  |          Min |          Max\n");
+
+		for (column = 0; column < RESULT_COLUMN_COUNT && total_rows > 0; column++)
+		{
+			printf("%-17s | int%-2d | %12lld | %12lld\n", names[column], types[column] * 8, minimum[column], maximum[column]);
+		}
+
+		if (total_rows > 0)
+		{
+			printf("\nWins: %lld, losses: %lld, pushes: %lld, blackjacks: %lld\n", outcomes[OUTCOME_WIN], outcomes[OUTCOME_LOSS], outcomes[OUTCOME_PUSH], outcomes[OUTCOME_BLACKJACK]);
+			printf("Player's return: %+.4f%% of $%lld wagered.\n", (wagered > 0) ? 100.0 * (returned - wagered) / wagered : 0.0, wagered);
+		}
+	}
+
+	for (column = 0; column < RESULT_COLUMN_COUNT; column++)
+	{
+		free(values[column]);
+	}
+
+	free(data);
+
+	return 0;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------- START OF HAND HISTORY QUERIES ------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+Queries run against bitmap indexes kept next to the history in "<history>.idx".
+The index is brought up to date before every query, so only rounds recorded
+since the last query get indexed.
+
+The history is split into segments of HISTORY_SEGMENT_RECORDS rounds. For each
+segment the index holds the earliest and latest time in it, then one bitmap per
+indexed value with a bit set for every round that has that value:
+
+	outcome          one bitmap per round_outcome
+	bet              one bitmap per power of two ($16 - $31, $32 - $63, ...)
+	player's total   one bitmap per total
+	dealer's up card one bitmap per value, 2 - 11
+	blackjacks       one bitmap for the player's, one for the dealer's
+
+A query ORs together the bitmaps each filter accepts and ANDs the filters, a
+word at a time. Rounds are recorded in time order, so dates narrow the search
+to whole segments and only the segments a date falls inside need checking round
+by round. Bets are checked the same way, since a bet bitmap covers a range.
+
+The index is a cache in the machine's own byte order. --rebuild throws it away.
+
+==============================================================================*/
+
+#define HISTORY_INDEX_MAGIC "BJHX"
+#define HISTORY_INDEX_VERSION 1
+#define HISTORY_INDEX_HEADER_SIZE 32
+#define HISTORY_SEGMENT_RECORDS 65536
+#define HISTORY_SEGMENT_WORDS (HISTORY_SEGMENT_RECORDS / 64)
+#define HISTORY_BET_BUCKETS 32
+#define HISTORY_TOTAL_VALUES 32
+#define HISTORY_MAX_FILTERS 16
+#define SECONDS_PER_DAY 86400
+
+enum history_bitmap
+{
+	BITMAP_OUTCOME = 0,
+	BITMAP_BET = BITMAP_OUTCOME + OUTCOME_BLACKJACK + 1,
+	BITMAP_PLAYER_TOTAL = BITMAP_BET + HISTORY_BET_BUCKETS,
+	BITMAP_UP_CARD = BITMAP_PLAYER_TOTAL + HISTORY_TOTAL_VALUES,
+	BITMAP_PLAYER_BLACKJACK = BITMAP_UP_CARD + RANK_COUNT,
+	BITMAP_DEALER_BLACKJACK,
+	HISTORY_BITMAP_COUNT
+};
+
+#define HISTORY_SEGMENT_SIZE (16 + (size_t)HISTORY_BITMAP_COUNT * HISTORY_SEGMENT_WORDS * sizeof(uint64_t))
+
+char *outcome_names[OUTCOME_BLACKJACK + 1] = {"loss", "push", "win", "blackjack"};
+
+// Accepts rounds with any bitmap from 'first_bitmap' to 'last_bitmap' set, or none of them when negated.
+typedef struct history_filter
+{
+	int first_bitmap;
+	int last_bitmap;
+	int negate;
+	int check_bet;
+	long long low;
+	long long high;
+} history_filter;
+
+// The history and its index, both mapped into memory.
+typedef struct history_index
+{
+	const unsigned char *records;
+	long long record_count;
+	size_t history_size;
+	unsigned char *index;
+	size_t index_size;
+} history_index;
+
+// Bucket 'b' holds bets from 2^b to 2^(b + 1) - 1.
+int get_bet_bucket(long long bet)
+{
+	int bucket = 0;
+
+	while (bucket < HISTORY_BET_BUCKETS - 1 && (bet >> (bucket + 1)) > 0)
+	{
+		bucket++;
+	}
+
+	return bucket;
+}
+
+#ifndef _WIN32
+uint64_t *get_segment_bitmap(unsigned char *index, long long segment, int bitmap)
+{
+	return (uint64_t *)(index + HISTORY_INDEX_HEADER_SIZE + segment * HISTORY_SEGMENT_SIZE + 16 + (size_t)bitmap * HISTORY_SEGMENT_WORDS * sizeof(uint64_t));
+}
+
+// Rebuilds one segment of the index from the records in it.
+void index_history_segment(history_index *history, long long segment)
+{
+	long long i, first = segment * HISTORY_SEGMENT_RECORDS, last = first + HISTORY_SEGMENT_RECORDS;
+	int bit;
+	uint64_t time_value, earliest = UINT64_MAX, latest = 0;
+	const unsigned char *record;
+	unsigned char *header = history->index + HISTORY_INDEX_HEADER_SIZE + segment * HISTORY_SEGMENT_SIZE;
+
+	if (last > history->record_count)
+	{
+		last = history->record_count;
+	}
+
+	memset(header, 0, HISTORY_SEGMENT_SIZE);
+
+	for (i = first; i < last; i++)
+	{
+		record = history->records + i * HISTORY_RECORD_SIZE;
+		bit = (int)(i - first);
+		time_value = get_u64(record);
+
+		earliest = (time_value < earliest) ? time_value : earliest;
+		latest = (time_value > latest) ? time_value : latest;
+
+		#define SET_HISTORY_BIT(bitmap) (get_segment_bitmap(history->index, segment, (bitmap))[bit / 64] |= 1ULL << (bit % 64))
+
+		SET_HISTORY_BIT(BITMAP_OUTCOME + (record[19] % (OUTCOME_BLACKJACK + 1)));
+		SET_HISTORY_BIT(BITMAP_BET + get_bet_bucket(get_u32(record + 8)));
+		SET_HISTORY_BIT(BITMAP_PLAYER_TOTAL + (record[16] % HISTORY_TOTAL_VALUES));
+
+		if (record[18] >= 2 && record[18] <= 11)
+		{
+			SET_HISTORY_BIT(BITMAP_UP_CARD + (record[18] - 2));
+		}
+
+		if (record[20] & HISTORY_PLAYER_BLACKJACK)
+		{
+			SET_HISTORY_BIT(BITMAP_PLAYER_BLACKJACK);
+		}
+
+		if (record[20] & HISTORY_DEALER_BLACKJACK)
+		{
+			SET_HISTORY_BIT(BITMAP_DEALER_BLACKJACK);
+		}
+
+		#undef SET_HISTORY_BIT
+	}
+
+	put_u64(header, earliest);
+	put_u64(header + 8, latest);
+}
+
+// Maps the history and its index, indexing any rounds recorded since the last query. Returns 0 on failure.
+int open_history_index(history_index *history, const char *history_path, int rebuild)
+{
+	int fd;
+	long long indexed = 0, segment, segment_count;
+	char index_path[512];
+	unsigned char header[HISTORY_INDEX_HEADER_SIZE];
+	struct stat status;
+
+	fd = open(history_path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &status) != 0)
+	{
+		printf("ERROR: Failed to open the hand history '%s'.\n", history_path);
+		return 0;
+	}
+
+	// A round still being written is left for the next query.
+	history->record_count = (long long)status.st_size / HISTORY_RECORD_SIZE;
+	history->history_size = (size_t)status.st_size;
+	history->records = (history->history_size > 0) ? mmap(NULL, history->history_size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+	close(fd);
+
+	if (history->records == MAP_FAILED)
+	{
+		printf("ERROR: Failed to map the hand history '%s'.\n", history_path);
+		return 0;
+	}
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", history_path);
+
+	fd = open(index_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		printf("ERROR: Failed to open the index '%s'.\n", index_path);
+		return 0;
+	}
+
+	if (!rebuild && read(fd, header, sizeof(header)) == sizeof(header) && memcmp(header, HISTORY_INDEX_MAGIC, 4) == 0 && get_u32(header + 4) == HISTORY_INDEX_VERSION && get_u32(header + 8) == HISTORY_SEGMENT_RECORDS && get_u32(header + 12) == HISTORY_BITMAP_COUNT)
+	{
+		indexed = (long long)get_u64(header + 16);
+	}
+
+	// The history was replaced with a shorter one, so nothing in the index can be trusted.
+	if (indexed > history->record_count)
+	{
+		indexed = 0;
+	}
+
+	segment_count = (history->record_count + HISTORY_SEGMENT_RECORDS - 1) / HISTORY_SEGMENT_RECORDS;
+	history->index_size = HISTORY_INDEX_HEADER_SIZE + segment_count * HISTORY_SEGMENT_SIZE;
+
+	if (ftruncate(fd, (off_t)history->index_size) != 0)
+	{
+		printf("ERROR: Failed to grow the index '%s'.\n", index_path);
+		close(fd);
+		return 0;
+	}
+
+	history->index = mmap(NULL, history->index_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (history->index == MAP_FAILED)
+	{
+		printf("ERROR: Failed to map the index '%s'.\n", index_path);
+		return 0;
+	}
+
+	// The last segment may have been partly filled, so it's indexed again along with any new ones.
+	for (segment = indexed / HISTORY_SEGMENT_RECORDS; segment < segment_count && indexed < history->record_count; segment++)
+	{
+		index_history_segment(history, segment);
+	}
+
+	memset(history->index, 0, HISTORY_INDEX_HEADER_SIZE);
+	memcpy(history->index, HISTORY_INDEX_MAGIC, 4);
+	put_u32(history->index + 4, HISTORY_INDEX_VERSION);
+	put_u32(history->index + 8, HISTORY_SEGMENT_RECORDS);
+	put_u32(history->index + 12, HISTORY_BITMAP_COUNT);
+	put_u64(history->index + 16, (uint64_t)history->record_count);
+
+	return 1;
+}
+
+void close_history_index(history_index *history)
+{
+	if (history->records != NULL)
+	{
+		munmap((void *)history->records, history->history_size);
+	}
+
+	munmap(history->index, history->index_size);
+}
+#endif
+
+// Reads "2026-10-01" as local midnight, or "7d" as that many days ago. Returns -1 if it's neither.
+long long parse_history_date(const char *text, int end_of_day)
+{
+	int year, month, day;
+	long long days;
+	char unit;
+	struct tm date;
+
+	if (sscanf(text, "%d-%d-%d", &year, &month, &day) == 3)
+	{
+		memset(&date, 0, sizeof(date));
+		date.tm_year = year - 1900;
+		date.tm_mon = month - 1;
+		date.tm_mday = day + (end_of_day ? 1 : 0);
+		date.tm_isdst = -1;
+
+		return (long long)mktime(&date);
+	}
+
+	if (sscanf(text, "%lld%c", &days, &unit) == 2 && unit == 'd')
+	{
+		return (long long)time(NULL) - days * SECONDS_PER_DAY;
+	}
+
+	return -1;
+}
+
+// Turns one query term, such as "bet>1000" or "blackjack=dealer", into a filter. Returns 0 if it isn't understood.
+int parse_history_filter(const char *term, history_filter *filter, long long *since, long long *until)
+{
+	int i;
+	long long value, low, high;
+	char name[32], op[3] = {0};
+	const char *text;
+	size_t length = strcspn(term, "<>=");
+
+	if (length == 0 || length >= sizeof(name) || term[length] == '\0')
+	{
+		return 0;
+	}
+
+	memcpy(name, term, length);
+	name[length] = '\0';
+
+	op[0] = term[length];
+	if (term[length + 1] == '=')
+	{
+		op[1] = '=';
+	}
+
+	text = term + length + strlen(op);
+
+	filter->negate = 0;
+	filter->check_bet = 0;
+
+	if (strcmp(name, "since") == 0 || strcmp(name, "until") == 0)
+	{
+		value = parse_history_date(text, (name[0] == 'u' && strchr(text, '-') != NULL));
+
+		if (strcmp(op, "=") != 0 || value < 0)
+		{
+			return 0;
+		}
+
+		*((name[0] == 's') ? since : until) = value;
+
+		// Dates don't use a bitmap.
+		filter->first_bitmap = -1;
+		return 1;
+	}
+
+	if (strcmp(name, "outcome") == 0 || strcmp(name, "blackjack") == 0)
+	{
+		if (strcmp(op, "=") != 0)
+		{
+			return 0;
+		}
+
+		for (i = 0; name[0] == 'o' && i <= OUTCOME_BLACKJACK; i++)
+		{
+			if (strcmp(text, outcome_names[i]) == 0)
+			{
+				filter->first_bitmap = filter->last_bitmap = BITMAP_OUTCOME + i;
+				return 1;
+			}
+		}
+
+		if (name[0] == 'b')
+		{
+			filter->first_bitmap = (strcmp(text, "dealer") == 0) ? BITMAP_DEALER_BLACKJACK : BITMAP_PLAYER_BLACKJACK;
+			filter->last_bitmap = (strcmp(text, "player") == 0) ? BITMAP_PLAYER_BLACKJACK : BITMAP_DEALER_BLACKJACK;
+			filter->negate = (strcmp(text, "none") == 0);
+
+			return (strcmp(text, "dealer") == 0 || strcmp(text, "player") == 0 || strcmp(text, "any") == 0 || filter->negate);
+		}
+
+		return 0;
+	}
+
+	// Everything else is a number compared with =, <, <=, > or >=.
+	if (strcmp(name, "up") == 0 && toupper(text[0]) == 'A' && text[1] == '\0')
+	{
+		value = 11;
+	}
+	else if (sscanf(text, "%lld", &value) != 1)
+	{
+		return 0;
+	}
+
+	low = (op[0] == '>') ? value + (op[1] != '=') : ((op[0] == '<') ? INT64_MIN / 2 : value);
+	high = (op[0] == '<') ? value - (op[1] != '=') : ((op[0] == '>') ? INT64_MAX / 2 : value);
+
+	if (strcmp(name, "bet") == 0)
+	{
+		filter->first_bitmap = BITMAP_BET + get_bet_bucket((low < 0) ? 0 : low);
+		filter->last_bitmap = (high < 0) ? (BITMAP_BET - 1) : (BITMAP_BET + get_bet_bucket(high));
+		filter->low = low;
+		filter->high = high;
+
+		// Rounds only need checking one by one when a bound falls inside a bucket.
+		filter->check_bet = (low > 1 && low != (1LL << get_bet_bucket(low))) || (high < INT64_MAX / 2 && high != (2LL << get_bet_bucket(high)) - 1);
+	}
+	else if (strcmp(name, "player") == 0)
+	{
+		filter->first_bitmap = BITMAP_PLAYER_TOTAL + (int)((low < 0) ? 0 : ((low >= HISTORY_TOTAL_VALUES) ? HISTORY_TOTAL_VALUES : low));
+		filter->last_bitmap = BITMAP_PLAYER_TOTAL + (int)((high < 0) ? -1 : ((high >= HISTORY_TOTAL_VALUES) ? (HISTORY_TOTAL_VALUES - 1) : high));
+	}
+	else if (strcmp(name, "up") == 0)
+	{
+		filter->first_bitmap = BITMAP_UP_CARD + (int)((low < 2) ? 0 : ((low > 11) ? RANK_COUNT : (low - 2)));
+		filter->last_bitmap = BITMAP_UP_CARD + (int)((high < 2) ? -1 : ((high > 11) ? (RANK_COUNT - 1) : (high - 2)));
+	}
+	else
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+// Finds the rounds in the hand history that match every term.
+// Usage: blackjack --query-history [--history file] [--list n] [--totals] [--rebuild] [term ...]
+// Terms: outcome=win|loss|push|blackjack, blackjack=player|dealer|any|none, bet>1000, player>=17, up=A, since=7d, until=2026-10-01
+int run_query_history(int argc, char *argv[])
+{
+	#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+
+	printf("Hand history queries are not supported on Windows.\n");
+	return 1;
+	#else
+	int i, f, bit, filter_count = 0, list = 0, totals = 0, rebuild = 0, check_time, word_count, listed = 0;
+	long long segment, segment_count, first, rows, since = INT64_MIN, until = INT64_MAX, matches = 0, wagered = 0, paid = 0, number, record_time;
+	uint64_t words[HISTORY_SEGMENT_WORDS], any, earliest, latest;
+	char *history_path = HISTORY_FILE_NAME, date[32];
+	double start;
+	const unsigned char *record;
+	history_filter filters[HISTORY_MAX_FILTERS];
+	history_index history;
+	time_t shown;
+
+	for (i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--history") == 0 && (i + 1) < argc)
+		{
+			history_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--list") == 0 && (i + 1) < argc)
+		{
+			list = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--totals") == 0)
+		{
+			totals = 1;
+		}
+		else if (strcmp(argv[i], "--rebuild") == 0)
+		{
+			rebuild = 1;
+		}
+		else if (filter_count == HISTORY_MAX_FILTERS || !parse_history_filter(argv[i], &filters[filter_count], &since, &until))
+		{
+			printf("Could not understand '%s'.\n", argv[i]);
+			printf("Usage: blackjack --query-history [--history file] [--list n] [--totals] [--rebuild] [term ...]\n");
+			printf("Terms: outcome=win|loss|push|blackjack, blackjack=player|dealer|any|none, bet>1000, player>=17, up=A, since=7d, until=2026-10-01\n");
+			return 1;
+		}
+		else if (filters[filter_count].first_bitmap >= 0)
+		{
+			filter_count++;
+		}
+	}
+
+	if (!open_history_index(&history, history_path, rebuild))
+	{
+		return 1;
+	}
+
+	start = get_seconds();
+	segment_count = (history.record_count + HISTORY_SEGMENT_RECORDS - 1) / HISTORY_SEGMENT_RECORDS;
+
+	if (list > 0)
+	{
+		printf("Time                |     Bet |  Payout | Player | Dealer | Up | Outcome   | Blackjack\n");
+	}
+
+	for (segment = 0; segment < segment_count; segment++)
+	{
+		earliest = get_u64(history.index + HISTORY_INDEX_HEADER_SIZE + segment * HISTORY_SEGMENT_SIZE);
+		latest = get_u64(history.index + HISTORY_INDEX_HEADER_SIZE + segment * HISTORY_SEGMENT_SIZE + 8);
+
+		if ((long long)latest < since || (long long)earliest >= until)
+		{
+			continue;
+		}
+
+		check_time = ((long long)earliest < since || (long long)latest >= until);
+		first = segment * HISTORY_SEGMENT_RECORDS;
+		rows = (history.record_count - first < HISTORY_SEGMENT_RECORDS) ? (history.record_count - first) : HISTORY_SEGMENT_RECORDS;
+		word_count = (int)((rows + 63) / 64);
+
+		for (i = 0; i < word_count; i++)
+		{
+			words[i] = ~0ULL;
+		}
+
+		for (f = 0; f < filter_count; f++)
+		{
+			for (i = 0; i < word_count; i++)
+			{
+				for (any = 0, bit = filters[f].first_bitmap; bit <= filters[f].last_bitmap; bit++)
+				{
+					any |= get_segment_bitmap(history.index, segment, bit)[i];
+				}
+
+				words[i] &= filters[f].negate ? ~any : any;
+			}
+		}
+
+		// Rounds past the end of the history in the last word.
+		if (rows % 64 != 0)
+		{
+			words[word_count - 1] &= (1ULL << (rows % 64)) - 1;
+		}
+
+		for (i = 0; i < word_count; i++)
+		{
+			any = words[i];
+
+			// Nothing to check or add up, so the bits only need counting.
+			if (!check_time && list == listed && !totals)
+			{
+				for (f = 0; f < filter_count && !filters[f].check_bet; f++);
+
+				if (f == filter_count)
+				{
+					matches += __builtin_popcountll(any);
+					continue;
+				}
+			}
+
+			while (any != 0)
+			{
+				bit = __builtin_ctzll(any);
+				any &= any - 1;
+
+				number = first + i * 64 + bit;
+				record = history.records + number * HISTORY_RECORD_SIZE;
+				record_time = (long long)get_u64(record);
+
+				if (check_time && (record_time < since || record_time >= until))
+				{
+					continue;
+				}
+
+				for (f = 0; f < filter_count; f++)
+				{
+					if (filters[f].check_bet && (get_u32(record + 8) < filters[f].low || get_u32(record + 8) > filters[f].high))
+					{
+						break;
+					}
+				}
+
+				if (f < filter_count)
+				{
+					continue;
+				}
+
+				matches++;
+				wagered += get_u32(record + 8);
+				paid += get_u32(record + 12);
+
+				if (listed < list)
+				{
+					shown = (time_t)record_time;
+					strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&shown));
+					printf("%s | %7u | %7u | %6d | %6d | %2d | %-9s | %s\n", date, get_u32(record + 8), get_u32(record + 12), record[16], record[17], record[18], outcome_names[record[19] % (OUTCOME_BLACKJACK + 1)], (record[20] & HISTORY_DEALER_BLACKJACK) ? ((record[20] & HISTORY_PLAYER_BLACKJACK) ? "both" : "dealer") : ((record[20] & HISTORY_PLAYER_BLACKJACK) ? "player" : "-"));
+					listed++;
+				}
+			}
+		}
+	}
+
+	if (list > 0)
+	{
+		printf("\n");
+	}
+
+	printf("%lld of %lld rounds match. Answered in %.2f ms.\n", matches, history.record_count, (get_seconds() - start) * 1000.0);
+
+	if (totals)
+	{
+		printf("Wagered: $%lld, paid back: $%lld, player's net: %+lld.\n", wagered, paid, paid - wagered);
+	}
+
+	close_history_index(&history);
+
+	return 0;
+	#endif
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------ START OF SIMULATION SUMMARIES -------------------------
+--------------------------------------------------------------------------------
+================================================================================
+
+A big simulation can be split into shards, each its own process with no
+network between them. Shard k of `--simulate --tables n --shard k` plays
+tables k * n to (k + 1) * n - 1, each seeded with the seed plus its table
+number, so every shard plays different shoes and the shards together play
+exactly what one run with all the tables would.
+
+Each shard writes a summary file with `--summary`. Everything in it is a
+whole number, results counted in half bets so a blackjack paid 3 to 2 is 1
+and a win 2,
+which lets `blackjack --merge-summaries` add the shards up exactly in any
+order. The merged summary is itself a summary, so merges can be merged.
+Numbers are little-endian.
+
+	  0  "BJSM"
+	  4  version (u32)
+	  8  decks (u32)
+	 12  bucket count (u32)
+	 16  rounds per table (u64)
+	 24  seed (u64)
+	 32  first table (u64)
+	 40  table count (u64)
+	 48  hands (u64)
+	 56  sum of the results in half bets (i64)
+	 64  sum of the squared results in half bets (u64)
+	 72  losses, pushes, wins and blackjacks (4 x u64)
+	104  bucket width in half bets (u64)
+	112  strategy name (SUMMARY_NAME_LENGTH bytes, zero padded)
+	176  buckets, a histogram of each table's net result (bucket count x u64)
+
+Bucket b counts the tables that finished with a net result from
+(b - bucket count / 2) bucket widths up to the next. The first and last
+buckets also hold everything beyond them.
+
+==============================================================================*/
+
+#define SUMMARY_MAGIC "BJSM"
+#define SUMMARY_VERSION 1
+#define SUMMARY_BUCKETS 64
+#define SUMMARY_NAME_LENGTH 64
+#define SUMMARY_HEADER_SIZE 176
+#define SUMMARY_SIZE (SUMMARY_HEADER_SIZE + SUMMARY_BUCKETS * 8)
+#define SUMMARY_BAR_WIDTH 40
+
+typedef struct simulation_summary
+{
+	uint32_t num_decks;
+	uint64_t rounds;
+	uint64_t seed;
+	uint64_t first_table;
+	uint64_t table_count;
+	uint64_t hands;
+	int64_t sum;
+	uint64_t square;
+	uint64_t outcomes[OUTCOME_BLACKJACK + 1];
+	uint64_t bucket_width;
+	char strategy_name[SUMMARY_NAME_LENGTH];
+	uint64_t buckets[SUMMARY_BUCKETS];
+} simulation_summary;
+
+// Gets what a round ended in from its net result, the same way the hand history does. 'natural' is 1 if the
+// player's first two cards were a blackjack. A natural wins 1.5x, or 1x against a dealer bust like any other win.
+int get_round_outcome(double result, int natural)
+{
+	if (result < 0.0)
+	{
+		return OUTCOME_LOSS;
+	}
+	else if (result == 0.0)
+	{
+		return OUTCOME_PUSH;
+	}
+
+	return natural ? OUTCOME_BLACKJACK : OUTCOME_WIN;
+}
+
+// Sets up an empty summary. The bucket width only depends on the rounds, so shards of one run always agree on it.
+// The buckets are wide enough for an edge of 15% either way plus four standard deviations of luck.
+void start_simulation_summary(simulation_summary *summary, int num_decks, uint64_t rounds, uint64_t seed, uint64_t first_table, const char *strategy_name)
+{
+	memset(summary, 0, sizeof(simulation_summary));
+	summary->num_decks = (uint32_t)num_decks;
+	summary->rounds = rounds;
+	summary->seed = seed;
+	summary->first_table = first_table;
+	summary->bucket_width = 1 + rounds / 100 + (uint64_t)sqrt((double)rounds) / 4;
+	snprintf(summary->strategy_name, SUMMARY_NAME_LENGTH, "%s", strategy_name);
+}
+
+// Adds the rounds of one table: how many of each outcome, and its net result in half bets.
+// Every round is -2, 0, 1 or 2 half bets, and only a natural paid 3 to 2 is 1. The net says how many of the
+// blackjacks were paid that way rather than beating a dealer bust, which gives the sum of the squares.
+void add_table_to_summary(simulation_summary *summary, const long long *outcomes, long long net)
+{
+	int i;
+	long long bucket, wins = outcomes[OUTCOME_WIN] + outcomes[OUTCOME_BLACKJACK];
+	long long paid_3_to_2 = 2 * wins - 2 * outcomes[OUTCOME_LOSS] - net;
+
+	for (i = 0; i <= OUTCOME_BLACKJACK; i++)
+	{
+		summary->outcomes[i] += (uint64_t)outcomes[i];
+		summary->hands += (uint64_t)outcomes[i];
+	}
+
+	summary->sum += (int64_t)net;
+	summary->square += (uint64_t)(4 * (wins + outcomes[OUTCOME_LOSS]) - 3 * paid_3_to_2);
+
+	// Rounds toward negative infinity, so a table that lost half a bet isn't counted with the ones that broke even.
+	bucket = (net >= 0) ? net / (long long)summary->bucket_width : -((-net - 1) / (long long)summary->bucket_width) - 1;
+	bucket += SUMMARY_BUCKETS / 2;
+	bucket = (bucket < 0) ? 0 : ((bucket >= SUMMARY_BUCKETS) ? SUMMARY_BUCKETS - 1 : bucket);
+
+	summary->buckets[bucket]++;
+	summary->table_count++;
+}
+
+int write_simulation_summary(const char *path, const simulation_summary *summary)
+{
+	unsigned char buffer[SUMMARY_SIZE];
+	char temporary_path[512];
+	FILE *file;
+	int i;
+
+	memset(buffer, 0, sizeof(buffer));
+	memcpy(buffer, SUMMARY_MAGIC, 4);
+	put_u32(buffer + 4, SUMMARY_VERSION);
+	put_u32(buffer + 8, summary->num_decks);
+	put_u32(buffer + 12, SUMMARY_BUCKETS);
+	put_u64(buffer + 16, summary->rounds);
+	put_u64(buffer + 24, summary->seed);
+	put_u64(buffer + 32, summary->first_table);
+	put_u64(buffer + 40, summary->table_count);
+	put_u64(buffer + 48, summary->hands);
+	put_u64(buffer + 56, (uint64_t)summary->sum);
+	put_u64(buffer + 64, summary->square);
+
+	for (i = 0; i <= OUTCOME_BLACKJACK; i++)
+	{
+		put_u64(buffer + 72 + i * 8, summary->outcomes[i]);
+	}
+
+	put_u64(buffer + 104, summary->bucket_width);
+	memcpy(buffer + 112, summary->strategy_name, SUMMARY_NAME_LENGTH);
+
+	for (i = 0; i < SUMMARY_BUCKETS; i++)
+	{
+		put_u64(buffer + SUMMARY_HEADER_SIZE + i * 8, summary->buckets[i]);
+	}
+
+	// Written to a temporary name first, so a scheduler that kills the shard never leaves half a summary behind.
+	snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+	file = fopen(temporary_path, "wb");
+	if (file == NULL || fwrite(buffer, 1, sizeof(buffer), file) != sizeof(buffer) || fclose(file) != 0 || rename(temporary_path, path) != 0)
+	{
+		printf("ERROR: Failed to write the summary '%s'.\n", path);
+		return 0;
+	}
+
+	return 1;
+}
+
+int read_simulation_summary(const char *path, simulation_summary *summary)
+{
+	unsigned char buffer[SUMMARY_SIZE];
+	FILE *file = fopen(path, "rb");
+	size_t size;
+	int i;
+
+	if (file == NULL)
+	{
+		printf("ERROR: Failed to open the summary '%s'.\n", path);
+		return 0;
+	}
+
+	size = fread(buffer, 1, sizeof(buffer), file);
+	fclose(file);
+
+	if (size != sizeof(buffer) || memcmp(buffer, SUMMARY_MAGIC, 4) != 0 || get_u32(buffer + 4) != SUMMARY_VERSION || get_u32(buffer + 12) != SUMMARY_BUCKETS)
+	{
+		printf("ERROR: '%s' is not a simulation summary.\n", path);
+		return 0;
+	}
+
+	summary->num_decks = get_u32(buffer + 8);
+	summary->rounds = get_u64(buffer + 16);
+	summary->seed = get_u64(buffer + 24);
+	summary->first_table = get_u64(buffer + 32);
+	summary->table_count = get_u64(buffer + 40);
+	summary->hands = get_u64(buffer + 48);
+	summary->sum = (int64_t)get_u64(buffer + 56);
+	summary->square = get_u64(buffer + 64);
+
+	for (i = 0; i <= OUTCOME_BLACKJACK; i++)
+	{
+		summary->outcomes[i] = get_u64(buffer + 72 + i * 8);
+	}
+
+	summary->bucket_width = get_u64(buffer + 104);
+	memcpy(summary->strategy_name, buffer + 112, SUMMARY_NAME_LENGTH);
+	summary->strategy_name[SUMMARY_NAME_LENGTH - 1] = '\0';
+
+	for (i = 0; i < SUMMARY_BUCKETS; i++)
+	{
+		summary->buckets[i] = get_u64(buffer + SUMMARY_HEADER_SIZE + i * 8);
+	}
+
+	return 1;
+}
+
+// Sorts summaries by their first table.
+int compare_summaries(const void *a, const void *b)
+{
+	const simulation_summary *x = a, *y = b;
+
+	return (x->first_table > y->first_table) - (x->first_table < y->first_table);
+}
+
+// Prints the expected return, outcomes and the spread of the tables' results.
+void print_simulation_summary(const simulation_summary *summary)
+{
+	int i, j, first, last;
+	uint64_t most = 0;
+	double n = (double)summary->hands, mean, variance, width = summary->bucket_width / 2.0;
+
+	mean = summary->sum / n / 2.0;
+	variance = (n > 1) ? (summary->square / 4.0 - n * mean * mean) / (n - 1) : 0.0;
+
+	printf("Strategy: %s\n", summary->strategy_name);
+	printf("Tables: %llu from table %llu, rounds per table: %llu, decks: %u, seed: %llu\n\n", (unsigned long long)summary->table_count, (unsigned long long)summary->first_table, (unsigned long long)summary->rounds, summary->num_decks, (unsigned long long)summary->seed);
+	printf("Player's expected return: %+.4f%% +/- %.4f%% per hand.\n", mean * 100.0, sqrt(variance / n) * 100.0);
+	printf("%llu hands. Wins: %llu, losses: %llu, pushes: %llu, blackjacks: %llu\n\n", (unsigned long long)summary->hands, (unsigned long long)summary->outcomes[OUTCOME_WIN], (unsigned long long)summary->outcomes[OUTCOME_LOSS], (unsigned long long)summary->outcomes[OUTCOME_PUSH], (unsigned long long)summary->outcomes[OUTCOME_BLACKJACK]);
+
+	for (first = 0; first < SUMMARY_BUCKETS - 1 && summary->buckets[first] == 0; first++);
+	for (last = SUMMARY_BUCKETS - 1; last > first && summary->buckets[last] == 0; last--);
+
+	for (i = first; i <= last; i++)
+	{
+		most = (summary->buckets[i] > most) ? summary->buckets[i] : most;
+	}
+
+	printf("Net result of each table, in bets:\n");
+
+	for (i = first; i <= last; i++)
+	{
+		printf("%9.1f to %9.1f | %10llu | ", (i - SUMMARY_BUCKETS / 2) * width, (i - SUMMARY_BUCKETS / 2 + 1) * width, (unsigned long long)summary->buckets[i]);
+
+		for (j = 0; j < (int)(summary->buckets[i] * SUMMARY_BAR_WIDTH / most); j++)
+		{
+			printf("#");
+		}
+
+		printf("\n");
+	}
+}
+
+// Adds shard summaries together and checks that they belong to the same run and don't play any table twice.
+// Usage: blackjack --merge-summaries [--output file] file ...
+int run_merge_summaries(int argc, char *argv[])
+{
+	int i, j, count = 0, gaps = 0;
+	char *output = NULL;
+	simulation_summary *summaries, total;
+
+	summaries = malloc(sizeof(simulation_summary) * argc);
+
+	if (summaries == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'summaries' - 01.\n");
+		return 1;
+	}
+
+	for (i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--output") == 0 && (i + 1) < argc)
+		{
+			output = argv[++i];
+		}
+		else if (!read_simulation_summary(argv[i], &summaries[count++]))
+		{
+			free(summaries);
+			return 1;
+		}
+	}
+
+	if (count == 0)
+	{
+		printf("Usage: blackjack --merge-summaries [--output file] file ...\n");
+		free(summaries);
+		return 1;
+	}
+
+	qsort(summaries, count, sizeof(simulation_summary), compare_summaries);
+	total = summaries[0];
+
+	for (i = 1; i < count; i++)
+	{
+		simulation_summary *shard = &summaries[i];
+
+		if (shard->num_decks != total.num_decks || shard->rounds != total.rounds || shard->seed != total.seed || shard->bucket_width != total.bucket_width || strcmp(shard->strategy_name, total.strategy_name) != 0)
+		{
+			printf("ERROR: The summary of tables %llu to %llu comes from a different run. (Decks, rounds, seed or strategy differ)\n", (unsigned long long)shard->first_table, (unsigned long long)(shard->first_table + shard->table_count - 1));
+			free(summaries);
+			return 1;
+		}
+
+		if (shard->first_table < summaries[i - 1].first_table + summaries[i - 1].table_count)
+		{
+			printf("ERROR: Tables %llu to %llu are in more than one summary.\n", (unsigned long long)shard->first_table, (unsigned long long)(summaries[i - 1].first_table + summaries[i - 1].table_count - 1));
+			free(summaries);
+			return 1;
+		}
+
+		if (shard->first_table > summaries[i - 1].first_table + summaries[i - 1].table_count)
+		{
+			printf("Tables %llu to %llu are missing.\n", (unsigned long long)(summaries[i - 1].first_table + summaries[i - 1].table_count), (unsigned long long)(shard->first_table - 1));
+			gaps++;
+		}
+
+		total.table_count += shard->table_count;
+		total.hands += shard->hands;
+		total.sum += shard->sum;
+		total.square += shard->square;
+
+		for (j = 0; j <= OUTCOME_BLACKJACK; j++)
+		{
+			total.outcomes[j] += shard->outcomes[j];
+		}
+
+		for (j = 0; j < SUMMARY_BUCKETS; j++)
+		{
+			total.buckets[j] += shard->buckets[j];
+		}
+	}
+
+	printf("Merged %d summar%s.%s\n", count, (count == 1) ? "y" : "ies", (gaps > 0) ? " (Some tables are missing)" : "");
+	print_simulation_summary(&total);
+
+	if (output != NULL)
+	{
+		// A summary only describes one unbroken range of tables.
+		if (gaps > 0)
+		{
+			printf("ERROR: Not writing '%s' since tables are missing.\n", output);
+			free(summaries);
+			return 1;
+		}
+
+		if (!write_simulation_summary(output, &total))
+		{
+			free(summaries);
+			return 1;
+		}
+
+		printf("\nWrote the merged summary to '%s'.\n", output);
+	}
+
+	free(summaries);
+
+	return (gaps > 0);
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------ START OF HEADLESS SIMULATION --------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+#define DEFAULT_SIMULATION_TABLES 1000
+#define DEFAULT_TABLE_ROUNDS 1000
+#define UNLIMITED_ROUNDS 2000000000
+#define SIMULATION_GROUP_TABLES 64
+#define DEFAULT_CONFIDENCE 95.0
+#define MIN_SEQUENTIAL_HANDS 100000
+#define SIMULATION_SLICE_ROUNDS 1000
+
+enum table_phase
+{
+	TABLE_WAITING,
+	TABLE_DEALER,
+	TABLE_DONE
+};
+
+// One table of a headless simulation, with its own shoe and generator.
+typedef struct sim_table
+{
+	deck play_deck;
+	deck used_deck;
+	hand player;
+	hand dealer;
+	int counts[RANK_COUNT];
+	int phase;
+	int shoe_position;
+	int running_count;
+	double result;
+	// Kept for summaries: the table's net result in half bets and how many rounds ended each way.
+	long long net;
+	long long outcomes[OUTCOME_BLACKJACK + 1];
+	rng r;
+} sim_table;
+
+// Running mean and spread of a stream of results. (Welford's method)
+typedef struct welford
+{
+	long long count;
+	double mean;
+	double m2;
+} welford;
+
+// A slice of the tables played together. Each pass sends all of its tables waiting on a hit or stand to the strategy in one call.
+typedef struct sim_group
+{
+	sim_table *tables;
+	int first_table;
+	int table_count;
+	strategy_request *requests;
+	int *waiting;
+	int *decisions;
+	long long batches;
+	long long decisions_made;
+	welford results;
+} sim_group;
+
+typedef struct simulation_context
+{
+	sim_group *groups;
+	strategy *player_strategy;
+	int rounds;
+} simulation_context;
+
+void add_welford(welford *w, double x)
+{
+	double delta = x - w->mean;
+
+	(w->count)++;
+	w->mean += delta / w->count;
+	w->m2 += delta * (x - w->mean);
+}
+
+// Adds the results summed up in 'from' to 'into', as if they had been added one at a time. (Chan's method)
+void merge_welford(welford *into, const welford *from)
+{
+	long long count = into->count + from->count;
+	double delta = from->mean - into->mean;
+
+	if (from->count == 0)
+	{
+		return;
+	}
+
+	into->mean += delta * from->count / count;
+	into->m2 += from->m2 + delta * delta * ((double)into->count * from->count / count);
+	into->count = count;
+}
+
+// Standard error of the mean of the results.
+double get_welford_error(const welford *w)
+{
+	return (w->count > 1) ? sqrt(w->m2 / (w->count - 1) / w->count) : 0.0;
+}
+
+// Gets how many standard errors either side of the mean hold 'confidence' percent of a normal distribution.
+double get_confidence_z(double confidence)
+{
+	double low = 0.0, high = 10.0, middle;
+	int i;
+
+	for (i = 0; i < 100; i++)
+	{
+		middle = (low + high) / 2;
+
+		if (erf(middle / sqrt(2.0)) * 100.0 < confidence)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return (low + high) / 2;
+}
+
+// Plays one round at every table of a group. With a results file, every round is also written to it.
+void play_group_round(sim_group *group, strategy *player_strategy, int round, int bet, results_file *results)
+{
+	int i, t, count, total_cards, outcome, natural;
+	long long row[RESULT_COLUMN_COUNT];
+	sim_table *tables = group->tables;
+
+	for (t = 0; t < group->table_count; t++)
+	{
+		sim_table *table = &tables[t];
+
+		if (results != NULL)
+		{
+			total_cards = table->play_deck.total_cards + table->used_deck.total_cards;
+			table->shoe_position = total_cards - table->play_deck.total_cards;
+			table->running_count = get_running_count(table->counts);
+		}
+
+		if (!deal_headless_round(&table->play_deck, &table->used_deck, &table->player, &table->dealer, table->counts, &table->r))
+		{
+			table->phase = TABLE_DONE;
+		}
+		else
+		{
+			table->phase = (table->player.hand_value < 21) ? TABLE_WAITING : TABLE_DEALER;
+		}
+	}
+
+	// Keeps asking until every player has stood, busted or reached 21.
+	do
+	{
+		for (t = 0, count = 0; t < group->table_count; t++)
+		{
+			if (tables[t].phase == TABLE_WAITING)
+			{
+				fill_strategy_request(&group->requests[count], &tables[t].player, &tables[t].dealer, tables[t].counts);
+				group->waiting[count] = t;
+				count++;
+			}
+		}
+
+		if (count == 0)
+		{
+			break;
+		}
+
+		player_strategy->decide(group->requests, group->decisions, count);
+		(group->batches)++;
+		group->decisions_made += count;
+
+		for (i = 0; i < count; i++)
+		{
+			sim_table *table = &tables[group->waiting[i]];
+
+			if (group->decisions[i] == STRATEGY_HIT)
+			{
+				draw_card(&table->play_deck, &table->used_deck, &table->player, table->counts, &table->r);
+				get_hand_value(&table->player);
+
+				if (table->player.hand_value >= 21)
+				{
+					table->phase = TABLE_DEALER;
+				}
+			}
+			else
+			{
+				table->phase = TABLE_DEALER;
+			}
+		}
+	}
+	while (count > 0);
+
+	for (t = 0; t < group->table_count; t++)
+	{
+		sim_table *table = &tables[t];
+
+		if (table->phase == TABLE_DEALER)
+		{
+			play_dealer_hand(&table->play_deck, &table->used_deck, &table->player, &table->dealer, table->counts, &table->r);
+		}
+
+		natural = (table->player.total_cards == 2 && table->player.hand_value == 21);
+
+		if (results != NULL)
+		{
+			row[RESULT_TABLE] = group->first_table + t;
+			row[RESULT_ROUND] = round;
+			row[RESULT_SHOE_POSITION] = table->shoe_position;
+			row[RESULT_RUNNING_COUNT] = table->running_count;
+			row[RESULT_BET] = bet;
+			row[RESULT_PLAYER_CARD_1] = get_card_value(table->player.hand[0]);
+			row[RESULT_PLAYER_CARD_2] = get_card_value(table->player.hand[1]);
+			row[RESULT_DEALER_UP_CARD] = get_card_value(table->dealer.hand[1]);
+			row[RESULT_DEALER_HOLE_CARD] = get_card_value(table->dealer.hand[0]);
+			row[RESULT_PLAYER_TOTAL] = table->player.hand_value;
+			row[RESULT_DEALER_TOTAL] = table->dealer.hand_value;
+			row[RESULT_PLAYER_CARDS] = table->player.total_cards;
+			row[RESULT_NATURAL] = natural;
+		}
+
+		table->result = settle_headless_round(&table->used_deck, &table->player, &table->dealer);
+		outcome = get_round_outcome(table->result, natural);
+		table->outcomes[outcome]++;
+		// Results are whole half bets: -1, 0, 0.5 or 1.
+		table->net += (long long)(table->result * 2.0);
+
+		if (results != NULL)
+		{
+			row[RESULT_OUTCOME] = outcome;
+			row[RESULT_PAYOUT] = (long long)(bet * (1.0 + table->result));
+			add_result_row(results, row);
+		}
+
+		add_welford(&group->results, table->result);
+	}
+}
+
+// Plays the next stretch of rounds at one group of tables.
+void simulation_task(void *argument, int task, int worker)
+{
+	simulation_context *context = argument;
+	int round;
+
+	(void)worker;
+
+	for (round = 0; round < context->rounds; round++)
+	{
+		play_group_round(&context->groups[task], context->player_strategy, round, 0, NULL);
+	}
+}
+
+// A checkpoint holds everything a simulation needs to carry on exactly where it was: each table's generator, shoe,
+// used cards and totals, and each group's running statistics. Hands are always empty between rounds, so they aren't
+// kept, and the rank counts are worked out again from the shoe. Numbers are little-endian, doubles are stored as
+// their bits so a resumed run gives exactly the same answer.
+//
+//	Header:  "BJCK", version (u32), then the run's options (CHECKPOINT_OPTIONS_SIZE bytes, see
+//	         pack_checkpoint_options()), rounds played (u64), round of the next precision check (u64).
+//	Group:   hands (u64), mean (f64), sum of squared differences (f64), batches (u64), decisions (u64).
+//	Table:   generator state (4 x u32), net result in half bets (i64), outcomes (4 x u64),
+//	         cards in the shoe (u32), used cards (u32), then every card of the shoe and the used cards (u16 each).
+#define CHECKPOINT_MAGIC "BJCK"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_OPTIONS_SIZE (4 * 4 + 8 * 5 + SUMMARY_NAME_LENGTH)
+#define CHECKPOINT_HEADER_SIZE (8 + CHECKPOINT_OPTIONS_SIZE + 16)
+#define CHECKPOINT_GROUP_SIZE 40
+#define CHECKPOINT_TABLE_SIZE (16 + 8 + 32 + 8)
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+
+typedef struct checkpoint_file
+{
+	const char *path;
+	double interval;
+	double last_saved;
+	unsigned char options[CHECKPOINT_OPTIONS_SIZE];
+	sim_table *tables;
+	int table_count;
+	sim_group *groups;
+	int group_count;
+	int total_cards;
+	int saved;
+	// The longest the simulation stopped for while a checkpoint was taken.
+	double longest_pause;
+	#ifndef _WIN32
+	pid_t writer;
+	#endif
+} checkpoint_file;
+
+void put_f64(unsigned char *buffer, double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	put_u64(buffer, bits);
+}
+
+double get_f64(const unsigned char *buffer)
+{
+	uint64_t bits = get_u64(buffer);
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+// Packs every option that changes what a run plays, so a checkpoint is only resumed by the same run.
+void pack_checkpoint_options(unsigned char *buffer, int num_decks, int table_count, int group_count, int rounds, uint64_t seed, long long first_table, double precision, double confidence, const char *strategy_name)
+{
+	memset(buffer, 0, CHECKPOINT_OPTIONS_SIZE);
+	put_u32(buffer, (uint32_t)num_decks);
+	put_u32(buffer + 4, (uint32_t)table_count);
+	put_u32(buffer + 8, (uint32_t)group_count);
+	put_u32(buffer + 12, (uint32_t)rounds);
+	put_u64(buffer + 16, seed);
+	put_u64(buffer + 24, (uint64_t)first_table);
+	put_f64(buffer + 32, precision);
+	put_f64(buffer + 40, confidence);
+	snprintf((char *)buffer + 56, SUMMARY_NAME_LENGTH, "%s", strategy_name);
+}
+
+size_t get_checkpoint_size(checkpoint_file *checkpoint)
+{
+	return CHECKPOINT_HEADER_SIZE + (size_t)checkpoint->group_count * CHECKPOINT_GROUP_SIZE + (size_t)checkpoint->table_count * (CHECKPOINT_TABLE_SIZE + (size_t)checkpoint->total_cards * 2);
+}
+
+// Writes the simulation's state to the checkpoint. Written to a temporary name first, so a run killed halfway
+// through always leaves the last complete checkpoint behind.
+int write_checkpoint(checkpoint_file *checkpoint, long long rounds_played, long long next_check)
+{
+	size_t size = get_checkpoint_size(checkpoint), offset;
+	unsigned char *buffer = malloc(size);
+	char temporary_path[512];
+	FILE *file;
+	int g, t, i, written;
+
+	if (buffer == NULL)
+	{
+		return 0;
+	}
+
+	memcpy(buffer, CHECKPOINT_MAGIC, 4);
+	put_u32(buffer + 4, CHECKPOINT_VERSION);
+	memcpy(buffer + 8, checkpoint->options, CHECKPOINT_OPTIONS_SIZE);
+	put_u64(buffer + 8 + CHECKPOINT_OPTIONS_SIZE, (uint64_t)rounds_played);
+	put_u64(buffer + 16 + CHECKPOINT_OPTIONS_SIZE, (uint64_t)next_check);
+	offset = CHECKPOINT_HEADER_SIZE;
+
+	for (g = 0; g < checkpoint->group_count; g++, offset += CHECKPOINT_GROUP_SIZE)
+	{
+		sim_group *group = &checkpoint->groups[g];
+
+		put_u64(buffer + offset, (uint64_t)group->results.count);
+		put_f64(buffer + offset + 8, group->results.mean);
+		put_f64(buffer + offset + 16, group->results.m2);
+		put_u64(buffer + offset + 24, (uint64_t)group->batches);
+		put_u64(buffer + offset + 32, (uint64_t)group->decisions_made);
+	}
+
+	for (t = 0; t < checkpoint->table_count; t++)
+	{
+		sim_table *table = &checkpoint->tables[t];
+
+		for (i = 0; i < 4; i++)
+		{
+			put_u32(buffer + offset + i * 4, table->r.state[i]);
+		}
+
+		put_u64(buffer + offset + 16, (uint64_t)table->net);
+
+		for (i = 0; i <= OUTCOME_BLACKJACK; i++)
+		{
+			put_u64(buffer + offset + 24 + i * 8, (uint64_t)table->outcomes[i]);
+		}
+
+		put_u32(buffer + offset + 56, (uint32_t)table->play_deck.total_cards);
+		put_u32(buffer + offset + 60, (uint32_t)table->used_deck.total_cards);
+		offset += CHECKPOINT_TABLE_SIZE;
+
+		for (i = 0; i < table->play_deck.total_cards; i++, offset += 2)
+		{
+			buffer[offset] = (unsigned char)table->play_deck.deck[i];
+			buffer[offset + 1] = (unsigned char)(table->play_deck.deck[i] >> 8);
+		}
+
+		for (i = 0; i < table->used_deck.total_cards; i++, offset += 2)
+		{
+			buffer[offset] = (unsigned char)table->used_deck.deck[i];
+			buffer[offset + 1] = (unsigned char)(table->used_deck.deck[i] >> 8);
+		}
+	}
+
+	// Between rounds every card is in the shoe or the used cards, so the size always comes out the same.
+	snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", checkpoint->path);
+	file = fopen(temporary_path, "wb");
+	written = (file != NULL) && (fwrite(buffer, 1, offset, file) == offset);
+	written = (file != NULL) && (fclose(file) == 0) && written;
+	written = written && (rename(temporary_path, checkpoint->path) == 0);
+
+	free(buffer);
+
+	return written;
+}
+
+// Takes a checkpoint if one is due. The simulation only stops for as long as fork() takes: the child process
+// writes the checkpoint from its copy-on-write view of memory while the simulation carries on. Only called
+// between rounds while no other thread is playing.
+void save_checkpoint_if_due(checkpoint_file *checkpoint, long long rounds_played, long long next_check)
+{
+	double now = get_seconds(), pause;
+	#ifndef _WIN32
+	pid_t child;
+	#endif
+
+	if (checkpoint->path == NULL || now - checkpoint->last_saved < checkpoint->interval)
+	{
+		return;
+	}
+
+	#ifdef _WIN32
+	write_checkpoint(checkpoint, rounds_played, next_check);
+	pause = get_seconds() - now;
+	#else
+	// Skips this one if the last checkpoint is still being written.
+	if (checkpoint->writer > 0)
+	{
+		if (waitpid(checkpoint->writer, NULL, WNOHANG) == 0)
+		{
+			return;
+		}
+
+		checkpoint->writer = 0;
+	}
+
+	fflush(stdout);
+	child = fork();
+
+	if (child == 0)
+	{
+		_exit(write_checkpoint(checkpoint, rounds_played, next_check) ? 0 : 1);
+	}
+
+	pause = get_seconds() - now;
+
+	// Without a child process it is written here instead.
+	if (child < 0)
+	{
+		write_checkpoint(checkpoint, rounds_played, next_check);
+		pause = get_seconds() - now;
+	}
+	else
+	{
+		checkpoint->writer = child;
+	}
+	#endif
+
+	checkpoint->longest_pause = (pause > checkpoint->longest_pause) ? pause : checkpoint->longest_pause;
+	checkpoint->last_saved = get_seconds();
+	(checkpoint->saved)++;
+}
+
+// Waits for a checkpoint still being written.
+void finish_checkpoints(checkpoint_file *checkpoint)
+{
+	#ifndef _WIN32
+	if (checkpoint->writer > 0)
+	{
+		waitpid(checkpoint->writer, NULL, 0);
+		checkpoint->writer = 0;
+	}
+	#else
+	(void)checkpoint;
+	#endif
+}
+
+// Loads a checkpoint into the tables and groups. Returns 0 if there isn't one, -1 if it can't be used.
+int read_checkpoint(checkpoint_file *checkpoint, long long *rounds_played, long long *next_check)
+{
+	size_t size = get_checkpoint_size(checkpoint), offset, read;
+	unsigned char *buffer;
+	FILE *file = fopen(checkpoint->path, "rb");
+	int g, t, i;
+
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	buffer = malloc(size);
+	if (buffer == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'buffer' - 01.\n");
+		fclose(file);
+		return -1;
+	}
+
+	read = fread(buffer, 1, size, file);
+	fclose(file);
+
+	if (read != size || memcmp(buffer, CHECKPOINT_MAGIC, 4) != 0 || get_u32(buffer + 4) != CHECKPOINT_VERSION)
+	{
+		printf("ERROR: '%s' is not a checkpoint of this simulation.\n", checkpoint->path);
+		free(buffer);
+		return -1;
+	}
+
+	if (memcmp(buffer + 8, checkpoint->options, CHECKPOINT_OPTIONS_SIZE) != 0)
+	{
+		printf("ERROR: '%s' was saved by a simulation with different options. Resume it with the same command line.\n", checkpoint->path);
+		free(buffer);
+		return -1;
+	}
+
+	*rounds_played = (long long)get_u64(buffer + 8 + CHECKPOINT_OPTIONS_SIZE);
+	*next_check = (long long)get_u64(buffer + 16 + CHECKPOINT_OPTIONS_SIZE);
+	offset = CHECKPOINT_HEADER_SIZE;
+
+	for (g = 0; g < checkpoint->group_count; g++, offset += CHECKPOINT_GROUP_SIZE)
+	{
+		sim_group *group = &checkpoint->groups[g];
+
+		group->results.count = (long long)get_u64(buffer + offset);
+		group->results.mean = get_f64(buffer + offset + 8);
+		group->results.m2 = get_f64(buffer + offset + 16);
+		group->batches = (long long)get_u64(buffer + offset + 24);
+		group->decisions_made = (long long)get_u64(buffer + offset + 32);
+	}
+
+	for (t = 0; t < checkpoint->table_count; t++)
+	{
+		sim_table *table = &checkpoint->tables[t];
+
+		for (i = 0; i < 4; i++)
+		{
+			table->r.state[i] = get_u32(buffer + offset + i * 4);
+		}
+
+		table->net = (long long)get_u64(buffer + offset + 16);
+
+		for (i = 0; i <= OUTCOME_BLACKJACK; i++)
+		{
+			table->outcomes[i] = (long long)get_u64(buffer + offset + 24 + i * 8);
+		}
+
+		table->play_deck.total_cards = (int)get_u32(buffer + offset + 56);
+		table->used_deck.total_cards = (int)get_u32(buffer + offset + 60);
+		offset += CHECKPOINT_TABLE_SIZE;
+
+		if (table->play_deck.total_cards + table->used_deck.total_cards != checkpoint->total_cards)
+		{
+			printf("ERROR: '%s' is damaged.\n", checkpoint->path);
+			free(buffer);
+			return -1;
+		}
+
+		// The rest of both arrays is zero, just like after a run that was never stopped.
+		memset(table->play_deck.deck, 0, sizeof(int) * checkpoint->total_cards);
+		memset(table->used_deck.deck, 0, sizeof(int) * checkpoint->total_cards);
+
+		for (i = 0; i < table->play_deck.total_cards; i++, offset += 2)
+		{
+			table->play_deck.deck[i] = buffer[offset] | (buffer[offset + 1] << 8);
+		}
+
+		for (i = 0; i < table->used_deck.total_cards; i++, offset += 2)
+		{
+			table->used_deck.deck[i] = buffer[offset] | (buffer[offset + 1] << 8);
+		}
+
+		count_shoe(&table->play_deck, table->counts);
+	}
+
+	free(buffer);
+
+	return 1;
+}
+
+// Plays every table in lockstep, for a fixed number of rounds or until the expected return is known well enough.
+// With --precision, the tables are split into groups played on a thread pool. After each stretch of rounds the groups'
+// results are merged in table order, so the answer only depends on the seed, and the run stops as soon as the
+// confidence interval is narrow enough. Each stretch aims for half of the hands the current spread says are still needed.
+// With --results, every round is also written to a results file. With --summary, the run's totals are written to a
+// summary that can be merged with the other shards of the same run.
+// With --checkpoint, the run's state is saved every --checkpoint-every seconds. Running the same command with --resume
+// carries on from the checkpoint and ends with exactly the same answer as a run that was never stopped.
+// Usage: blackjack --simulate [--strategy file] [--tables n] [--rounds n] [--decks n] [--seed n] [--results file] [--bet n]
+//                             [--precision percent] [--confidence percent] [--threads n] [--shard n] [--summary file]
+//                             [--checkpoint file] [--checkpoint-every seconds] [--resume]
+int run_simulation(int argc, char *argv[])
+{
+	int i, t, g, num_decks, table_count, group_count, rounds, max_rounds, total_cards, bet, thread_count, resume = 0;
+	long long batches = 0, decisions_made = 0, needed, next_rounds, shard, first_table, round = 0, next_check;
+	double precision, confidence, z = 0.0, error, seconds, start;
+	char *path = NULL, *results_path = NULL, *summary_path = NULL;
+	simulation_summary summary;
+	checkpoint_file checkpoint;
+	results_file *results = NULL;
+	uint64_t seed;
+	sim_table *tables;
+	sim_group *groups;
+	simulation_context context;
+	welford total;
+	strategy player_strategy;
+
+	memset(&checkpoint, 0, sizeof(checkpoint));
+
+	for (i = 2; i < argc; i++)
+	{
+		resume |= (strcmp(argv[i], "--resume") == 0);
+
+		if (i == (argc - 1))
+		{
+			break;
+		}
+
+		if (strcmp(argv[i], "--strategy") == 0)
+		{
+			path = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--results") == 0)
+		{
+			results_path = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--summary") == 0)
+		{
+			summary_path = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--checkpoint") == 0)
+		{
+			checkpoint.path = argv[i + 1];
+		}
+	}
+
+	num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	table_count = (int)get_option(argc, argv, "--tables", DEFAULT_SIMULATION_TABLES);
+	shard = get_option(argc, argv, "--shard", 0);
+	seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	bet = (int)get_option(argc, argv, "--bet", MIN_BET);
+	precision = get_decimal_option(argc, argv, "--precision", 0.0);
+	confidence = get_decimal_option(argc, argv, "--confidence", DEFAULT_CONFIDENCE);
+	thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	checkpoint.interval = get_decimal_option(argc, argv, "--checkpoint-every", DEFAULT_CHECKPOINT_INTERVAL);
+
+	// A precision target has no round limit unless one is given.
+	rounds = (int)get_option(argc, argv, "--rounds", (precision > 0.0) ? UNLIMITED_ROUNDS : DEFAULT_TABLE_ROUNDS);
+
+	if (num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT || table_count < 1 || rounds < 1 || bet < 1 || precision < 0.0 || confidence <= 0.0 || confidence >= 100.0 || thread_count < 1 || shard < 0 || checkpoint.interval < 0.0 || (resume && checkpoint.path == NULL))
+	{
+		printf("Usage: blackjack --simulate [--strategy file] [--tables n] [--rounds n] [--decks %d-%d] [--seed n] [--results file] [--bet n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		printf("                            [--precision percent] [--confidence percent] [--threads n] [--shard n] [--summary file]\n");
+		printf("                            [--checkpoint file] [--checkpoint-every seconds] [--resume]\n");
+		return 1;
+	}
+
+	// A results file can't be taken back to where a checkpoint was saved.
+	if (checkpoint.path != NULL && results_path != NULL)
+	{
+		printf("ERROR: --results can't be used with --checkpoint.\n");
+		return 1;
+	}
+
+	if (precision > 0.0 && (results_path != NULL || summary_path != NULL))
+	{
+		printf("ERROR: --results and --summary need a fixed number of rounds and can't be used with --precision.\n");
+		return 1;
+	}
+
+	// Each shard plays its own range of tables, and every table is seeded from its number.
+	first_table = shard * table_count;
+
+	if (!load_strategy(&player_strategy, path))
+	{
+		return 1;
+	}
+
+	if (results_path != NULL && (results = open_results_file(results_path)) == NULL)
+	{
+		unload_strategy(&player_strategy);
+		return 1;
+	}
+
+	// Without a precision target every table is in one group, so each pass sends every waiting table in one call.
+	group_count = (precision > 0.0) ? (table_count + SIMULATION_GROUP_TABLES - 1) / SIMULATION_GROUP_TABLES : 1;
+	total_cards = num_decks * CARDS_IN_A_DECK;
+	tables = malloc(sizeof(sim_table) * table_count);
+	groups = malloc(sizeof(sim_group) * group_count);
+
+	if (tables == NULL || groups == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'tables' - 01.\n");
+		return 1;
+	}
+
+	// Every table gets its own shoe, shuffled the same way the game does it.
+	for (t = 0; t < table_count; t++)
+	{
+		tables[t].play_deck.deck = malloc(sizeof(int) * total_cards);
+		tables[t].used_deck.deck = malloc(sizeof(int) * total_cards);
+
+		if (tables[t].play_deck.deck == NULL || tables[t].used_deck.deck == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'tables' - 02.\n");
+			return 1;
+		}
+
+		tables[t].play_deck.total_cards = total_cards;
+		tables[t].used_deck.total_cards = 0;
+		tables[t].player.total_cards = 0;
+		tables[t].dealer.total_cards = 0;
+		tables[t].net = 0;
+		memset(tables[t].outcomes, 0, sizeof(tables[t].outcomes));
+
+		seed_rng(&tables[t].r, seed + (uint64_t)(first_table + t));
+		create_decks(&tables[t].play_deck, &tables[t].used_deck, total_cards);
+		shuffle_deck_rng(&tables[t].play_deck, total_cards, total_cards, &tables[t].r);
+		count_shoe(&tables[t].play_deck, tables[t].counts);
+	}
+
+	for (g = 0; g < group_count; g++)
+	{
+		groups[g].first_table = (int)(((long long)table_count * g) / group_count);
+		groups[g].table_count = (int)(((long long)table_count * (g + 1)) / group_count) - groups[g].first_table;
+		groups[g].tables = &tables[groups[g].first_table];
+		groups[g].requests = malloc(sizeof(strategy_request) * groups[g].table_count);
+		groups[g].waiting = malloc(sizeof(int) * groups[g].table_count);
+		groups[g].decisions = malloc(sizeof(int) * groups[g].table_count);
+		groups[g].batches = 0;
+		groups[g].decisions_made = 0;
+		memset(&groups[g].results, 0, sizeof(welford));
+
+		if (groups[g].requests == NULL || groups[g].waiting == NULL || groups[g].decisions == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'groups' - 01.\n");
+			return 1;
+		}
+	}
+
+	// The first precision check comes once MIN_SEQUENTIAL_HANDS have been played, or at --rounds if that is sooner.
+	next_check = (precision > 0.0) ? (MIN_SEQUENTIAL_HANDS + table_count - 1) / table_count : rounds;
+	next_check = (next_check > rounds) ? rounds : next_check;
+
+	if (checkpoint.path != NULL)
+	{
+		pack_checkpoint_options(checkpoint.options, num_decks, table_count, group_count, rounds, seed, first_table, precision, confidence, player_strategy.name);
+		checkpoint.tables = tables;
+		checkpoint.table_count = table_count;
+		checkpoint.groups = groups;
+		checkpoint.group_count = group_count;
+		checkpoint.total_cards = total_cards;
+		checkpoint.last_saved = get_seconds();
+
+		if (resume)
+		{
+			i = read_checkpoint(&checkpoint, &round, &next_check);
+
+			if (i < 0)
+			{
+				return 1;
+			}
+
+			printf((i > 0) ? "Resuming from '%s' after %lld rounds.\n" : "No checkpoint in '%s' yet, starting from the beginning.\n", checkpoint.path, round);
+		}
+	}
+
+	memset(&total, 0, sizeof(welford));
+	start = get_seconds();
+
+	if (precision > 0.0)
+	{
+		z = get_confidence_z(confidence);
+		context.groups = groups;
+		context.player_strategy = &player_strategy;
+		max_rounds = rounds;
+
+		printf("Playing until the expected return is known to +/- %g%% at %g%% confidence. (%.3f standard errors)\n", precision, confidence, z);
+
+		while (round < next_check)
+		{
+			// Played in slices so long stretches can still be checkpointed. Each table plays the same rounds either way.
+			context.rounds = (int)((next_check - round < SIMULATION_SLICE_ROUNDS) ? next_check - round : SIMULATION_SLICE_ROUNDS);
+			run_work_pool(group_count, thread_count, simulation_task, &context);
+			round += context.rounds;
+
+			if (round < next_check)
+			{
+				save_checkpoint_if_due(&checkpoint, round, next_check);
+				continue;
+			}
+
+			memset(&total, 0, sizeof(welford));
+
+			for (g = 0; g < group_count; g++)
+			{
+				merge_welford(&total, &groups[g].results);
+			}
+
+			error = z * get_welford_error(&total);
+			printf("%13lld hands: %+.4f%% +/- %.4f%%\n", total.count, total.mean * 100.0, error * 100.0);
+
+			if (error * 100.0 <= precision)
+			{
+				break;
+			}
+
+			// Projects how many hands the interval needs from its width so far, then plays half of the rest.
+			needed = (long long)(total.count * (error * 100.0 / precision) * (error * 100.0 / precision)) - total.count;
+			next_rounds = (needed / 2 + table_count - 1) / table_count;
+			next_rounds = (next_rounds < 1) ? 1 : next_rounds;
+			next_check = round + ((next_rounds > max_rounds - round) ? max_rounds - round : next_rounds);
+			save_checkpoint_if_due(&checkpoint, round, next_check);
+		}
+
+		rounds = (int)round;
+		printf("\n");
+	}
+	else
+	{
+		while (round < rounds)
+		{
+			play_group_round(&groups[0], &player_strategy, (int)round, bet, results);
+			round++;
+			save_checkpoint_if_due(&checkpoint, round, next_check);
+		}
+
+		total = groups[0].results;
+	}
+
+	finish_checkpoints(&checkpoint);
+
+	seconds = get_seconds() - start;
+
+	for (g = 0; g < group_count; g++)
+	{
+		batches += groups[g].batches;
+		decisions_made += groups[g].decisions_made;
+	}
+
+	printf("Strategy: %s\n", player_strategy.name);
+	printf("Tables: %d, rounds per table: %d, decks: %d, seed: %llu\n", table_count, rounds, num_decks, (unsigned long long)seed);
+
+	if (shard > 0 || summary_path != NULL)
+	{
+		printf("Shard %lld: tables %lld to %lld\n", shard, first_table, first_table + table_count - 1);
+	}
+
+	printf("\n");
+	printf("Player's expected return: %+.4f%% +/- %.4f%% per hand.\n", total.mean * 100.0, get_welford_error(&total) * 100.0);
+
+	if (precision > 0.0)
+	{
+		printf("%g%% confidence interval: %+.4f%% to %+.4f%%.%s\n", confidence, (total.mean - z * get_welford_error(&total)) * 100.0, (total.mean + z * get_welford_error(&total)) * 100.0, (z * get_welford_error(&total) * 100.0 <= precision) ? "" : " (Stopped at --rounds before reaching the target)");
+	}
+
+	printf("%lld hands, %lld decisions in %lld batches (%.1f per call).\n", total.count, decisions_made, batches, (batches > 0) ? (double)decisions_made / batches : 0.0);
+	printf("%.2f seconds, %.0f hands per second.\n", seconds, (seconds > 0.0) ? total.count / seconds : 0.0);
+
+	if (results != NULL)
+	{
+		if (close_results_file(results))
+		{
+			printf("Wrote every round to '%s'. Read it with: blackjack --read-results %s\n", results_path, results_path);
+		}
+		else
+		{
+			printf("ERROR: Failed to write the results file '%s'. What was written is incomplete. (Is the disk full?)\n", results_path);
+		}
+	}
+
+	if (checkpoint.path != NULL)
+	{
+		printf("Saved %d checkpoint%s to '%s'. The simulation stopped for at most %.0f microseconds for each.\n", checkpoint.saved, (checkpoint.saved == 1) ? "" : "s", checkpoint.path, checkpoint.longest_pause * 1e6);
+
+		// The run is over, so there is nothing left to resume.
+		remove(checkpoint.path);
+	}
+
+	if (summary_path != NULL)
+	{
+		start_simulation_summary(&summary, num_decks, (uint64_t)rounds, seed, (uint64_t)first_table, player_strategy.name);
+
+		for (t = 0; t < table_count; t++)
+		{
+			add_table_to_summary(&summary, tables[t].outcomes, tables[t].net);
+		}
+
+		if (write_simulation_summary(summary_path, &summary))
+		{
+			printf("Wrote the summary to '%s'. Merge the shards with: blackjack --merge-summaries file ...\n", summary_path);
+		}
+	}
+
+	for (t = 0; t < table_count; t++)
+	{
+		free(tables[t].used_deck.deck);
+		free(tables[t].play_deck.deck);
+	}
+
+	for (g = 0; g < group_count; g++)
+	{
+		free(groups[g].decisions);
+		free(groups[g].waiting);
+		free(groups[g].requests);
+	}
+
+	free(groups);
+	free(tables);
+	unload_strategy(&player_strategy);
+
+	return 0;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+---------------------- START OF GAME SERVER AND LOAD TESTER --------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Protocol: one command per line, one reply line per command.
+//   B <amount>  Bet and deal a round.   H  Hit.   S  Stand.
+// Replies:
+//   P <hand value> <dealer up card value>  The player's turn.
+//   R <net won> <money>                    The round is over. Money is topped back up if it falls below the minimum bet.
+//   E <message>                            The command was not allowed.
+
+#define SERVER_STARTING_MONEY 1000
+#define CONNECTION_BUFFER_SIZE 256
+// Replies waiting to be sent. A client stops being read from until there's room for another reply.
+#define CONNECTION_OUTPUT_SIZE 4096
+#define DEFAULT_LOAD_CLIENTS 1000
+#define DEFAULT_LOAD_SECONDS 5
+#define DEFAULT_THINK_TIME 10
+
+#ifndef _WIN32
+// Independent table state for every connection.
+typedef struct connection
+{
+	int fd;
+	int money;
+	int bet;
+	int in_round;
+	int input_length;
+	int output_length;
+	char input[CONNECTION_BUFFER_SIZE];
+	char output[CONNECTION_OUTPUT_SIZE];
+	deck play_deck;
+	deck used_deck;
+	hand player;
+	hand dealer;
+	rng r;
+} connection;
+
+typedef struct load_client
+{
+	int fd;
+	int waiting;
+	int length;
+	char buffer[CONNECTION_BUFFER_SIZE];
+	char next_command[16];
+	double sent_at;
+	double wake_at;
+} load_client;
+
+// Allows as many open connections as the system will give this process.
+void raise_file_limit(void)
+{
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+// Pays out a finished round the same way blackjack() does and writes the reply.
+void settle_connection(connection *c, double result, char *reply, size_t size)
+{
+	int payout = (int)(c->bet * (1.0 + result));
+
+	c->money += payout;
+	c->in_round = 0;
+	snprintf(reply, size, "R %+d %d\n", payout - c->bet, c->money);
+
+	if (c->money < MIN_BET)
+	{
+		c->money = SERVER_STARTING_MONEY;
+	}
+}
+
+void finish_connection_round(connection *c, char *reply, size_t size)
+{
+	settle_connection(c, finish_headless_round(&c->play_deck, &c->used_deck, &c->player, &c->dealer, NULL, &c->r), reply, size);
+}
+
+// Runs one command from a client against its table and fills in the reply.
+void handle_command(connection *c, char *line, char *reply, size_t size)
+{
+	int bet;
+	char command = (char)toupper(line[0]);
+
+	if (command == 'B')
+	{
+		bet = atoi(line + 1);
+
+		if (c->in_round)
+		{
+			snprintf(reply, size, "E Round in progress\n");
+		}
+		else if (bet < MIN_BET || bet > c->money)
+		{
+			snprintf(reply, size, "E Bet must be between %d and %d\n", MIN_BET, c->money);
+		}
+		else
+		{
+			c->bet = bet;
+			c->money -= bet;
+			c->in_round = 1;
+
+			if (!deal_headless_round(&c->play_deck, &c->used_deck, &c->player, &c->dealer, NULL, &c->r))
+			{
+				settle_connection(c, settle_headless_round(&c->used_deck, &c->player, &c->dealer), reply, size);
+			}
+			else if (c->player.hand_value >= 21)
+			{
+				finish_connection_round(c, reply, size);
+			}
+			else
+			{
+				snprintf(reply, size, "P %d %d\n", c->player.hand_value, get_card_value(c->dealer.hand[1]));
+			}
+		}
+	}
+	else if ((command == 'H' || command == 'S') && !c->in_round)
+	{
+		snprintf(reply, size, "E No round in progress\n");
+	}
+	else if (command == 'H')
+	{
+		draw_card(&c->play_deck, &c->used_deck, &c->player, NULL, &c->r);
+		get_hand_value(&c->player);
+
+		if (c->player.hand_value >= 21)
+		{
+			finish_connection_round(c, reply, size);
+		}
+		else
+		{
+			snprintf(reply, size, "P %d %d\n", c->player.hand_value, get_card_value(c->dealer.hand[1]));
+		}
+	}
+	else if (command == 'S')
+	{
+		finish_connection_round(c, reply, size);
+	}
+	else
+	{
+		snprintf(reply, size, "E Unknown command\n");
+	}
+}
+
+connection *open_connection(int fd, int num_decks, uint64_t seed)
+{
+	int total_cards = num_decks * CARDS_IN_A_DECK;
+	connection *c = malloc(sizeof(connection));
+
+	if (c == NULL)
+	{
+		return NULL;
+	}
+
+	c->play_deck.deck = malloc(sizeof(int) * total_cards);
+	c->used_deck.deck = malloc(sizeof(int) * total_cards);
+
+	if (c->play_deck.deck == NULL || c->used_deck.deck == NULL)
+	{
+		free(c->play_deck.deck);
+		free(c->used_deck.deck);
+		free(c);
+		return NULL;
+	}
+
+	c->fd = fd;
+	c->money = SERVER_STARTING_MONEY;
+	c->in_round = 0;
+	c->input_length = 0;
+	c->output_length = 0;
+	c->play_deck.total_cards = total_cards;
+	c->used_deck.total_cards = 0;
+	c->player.total_cards = 0;
+	c->dealer.total_cards = 0;
+
+	seed_rng(&c->r, seed);
+	create_decks(&c->play_deck, &c->used_deck, total_cards);
+	shuffle_deck_rng(&c->play_deck, total_cards, total_cards, &c->r);
+
+	return c;
+}
+
+void close_connection(connection *c)
+{
+	close(c->fd);
+	free(c->used_deck.deck);
+	free(c->play_deck.deck);
+	free(c);
+}
+
+// Sends as much of a connection's waiting output as the socket will take without blocking.
+// Returns 0 if the client is gone.
+int flush_connection(connection *c)
+{
+	ssize_t length;
+
+	while (c->output_length > 0)
+	{
+		length = write(c->fd, c->output, c->output_length);
+
+		if (length < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+		}
+
+		memmove(c->output, c->output + length, c->output_length - length);
+		c->output_length -= (int)length;
+	}
+
+	return 1;
+}
+
+// Runs every complete command a connection has sent, as long as its output has room for the replies.
+void run_connection_commands(connection *c)
+{
+	int j;
+	char *line_end;
+
+	while (c->output_length + CONNECTION_BUFFER_SIZE <= CONNECTION_OUTPUT_SIZE && (line_end = strchr(c->input, '\n')) != NULL)
+	{
+		*line_end = '\0';
+		handle_command(c, c->input, c->output + c->output_length, CONNECTION_OUTPUT_SIZE - c->output_length);
+		c->output_length += (int)strlen(c->output + c->output_length);
+
+		j = (int)(line_end + 1 - c->input);
+		memmove(c->input, line_end + 1, c->input_length - j + 1);
+		c->input_length -= j;
+	}
+
+	// Drops lines too long to ever be a command.
+	if (c->input_length >= CONNECTION_BUFFER_SIZE - 1 && strchr(c->input, '\n') == NULL)
+	{
+		c->input_length = 0;
+		c->input[0] = '\0';
+	}
+}
+
+// A client that sends commands without reading the replies fills its output, and is then not read from until it
+// catches up. Nothing is ever waited on, so one slow client can't hold up the others.
+short get_connection_events(connection *c)
+{
+	short events = 0;
+
+	if (c->output_length + CONNECTION_BUFFER_SIZE <= CONNECTION_OUTPUT_SIZE)
+	{
+		events |= POLLIN;
+	}
+	if (c->output_length > 0)
+	{
+		events |= POLLOUT;
+	}
+
+	return events;
+}
+
+// Serves tables to any number of connections from a single thread using poll().
+// Writes the port it is listening on to 'port_pipe' if it isn't -1. Never returns unless setup fails.
+int serve_tables(int port, int num_decks, uint64_t seed, int port_pipe)
+{
+	int listener, fd, i, count = 1, capacity = 1024, one = 1, connected;
+	ssize_t length = 1;
+	uint64_t accepted = 0;
+	struct sockaddr_in address;
+	socklen_t address_length = sizeof(address);
+	struct pollfd *fds;
+	connection **connections;
+
+	raise_file_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((unsigned short)port);
+
+	if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		printf("ERROR: Failed to listen on port %d.\n", port);
+		return 1;
+	}
+
+	getsockname(listener, (struct sockaddr *)&address, &address_length);
+	port = ntohs(address.sin_port);
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+
+	if (port_pipe >= 0)
+	{
+		if (write(port_pipe, &port, sizeof(port)) != sizeof(port))
+		{
+			return 1;
+		}
+		close(port_pipe);
+	}
+	else
+	{
+		printf("Serving tables on 127.0.0.1:%d\n", port);
+		fflush(stdout);
+	}
+
+	fds = malloc(sizeof(struct pollfd) * capacity);
+	connections = malloc(sizeof(connection *) * capacity);
+
+	if (fds == NULL || connections == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'connections' - 01.\n");
+		return 1;
+	}
+
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+
+	while (1)
+	{
+		if (poll(fds, count, -1) < 0)
+		{
+			continue;
+		}
+
+		for (i = count - 1; i >= 1; i--)
+		{
+			if (fds[i].revents == 0)
+			{
+				continue;
+			}
+
+			length = 0;
+			connected = flush_connection(connections[i]);
+
+			if (connected && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && (fds[i].events & POLLIN))
+			{
+				length = read(fds[i].fd, connections[i]->input + connections[i]->input_length, CONNECTION_BUFFER_SIZE - 1 - connections[i]->input_length);
+				connected = (length > 0) || (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+			}
+
+			if (connected && length > 0)
+			{
+				connections[i]->input_length += (int)length;
+				connections[i]->input[connections[i]->input_length] = '\0';
+			}
+
+			// Replies go out straight away if the socket takes them, and wait for POLLOUT if it doesn't.
+			if (connected)
+			{
+				run_connection_commands(connections[i]);
+				connected = flush_connection(connections[i]);
+			}
+
+			// The client hung up, so its table goes away. The last connection fills the gap.
+			if (!connected)
+			{
+				close_connection(connections[i]);
+				count--;
+				fds[i] = fds[count];
+				connections[i] = connections[count];
+				continue;
+			}
+
+			fds[i].events = get_connection_events(connections[i]);
+		}
+
+		// Accepts every waiting connection. The listener is non-blocking so this stops once there are none left.
+		while ((fds[0].revents & POLLIN) && (fd = accept(listener, NULL, NULL)) >= 0)
+		{
+			if (count == capacity)
+			{
+				capacity *= 2;
+				fds = realloc(fds, sizeof(struct pollfd) * capacity);
+				connections = realloc(connections, sizeof(connection *) * capacity);
+
+				if (fds == NULL || connections == NULL)
+				{
+					printf("ERROR: Failed to allocate memory in heap space for variable 'connections' - 02.\n");
+					return 1;
+				}
+			}
+
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+			connections[count] = open_connection(fd, num_decks, seed + accepted);
+			accepted++;
+
+			if (connections[count] == NULL)
+			{
+				close(fd);
+			}
+			else
+			{
+				fds[count].fd = fd;
+				fds[count].events = POLLIN;
+				fds[count].revents = 0;
+				count++;
+			}
+		}
+	}
+}
+
+// Reads a memory figure (in kB) for another process from /proc.
+long get_process_memory(pid_t pid, const char *field)
+{
+	char path[64], line[256];
+	long value = -1;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "/proc/%ld/status", (long)pid);
+	file = fopen(path, "r");
+
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (strncmp(line, field, strlen(field)) == 0)
+		{
+			value = strtol(line + strlen(field), NULL, 10);
+			break;
+		}
+	}
+
+	fclose(file);
+
+	return value;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Stops the load tester's server and waits for it, so it isn't left behind as a zombie.
+void stop_server(pid_t server)
+{
+	if (server > 0)
+	{
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+	}
+}
+
+// Sends a command and remembers when, so the reply's latency can be measured.
+void send_client_command(load_client *client, const char *command)
+{
+	client->sent_at = get_seconds();
+	client->waiting = 1;
+
+	if (write(client->fd, command, strlen(command)) < 0)
+	{
+		client->waiting = 0;
+	}
+}
+#endif
+
+// Serves tables to clients over TCP on the loopback interface.
+// Usage: blackjack --serve [--port n] [--decks n] [--seed n]
+int run_server(int argc, char *argv[])
+{
+	#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+
+	printf("The game server is not supported on Windows.\n");
+	return 1;
+	#else
+	int num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+
+	if (num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT)
+	{
+		printf("Usage: blackjack --serve [--port n] [--decks %d-%d] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	return serve_tables((int)get_option(argc, argv, "--port", 0), num_decks, (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL)), -1);
+	#endif
+}
+
+// Starts a server in a child process and drives it with many simulated players.
+// Usage: blackjack --load-test [--clients n] [--seconds n] [--think ms] [--decks n]
+int run_load_test(int argc, char *argv[])
+{
+	#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+
+	printf("The load tester is not supported on Windows.\n");
+	return 1;
+	#else
+	int i, port, ready, client_count = (int)get_option(argc, argv, "--clients", DEFAULT_LOAD_CLIENTS);
+	int think = (int)get_option(argc, argv, "--think", DEFAULT_THINK_TIME);
+	int num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT), pipe_fds[2], timeout, one = 1;
+	long long latency_count = 0, latency_capacity = 1 << 16, rounds = 0;
+	long rss, peak_rss;
+	double seconds = (double)get_option(argc, argv, "--seconds", DEFAULT_LOAD_SECONDS), now, start, end, next_wake, *latencies;
+	char *line_end;
+	ssize_t length;
+	pid_t server;
+	struct sockaddr_in address;
+	struct pollfd *fds;
+	load_client *clients;
+	rng r;
+
+	if (client_count < 1 || think < 0 || seconds <= 0 || num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT)
+	{
+		printf("Usage: blackjack --load-test [--clients n] [--seconds n] [--think ms] [--decks %d-%d]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	raise_file_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	if (pipe(pipe_fds) != 0)
+	{
+		printf("ERROR: Failed to create a pipe for the server.\n");
+		return 1;
+	}
+
+	server = fork();
+
+	if (server == 0)
+	{
+		close(pipe_fds[0]);
+		exit(serve_tables(0, num_decks, (uint64_t)time(NULL), pipe_fds[1]));
+	}
+
+	close(pipe_fds[1]);
+
+	if (server < 0 || read(pipe_fds[0], &port, sizeof(port)) != sizeof(port))
+	{
+		printf("ERROR: Failed to start the server.\n");
+		stop_server(server);
+		return 1;
+	}
+
+	close(pipe_fds[0]);
+
+	clients = malloc(sizeof(load_client) * client_count);
+	fds = malloc(sizeof(struct pollfd) * client_count);
+	latencies = malloc(sizeof(double) * latency_capacity);
+
+	if (clients == NULL || fds == NULL || latencies == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'clients' - 01.\n");
+		stop_server(server);
+		return 1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((unsigned short)port);
+
+	for (i = 0; i < client_count; i++)
+	{
+		clients[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (clients[i].fd < 0 || connect(clients[i].fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+		{
+			printf("ERROR: Only %d of %d clients could connect. (Try raising the open file limit)\n", i, client_count);
+			stop_server(server);
+			return 1;
+		}
+
+		setsockopt(clients[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		clients[i].waiting = 0;
+		clients[i].length = 0;
+		clients[i].wake_at = 0.0;
+		strcpy(clients[i].next_command, "B 15\n");
+		fds[i].fd = clients[i].fd;
+		fds[i].events = POLLIN;
+	}
+
+	seed_rng(&r, (uint64_t)time(NULL));
+	printf("%d clients connected to the server on port %d. Running for %.0f seconds...\n", client_count, port, seconds);
+	fflush(stdout);
+
+	start = get_seconds();
+	end = start + seconds;
+
+	while ((now = get_seconds()) < end)
+	{
+		// Sends the next command of every client whose think time is over.
+		next_wake = end;
+		for (i = 0; i < client_count; i++)
+		{
+			if (!clients[i].waiting)
+			{
+				if (clients[i].wake_at <= now)
+				{
+					send_client_command(&clients[i], clients[i].next_command);
+				}
+				else if (clients[i].wake_at < next_wake)
+				{
+					next_wake = clients[i].wake_at;
+				}
+			}
+		}
+
+		timeout = (int)((next_wake - now) * 1000.0);
+		ready = poll(fds, client_count, (timeout > 0) ? timeout : 0);
+
+		for (i = 0; ready > 0 && i < client_count; i++)
+		{
+			if (fds[i].revents == 0)
+			{
+				continue;
+			}
+
+			length = read(clients[i].fd, clients[i].buffer + clients[i].length, CONNECTION_BUFFER_SIZE - 1 - clients[i].length);
+			if (length <= 0)
+			{
+				printf("ERROR: The server closed a connection.\n");
+				stop_server(server);
+				return 1;
+			}
+
+			clients[i].length += (int)length;
+			clients[i].buffer[clients[i].length] = '\0';
+
+			if ((line_end = strchr(clients[i].buffer, '\n')) == NULL)
+			{
+				continue;
+			}
+
+			now = get_seconds();
+
+			if (latency_count == latency_capacity)
+			{
+				latency_capacity *= 2;
+				latencies = realloc(latencies, sizeof(double) * latency_capacity);
+
+				if (latencies == NULL)
+				{
+					printf("ERROR: Failed to allocate memory in heap space for variable 'latencies' - 01.\n");
+					stop_server(server);
+					return 1;
+				}
+			}
+
+			latencies[latency_count] = now - clients[i].sent_at;
+			latency_count++;
+
+			// The simulated player hits below 17 and always bets the minimum.
+			if (clients[i].buffer[0] == 'P' && atoi(clients[i].buffer + 2) < DEFAULT_STAND_VALUE)
+			{
+				strcpy(clients[i].next_command, "H\n");
+			}
+			else if (clients[i].buffer[0] == 'P')
+			{
+				strcpy(clients[i].next_command, "S\n");
+			}
+			else
+			{
+				strcpy(clients[i].next_command, "B 15\n");
+				rounds++;
+			}
+
+			clients[i].length = 0;
+			clients[i].waiting = 0;
+			// Think times are spread evenly between zero and twice the average.
+			clients[i].wake_at = now + (think > 0 ? rng_bounded(&r, (uint32_t)(think * 2000)) / 1e6 : 0.0);
+		}
+	}
+
+	rss = get_process_memory(server, "VmRSS:");
+	peak_rss = get_process_memory(server, "VmHWM:");
+
+	for (i = 0; i < client_count; i++)
+	{
+		close(clients[i].fd);
+	}
+
+	stop_server(server);
+
+	qsort(latencies, latency_count, sizeof(double), compare_doubles);
+
+	printf("\nCommands: %lld (%.0f per second), rounds: %lld (%.0f per second)\n", latency_count, latency_count / seconds, rounds, rounds / seconds);
+
+	if (latency_count > 0)
+	{
+		printf("Latency p50: %.1f us, p90: %.1f us, p99: %.1f us, p99.9: %.1f us, max: %.1f us\n",
+			latencies[(latency_count * 50) / 100] * 1e6, latencies[(latency_count * 90) / 100] * 1e6,
+			latencies[(latency_count * 99) / 100] * 1e6, latencies[(latency_count * 999) / 1000] * 1e6,
+			latencies[latency_count - 1] * 1e6);
+	}
+
+	printf("Server memory: %ld kB resident, %ld kB peak (%.1f kB per table)\n", rss, peak_rss, (double)rss / client_count);
+
+	free(latencies);
+	free(fds);
+	free(clients);
+
+	return 0;
+	#endif
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+--------------------- START OF HOUSE EDGE CALCULATOR ---------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Rank compositions (10 counts) plus two bytes of hand state.
+#define MEMO_KEY_LENGTH (RANK_COUNT + 2)
+#define MEMO_PLAYER_KEY 255
+
+typedef struct memo_entry
+{
+	unsigned char key[MEMO_KEY_LENGTH];
+	unsigned char used;
+	double value[RANK_COUNT];
+} memo_entry;
+
+// Open addressing hash table of results keyed on the remaining rank composition.
+typedef struct memo_table
+{
+	memo_entry *entries;
+	size_t capacity;
+	size_t count;
+} memo_table;
+
+typedef struct exact_context
+{
+	unsigned char counts[RANK_COUNT];
+	int total_cards;
+	// Zero plays the best hit or stand for the exact remaining shoe, otherwise the player hits below this value.
+	int stand_value;
+	int pairs[RANK_COUNT * (RANK_COUNT + 1) / 2][2];
+	double *results;
+	memo_table *memos;
+} exact_context;
+
+typedef struct monte_carlo_context
+{
+	int num_decks;
+	int stand_value;
+	int chunk_count;
+	long long rounds;
+	uint64_t seed;
+	double *sums;
+	double *squares;
+} monte_carlo_context;
+
+// Gets the value of a rank index. (Ace, 2 - 9, then every ten-valued card)
+int get_rank_value(int rank)
+{
+	return (rank == ACE_RANK) ? 11 : (rank + 1);
+}
+
+// Applies the same ace adjustment as get_hand_value(), which only ever counts one ace as 1.
+int get_adjusted_value(int total, int ace_count)
+{
+	if ((total > 21) && (ace_count > 0))
+	{
+		return total - 10;
+	}
+
+	return total;
+}
+
+int is_dealer_blackjack(int up_rank, int hole_rank)
+{
+	return ((up_rank == ACE_RANK) && (hole_rank == TEN_RANK)) || ((up_rank == TEN_RANK) && (hole_rank == ACE_RANK));
+}
+
+size_t memo_hash(const unsigned char *key)
+{
+	size_t i, hash = 14695981039346656037ULL;
+
+	for (i = 0; i < MEMO_KEY_LENGTH; i++)
+	{
+		hash = (hash ^ key[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void memo_create(memo_table *table, size_t capacity)
+{
+	table->entries = calloc(capacity, sizeof(memo_entry));
+	table->capacity = capacity;
+	table->count = 0;
+
+	if (table->entries == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'memo' - 01.\n");
+		exit(1);
+	}
+}
+
+memo_entry *memo_find(memo_table *table, const unsigned char *key)
+{
+	size_t i = memo_hash(key) & (table->capacity - 1);
+
+	while (table->entries[i].used)
+	{
+		if (memcmp(table->entries[i].key, key, MEMO_KEY_LENGTH) == 0)
+		{
+			return &table->entries[i];
+		}
+
+		i = (i + 1) & (table->capacity - 1);
+	}
+
+	return NULL;
+}
+
+void memo_insert(memo_table *table, const unsigned char *key, const double *value)
+{
+	size_t i;
+	memo_table bigger;
+
+	// Doubles the table once it is 70% full.
+	if ((table->count + 1) * 10 > table->capacity * 7)
+	{
+		memo_create(&bigger, table->capacity * 2);
+
+		for (i = 0; i < table->capacity; i++)
+		{
+			if (table->entries[i].used)
+			{
+				memo_insert(&bigger, table->entries[i].key, table->entries[i].value);
+			}
+		}
+
+		free(table->entries);
+		*table = bigger;
+	}
+
+	i = memo_hash(key) & (table->capacity - 1);
+	while (table->entries[i].used)
+	{
+		i = (i + 1) & (table->capacity - 1);
+	}
+
+	memcpy(table->entries[i].key, key, MEMO_KEY_LENGTH);
+	memcpy(table->entries[i].value, value, sizeof(double) * RANK_COUNT);
+	table->entries[i].used = 1;
+	(table->count)++;
+}
+
+// Probabilities of the dealer finishing on 17, 18, 19, 20, 21 or busting from the given hand and shoe.
+void exact_dealer_outcomes(memo_table *memo, unsigned char *counts, int cards_left, int total, int ace_count, double *outcomes)
+{
+	int i, rank, value = get_adjusted_value(total, ace_count);
+	unsigned char key[MEMO_KEY_LENGTH];
+	double p, next[DEALER_OUTCOME_COUNT], result[RANK_COUNT];
+	memo_entry *entry;
+
+	for (i = 0; i < DEALER_OUTCOME_COUNT; i++)
+	{
+		outcomes[i] = 0.0;
+	}
+
+	// Dealer holds.
+	if (value >= DEALER_HOLD_VALUE)
+	{
+		outcomes[(value > 21) ? (DEALER_OUTCOME_COUNT - 1) : (value - DEALER_HOLD_VALUE)] = 1.0;
+		return;
+	}
+
+	memcpy(key, counts, RANK_COUNT);
+	key[RANK_COUNT] = (unsigned char)total;
+	key[RANK_COUNT + 1] = (ace_count > 0);
+
+	entry = memo_find(memo, key);
+	if (entry != NULL)
+	{
+		memcpy(outcomes, entry->value, sizeof(double) * DEALER_OUTCOME_COUNT);
+		return;
+	}
+
+	// Dealer draws every possible rank, weighted by how many are left in the shoe.
+	for (rank = 0; rank < RANK_COUNT; rank++)
+	{
+		if (counts[rank] == 0)
+		{
+			continue;
+		}
+
+		p = (double)counts[rank] / cards_left;
+
+		counts[rank]--;
+		exact_dealer_outcomes(memo, counts, cards_left - 1, total + get_rank_value(rank), ace_count + (rank == ACE_RANK), next);
+		counts[rank]++;
+
+		for (i = 0; i < DEALER_OUTCOME_COUNT; i++)
+		{
+			outcomes[i] += p * next[i];
+		}
+	}
+
+	memset(result, 0, sizeof(result));
+	memcpy(result, outcomes, sizeof(double) * DEALER_OUTCOME_COUNT);
+	memo_insert(memo, key, result);
+}
+
+// Fills values[hole] with the result of standing for every dealer hole card that is not a blackjack.
+// 'counts' is everything the player has not seen, which still includes the hole card.
+void exact_stand_values(memo_table *memo, unsigned char *counts, int cards_left, int player_value, int up_rank, int player_blackjack, double *values)
+{
+	int hole, i;
+	double outcomes[DEALER_OUTCOME_COUNT];
+
+	for (hole = 0; hole < RANK_COUNT; hole++)
+	{
+		values[hole] = 0.0;
+
+		if ((counts[hole] == 0) || is_dealer_blackjack(up_rank, hole))
+		{
+			continue;
+		}
+
+		counts[hole]--;
+		exact_dealer_outcomes(memo, counts, cards_left - 1, get_rank_value(up_rank) + get_rank_value(hole), (up_rank == ACE_RANK) + (hole == ACE_RANK), outcomes);
+		counts[hole]++;
+
+		for (i = 0; i < DEALER_OUTCOME_COUNT; i++)
+		{
+			values[hole] += outcomes[i] * get_round_result(player_value, (i == (DEALER_OUTCOME_COUNT - 1)) ? 22 : (DEALER_HOLD_VALUE + i), player_blackjack);
+		}
+	}
+}
+
+// Fills values[hole] with the player's expected result from this hand for every possible dealer hole card.
+// The hit or stand choice can't depend on the hole card, so it is made on the average over all of them.
+void exact_player_values(exact_context *context, memo_table *memo, unsigned char *counts, int cards_left, int total, int ace_count, int up_rank, double *values)
+{
+	int rank, hole, hit, value = get_adjusted_value(total, ace_count);
+	unsigned char key[MEMO_KEY_LENGTH];
+	double p, stand_average = 0.0, hit_average = 0.0, stand[RANK_COUNT], hit_values[RANK_COUNT], next[RANK_COUNT];
+	memo_entry *entry;
+
+	// Player busted.
+	if (value > 21)
+	{
+		for (hole = 0; hole < RANK_COUNT; hole++)
+		{
+			values[hole] = -1.0;
+		}
+		return;
+	}
+
+	// The remaining shoe decides the player's hand, so the composition and up card are enough for a key.
+	memcpy(key, counts, RANK_COUNT);
+	key[RANK_COUNT] = MEMO_PLAYER_KEY;
+	key[RANK_COUNT + 1] = (unsigned char)up_rank;
+
+	entry = memo_find(memo, key);
+	if (entry != NULL)
+	{
+		memcpy(values, entry->value, sizeof(double) * RANK_COUNT);
+		return;
+	}
+
+	exact_stand_values(memo, counts, cards_left, value, up_rank, 0, stand);
+
+	// The game stops the player from drawing at 21.
+	hit = (value < 21) && (cards_left > 1) && ((context->stand_value == 0) || (value < context->stand_value));
+
+	if (hit)
+	{
+		memset(hit_values, 0, sizeof(hit_values));
+
+		for (rank = 0; rank < RANK_COUNT; rank++)
+		{
+			if (counts[rank] == 0)
+			{
+				continue;
+			}
+
+			counts[rank]--;
+			exact_player_values(context, memo, counts, cards_left - 1, total + get_rank_value(rank), ace_count + (rank == ACE_RANK), up_rank, next);
+			counts[rank]++;
+
+			// The drawn card can't be the hole card, so it comes from the shoe without it.
+			for (hole = 0; hole < RANK_COUNT; hole++)
+			{
+				p = (double)(counts[rank] - (rank == hole)) / (cards_left - 1);
+
+				if (p > 0.0)
+				{
+					hit_values[hole] += p * next[hole];
+				}
+			}
+		}
+
+		if (context->stand_value == 0)
+		{
+			for (hole = 0; hole < RANK_COUNT; hole++)
+			{
+				if (!is_dealer_blackjack(up_rank, hole))
+				{
+					stand_average += counts[hole] * stand[hole];
+					hit_average += counts[hole] * hit_values[hole];
+				}
+			}
+
+			hit = (hit_average > stand_average);
+		}
+	}
+
+	memcpy(values, hit ? hit_values : stand, sizeof(double) * RANK_COUNT);
+	memo_insert(memo, key, values);
+}
+
+// Only used by the EV advisor's thread. Its player entries assume one starting shoe, so it is cleared with every new one.
+memo_table advice_memo;
+
+// Works out what standing and hitting return for the player's hand in an advisor request, playing the best hit or
+// stand choices after a hit. The dealer has already checked for blackjack, so only hole cards that don't make one count.
+void exact_advice(const advice_request *request, int new_shoe, double *values)
+{
+	int rank, hole, cards_left = 0, value = get_adjusted_value(request->total, request->ace_count);
+	unsigned char counts[RANK_COUNT];
+	double p, weight = 0.0, stand[RANK_COUNT], hit[RANK_COUNT], next[RANK_COUNT];
+	exact_context context;
+
+	if (new_shoe && advice_memo.entries != NULL)
+	{
+		free(advice_memo.entries);
+		advice_memo.entries = NULL;
+	}
+
+	if (advice_memo.entries == NULL)
+	{
+		memo_create(&advice_memo, MEMO_INITIAL_CAPACITY);
+	}
+
+	memcpy(counts, request->counts, RANK_COUNT);
+
+	for (rank = 0; rank < RANK_COUNT; rank++)
+	{
+		cards_left += counts[rank];
+	}
+
+	context.stand_value = 0;
+	exact_stand_values(&advice_memo, counts, cards_left, value, request->up_rank, 0, stand);
+	memset(hit, 0, sizeof(hit));
+
+	// Same as a hit in exact_player_values(), except the player has to take this one.
+	for (rank = 0; rank < RANK_COUNT && cards_left > 1; rank++)
+	{
+		if (counts[rank] == 0)
+		{
+			continue;
+		}
+
+		counts[rank]--;
+		exact_player_values(&context, &advice_memo, counts, cards_left - 1, request->total + get_rank_value(rank), request->ace_count + (rank == ACE_RANK), request->up_rank, next);
+		counts[rank]++;
+
+		for (hole = 0; hole < RANK_COUNT; hole++)
+		{
+			p = (double)(counts[rank] - (rank == hole)) / (cards_left - 1);
+
+			if (p > 0.0)
+			{
+				hit[hole] += p * next[hole];
+			}
+		}
+	}
+
+	values[ADVICE_STAND] = 0.0;
+	values[ADVICE_HIT] = 0.0;
+
+	for (hole = 0; hole < RANK_COUNT; hole++)
+	{
+		if (!is_dealer_blackjack(request->up_rank, hole))
+		{
+			values[ADVICE_STAND] += counts[hole] * stand[hole];
+			values[ADVICE_HIT] += counts[hole] * hit[hole];
+			weight += counts[hole];
+		}
+	}
+
+	if (weight > 0.0)
+	{
+		values[ADVICE_STAND] /= weight;
+		values[ADVICE_HIT] /= weight;
+	}
+}
+
+// Expected result of one starting deal (two player cards and a dealer up card), weighted by its probability.
+void exact_deal_task(void *argument, int task, int worker)
+{
+	exact_context *context = argument;
+	memo_table *memo = &context->memos[worker];
+	int hole, first = context->pairs[task / RANK_COUNT][0], second = context->pairs[task / RANK_COUNT][1], up_rank = task % RANK_COUNT;
+	int cards_left = context->total_cards, player_blackjack;
+	unsigned char counts[RANK_COUNT];
+	double probability, result = 0.0, values[RANK_COUNT];
+
+	memcpy(counts, context->counts, RANK_COUNT);
+
+	// Probability of the deal, counting both orders of two different player cards.
+	probability = (first == second) ? 1.0 : 2.0;
+	probability *= (double)counts[first] / cards_left;
+	counts[first]--;
+	cards_left--;
+	probability *= (double)counts[second] / cards_left;
+	if (counts[second] == 0)
+	{
+		context->results[task] = 0.0;
+		return;
+	}
+	counts[second]--;
+	cards_left--;
+	probability *= (double)counts[up_rank] / cards_left;
+	if (counts[up_rank] == 0)
+	{
+		context->results[task] = 0.0;
+		return;
+	}
+	counts[up_rank]--;
+
+	player_blackjack = ((first == ACE_RANK) && (second == TEN_RANK));
+
+	if (player_blackjack)
+	{
+		exact_stand_values(memo, counts, cards_left, 21, up_rank, 1, values);
+	}
+	else
+	{
+		exact_player_values(context, memo, counts, cards_left, get_rank_value(first) + get_rank_value(second), (first == ACE_RANK) + (second == ACE_RANK), up_rank, values);
+	}
+
+	// Averages over the hole card. The dealer's blackjack is settled before the player acts.
+	for (hole = 0; hole < RANK_COUNT; hole++)
+	{
+		if (is_dealer_blackjack(up_rank, hole))
+		{
+			result += ((double)counts[hole] / cards_left) * (player_blackjack ? 0.0 : -1.0);
+		}
+		else
+		{
+			result += ((double)counts[hole] / cards_left) * values[hole];
+		}
+	}
+
+	context->results[task] = probability * result;
+}
+
+// Exact expected result of a round dealt from a fresh shoe, in units of the bet.
+double exact_expected_result(int num_decks, int stand_value, int thread_count)
+{
+	int i, j, pair_count = 0, task_count;
+	double total = 0.0;
+	exact_context context;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		context.counts[i] = (unsigned char)(num_decks * ((i == TEN_RANK) ? 16 : 4));
+
+		for (j = i; j < RANK_COUNT; j++)
+		{
+			context.pairs[pair_count][0] = i;
+			context.pairs[pair_count][1] = j;
+			pair_count++;
+		}
+	}
+
+	context.total_cards = num_decks * CARDS_IN_A_DECK;
+	context.stand_value = stand_value;
+	task_count = pair_count * RANK_COUNT;
+	context.results = malloc(sizeof(double) * task_count);
+	context.memos = malloc(sizeof(memo_table) * thread_count);
+
+	if (context.results == NULL || context.memos == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'context' - 01.\n");
+		exit(1);
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		memo_create(&context.memos[i], MEMO_INITIAL_CAPACITY);
+	}
+
+	run_work_pool(task_count, thread_count, exact_deal_task, &context);
+
+	// Adds the results up in a fixed order so the answer doesn't depend on the thread count.
+	for (i = 0; i < task_count; i++)
+	{
+		total += context.results[i];
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		free(context.memos[i].entries);
+	}
+
+	free(context.memos);
+	free(context.results);
+
+	return total;
+}
+
+// Plays a chunk of rounds with play_headless_round(), each from a freshly shuffled shoe.
+void monte_carlo_task(void *argument, int task, int worker)
+{
+	monte_carlo_context *context = argument;
+	int total_cards = context->num_decks * CARDS_IN_A_DECK;
+	long long i, rounds = (context->rounds * (task + 1)) / context->chunk_count - (context->rounds * task) / context->chunk_count;
+	double result, sum = 0.0, square = 0.0;
+	deck play_deck, used_deck;
+	hand player, dealer;
+	rng r;
+
+	(void)worker;
+
+	play_deck.deck = malloc(sizeof(int) * total_cards);
+	used_deck.deck = malloc(sizeof(int) * total_cards);
+
+	if (play_deck.deck == NULL || used_deck.deck == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'deck' - 01.\n");
+		exit(1);
+	}
+
+	seed_rng(&r, context->seed + (uint64_t)task);
+	player.total_cards = 0;
+	dealer.total_cards = 0;
+
+	for (i = 0; i < rounds; i++)
+	{
+		play_deck.total_cards = total_cards;
+		used_deck.total_cards = 0;
+		create_decks(&play_deck, &used_deck, total_cards);
+		shuffle_deck_rng(&play_deck, total_cards, MAX_HAND_COUNT * 2, &r);
+
+		result = play_headless_round(&play_deck, &used_deck, &player, &dealer, context->stand_value, &r);
+		sum += result;
+		square += result * result;
+	}
+
+	context->sums[task] = sum;
+	context->squares[task] = square;
+
+	free(used_deck.deck);
+	free(play_deck.deck);
+}
+
+// Prints the exact expected result for 1 to 8 decks, checked against a Monte Carlo run of the same rules.
+// Usage: blackjack --house-edge [--decks n] [--stand n] [--rounds n] [--threads n] [--seed n]
+int run_house_edge(int argc, char *argv[])
+{
+	int num_decks, first_deck, last_deck, i;
+	int stand_value = (int)get_option(argc, argv, "--stand", DEFAULT_STAND_VALUE);
+	int thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	double best, fixed, mean, error, sum, square;
+	monte_carlo_context simulation;
+
+	first_deck = (int)get_option(argc, argv, "--decks", MIN_DECK_COUNT);
+	last_deck = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	simulation.rounds = get_option(argc, argv, "--rounds", DEFAULT_SIMULATION_ROUNDS);
+
+	if (first_deck < MIN_DECK_COUNT || last_deck > MAX_DECK_COUNT || stand_value < 2 || stand_value > 21 || thread_count < 1 || simulation.rounds < 2)
+	{
+		printf("Usage: blackjack --house-edge [--decks %d-%d] [--stand 2-21] [--rounds n] [--threads n] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	simulation.stand_value = stand_value;
+	simulation.seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	simulation.chunk_count = (int)((simulation.rounds + SIMULATION_CHUNK_ROUNDS - 1) / SIMULATION_CHUNK_ROUNDS);
+	simulation.sums = malloc(sizeof(double) * (simulation.chunk_count + 1));
+	simulation.squares = malloc(sizeof(double) * (simulation.chunk_count + 1));
+
+	if (simulation.sums == NULL || simulation.squares == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'simulation' - 01.\n");
+		return 1;
+	}
+
+	printf("Player's expected return per round from a fresh shoe. (The house edge is the negative of this)\n");
+	printf("Dealer holds at %d, no splits or doubles. Monte Carlo uses %lld rounds, seed %llu.\n\n", DEALER_HOLD_VALUE, simulation.rounds, (unsigned long long)simulation.seed);
+	printf("Decks | Best hit/stand (exact) | Hit below %d (exact) | Hit below %d (Monte Carlo)\n", stand_value, stand_value);
+
+	for (num_decks = first_deck; num_decks <= last_deck; num_decks++)
+	{
+		best = exact_expected_result(num_decks, 0, thread_count);
+		fixed = exact_expected_result(num_decks, stand_value, thread_count);
+
+		simulation.num_decks = num_decks;
+		run_work_pool(simulation.chunk_count, thread_count, monte_carlo_task, &simulation);
+
+		for (i = 0, sum = 0.0, square = 0.0; i < simulation.chunk_count; i++)
+		{
+			sum += simulation.sums[i];
+			square += simulation.squares[i];
+		}
+
+		mean = sum / simulation.rounds;
+		error = sqrt((square / simulation.rounds - mean * mean) / simulation.rounds);
+
+		printf("%5d | %21.4f%% | %18.4f%% | %10.4f%% +/- %.4f%% (%+.1f SE)\n", num_decks, best * 100.0, fixed * 100.0, mean * 100.0, error * 100.0, (mean - fixed) / error);
+	}
+
+	free(simulation.squares);
+	free(simulation.sums);
+
+	return 0;
+}
+
+#define DEFAULT_CSM_TABLES 1000
+#define DEFAULT_CSM_ROUNDS 1000
+#define CSM_TASK_TABLES 100
+#define CSM_BET 2
+#define CSM_TIMING_DRAWS 1000000
+#define CSM_TIMING_SIZES 5
+
+typedef struct csm_context
+{
+	int decks;
+	int stand_value;
+	int table_count;
+	int rounds;
+	uint64_t seed;
+	double *sums;
+	double *squares;
+} csm_context;
+
+// Plays up to CSM_TASK_TABLES tables through the round engine, one call per table at a time, each dealing from its
+// own continuous shuffler.
+void csm_task(void *argument, int task, int worker)
+{
+	csm_context *context = argument;
+	int t, first = task * CSM_TASK_TABLES, count, active, status[CSM_TASK_TABLES], played[CSM_TASK_TABLES];
+	double result, sum = 0.0, square = 0.0;
+	blackjack_table tables[CSM_TASK_TABLES];
+	csm shufflers[CSM_TASK_TABLES];
+	hand hands[CSM_TASK_TABLES * 2];
+
+	(void)worker;
+
+	count = (context->table_count - first < CSM_TASK_TABLES) ? (context->table_count - first) : CSM_TASK_TABLES;
+
+	for (t = 0; t < count; t++)
+	{
+		hands[t * 2].total_cards = 0;
+		hands[t * 2 + 1].total_cards = 0;
+		blackjack_table_init(&tables[t], NULL, NULL, &hands[t * 2], &hands[t * 2 + 1], context->seed + (uint64_t)(first + t));
+		blackjack_csm_init(&shufflers[t], context->decks);
+		blackjack_table_use_csm(&tables[t], &shufflers[t]);
+		status[t] = BLACKJACK_NEED_BET;
+		played[t] = 0;
+	}
+
+	for (active = count; active > 0; )
+	{
+		for (t = 0; t < count; t++)
+		{
+			if (played[t] == context->rounds)
+			{
+				continue;
+			}
+
+			if (status[t] == BLACKJACK_NEED_BET)
+			{
+				status[t] = blackjack_start_round(&tables[t], CSM_BET);
+			}
+			else if (status[t] == BLACKJACK_NEED_ACTION)
+			{
+				status[t] = blackjack_apply(&tables[t], (tables[t].player[tables[t].spot].hand_value < context->stand_value) ? BLACKJACK_HIT : BLACKJACK_STAND);
+			}
+			else
+			{
+				if (status[t] == BLACKJACK_ROUND_OVER)
+				{
+					result = (tables[t].payout - CSM_BET) / (double)CSM_BET;
+					sum += result;
+					square += result * result;
+
+					if (++played[t] == context->rounds)
+					{
+						active--;
+					}
+				}
+
+				status[t] = blackjack_step(&tables[t]);
+			}
+		}
+	}
+
+	context->sums[task] = sum;
+	context->squares[task] = square;
+}
+
+// Usage: blackjack --csm-simulate [--decks n] [--tables n] [--rounds n] [--stand n] [--threads n] [--seed n]
+// Plays tables dealing from continuous shufflers through the round engine, with the player hitting below --stand.
+// Every card goes back in after each round, so each round is dealt from a full shoe and should return exactly what
+// exact_expected_result() works out. Then times a draw for shufflers of up to 65,536 decks.
+int run_csm_simulation(int argc, char *argv[])
+{
+	int i, j, task_count, sizes[CSM_TIMING_SIZES] = {1, 8, 64, 1024, 65536};
+	int thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	long long rounds;
+	double start, seconds, sum = 0.0, square = 0.0, mean, error, exact;
+	unsigned int checksum = 0;
+	csm_context context;
+	csm shuffler;
+	rng r;
+
+	context.decks = (int)get_option(argc, argv, "--decks", 6);
+	context.table_count = (int)get_option(argc, argv, "--tables", DEFAULT_CSM_TABLES);
+	context.rounds = (int)get_option(argc, argv, "--rounds", DEFAULT_CSM_ROUNDS);
+	context.stand_value = (int)get_option(argc, argv, "--stand", DEFAULT_STAND_VALUE);
+	context.seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+
+	if (context.decks < 1 || context.decks > sizes[CSM_TIMING_SIZES - 1] || context.table_count < 1 || context.rounds < 1 || context.stand_value < 2 || context.stand_value > 21 || thread_count < 1)
+	{
+		printf("Usage: blackjack --csm-simulate [--decks 1-%d] [--tables n] [--rounds n] [--stand 2-21] [--threads n] [--seed n]\n", sizes[CSM_TIMING_SIZES - 1]);
+		return 1;
+	}
+
+	task_count = (context.table_count + CSM_TASK_TABLES - 1) / CSM_TASK_TABLES;
+	context.sums = malloc(sizeof(double) * task_count);
+	context.squares = malloc(sizeof(double) * task_count);
+
+	if (context.sums == NULL || context.squares == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'context' - 01.\n");
+		return 1;
+	}
+
+	start = get_seconds();
+	run_work_pool(task_count, thread_count, csm_task, &context);
+	seconds = get_seconds() - start;
+
+	for (i = 0; i < task_count; i++)
+	{
+		sum += context.sums[i];
+		square += context.squares[i];
+	}
+
+	rounds = (long long)context.table_count * context.rounds;
+	mean = sum / rounds;
+	error = sqrt((square / rounds - mean * mean) / rounds);
+
+	printf("Continuous shufflers of %d decks, %d tables of %d rounds, player hits below %d, seed %llu.\n", context.decks, context.table_count, context.rounds, context.stand_value, (unsigned long long)context.seed);
+	printf("%lld rounds in %.2f seconds on %d threads. (%.0f rounds a second)\n", rounds, seconds, thread_count, rounds / seconds);
+	printf("Return per round: %.4f%% +/- %.4f%%\n", mean * 100.0, error * 100.0);
+
+	// The exact calculator counts each rank in a byte, which is plenty for the game's own shoes.
+	if (context.decks <= MAX_DECK_COUNT)
+	{
+		exact = exact_expected_result(context.decks, context.stand_value, thread_count);
+		printf("Exact return from a full shoe: %.4f%% (%+.1f SE)\n", exact * 100.0, (mean - exact) / error);
+	}
+
+	printf("\n    Decks  Draw and return (ns)\n");
+
+	for (i = 0; i < CSM_TIMING_SIZES; i++)
+	{
+		blackjack_csm_init(&shuffler, sizes[i]);
+		seed_rng(&r, context.seed);
+		start = get_seconds();
+
+		for (j = 0; j < CSM_TIMING_DRAWS; j++)
+		{
+			checksum += (unsigned int)csm_draw(&shuffler, &r);
+			csm_add(&shuffler, (int)(checksum % CSM_CARD_COUNT) + 1, 1);
+		}
+
+		printf("%9d %21.1f\n", sizes[i], (get_seconds() - start) * 1e9 / CSM_TIMING_DRAWS);
+	}
+
+	printf("(checksum %u)\n", checksum);
+
+	free(context.sums);
+	free(context.squares);
+
+	return 0;
+}
+
+// Checks get_side_bet_odds() against every deal of the first four cards, on a full shoe and on shoes dealt part way.
+#define SIDE_BET_CHECK_SHOES 1
+#define SIDE_BET_TIMING_CALLS 200000
+
+// Usage: blackjack --side-bet-odds [--decks 1-8] [--seed n]
+// Prints what each side bet returns on a full shoe, checks the exact odds and times them.
+int run_side_bet_odds(int argc, char *argv[])
+{
+	int d, s, i, first_decks, last_decks, total_cards, cards[CARDS_IN_A_DECK], checked = 0;
+	uint64_t seed;
+	double values[SIDE_BET_COUNT], expected[SIDE_BET_COUNT], difference = 0.0, start, seconds, checksum = 0.0;
+	deck play_deck, used_deck;
+	rng r;
+
+	first_decks = (int)get_option(argc, argv, "--decks", 0);
+	seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	last_decks = (first_decks == 0) ? MAX_DECK_COUNT : first_decks;
+	first_decks = (first_decks == 0) ? MIN_DECK_COUNT : first_decks;
+
+	if (first_decks < MIN_DECK_COUNT || last_decks > MAX_DECK_COUNT)
+	{
+		printf("Usage: blackjack --side-bet-odds [--decks %d-%d] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	play_deck.deck = malloc(sizeof(int) * MAX_DECK_COUNT * CARDS_IN_A_DECK);
+	used_deck.deck = malloc(sizeof(int) * MAX_DECK_COUNT * CARDS_IN_A_DECK);
+
+	if (play_deck.deck == NULL || used_deck.deck == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'play_deck' - 01.\n");
+		return 1;
+	}
+
+	seed_rng(&r, seed);
+
+	printf("Side bet returns on a full shoe:\n\n");
+	printf("Decks");
+
+	for (i = 0; i < SIDE_BET_COUNT; i++)
+	{
+		printf("%16s", side_bet_names[i]);
+	}
+
+	printf("\n");
+
+	for (d = first_decks; d <= last_decks; d++)
+	{
+		total_cards = d * CARDS_IN_A_DECK;
+		create_decks(&play_deck, &used_deck, total_cards);
+		play_deck.total_cards = total_cards;
+		count_shoe_cards(&play_deck, cards);
+		get_side_bet_odds(cards, values);
+
+		printf("%5d", d);
+
+		for (i = 0; i < SIDE_BET_COUNT; i++)
+		{
+			printf("%15.4f%%", values[i] * 100.0);
+		}
+
+		printf("\n");
+
+		// The full shoe first, then shoes with a random number of cards already dealt.
+		for (s = 0; s <= SIDE_BET_CHECK_SHOES; s++)
+		{
+			if (s > 0)
+			{
+				shuffle_deck_rng(&play_deck, total_cards, total_cards, &r);
+				play_deck.total_cards = INITIAL_CARD_DRAW + (int)rng_bounded(&r, (uint32_t)(total_cards - INITIAL_CARD_DRAW));
+				count_shoe_cards(&play_deck, cards);
+			}
+
+			get_side_bet_odds(cards, values);
+			enumerate_side_bet_odds(cards, expected);
+			checked++;
+
+			for (i = 0; i < SIDE_BET_COUNT; i++)
+			{
+				difference = (fabs(values[i] - expected[i]) > difference) ? fabs(values[i] - expected[i]) : difference;
+			}
+		}
+	}
+
+	// Timed on the last shoe checked, adding a card then taking it away again so every call sees a new shoe.
+	start = get_seconds();
+
+	for (i = 0; i < SIDE_BET_TIMING_CALLS; i++)
+	{
+		cards[(i / 2) % CARDS_IN_A_DECK] += (i & 1) ? -1 : 1;
+		get_side_bet_odds(cards, values);
+		checksum += values[SIDE_21_PLUS_3];
+	}
+
+	seconds = get_seconds() - start;
+
+	printf("\nChecked against every deal of the first four cards on %d shoes: largest difference %.2e.\n", checked, difference);
+	printf("The exact odds take %.2f microseconds a shoe. (Checksum %.6f)\n", seconds * 1000000.0 / SIDE_BET_TIMING_CALLS, checksum / SIDE_BET_TIMING_CALLS);
+
+	free(play_deck.deck);
+	free(used_deck.deck);
+
+	return (difference < 1e-9) ? 0 : 1;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------ START OF POLICY COMPARISON ----------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Both policies play every shoe, so most of the luck cancels out of their difference. (Common random numbers)
+// With --antithetic each shoe also gets a twin shuffled with every swap mirrored (j becomes i - j), and the pair is
+// averaged. On top of that, the difference is regressed on control variates: functions of the player's first two
+// cards, the up card and the next card whose exact means are known from the shoe's composition. Subtracting the part they explain leaves the same
+// expected difference with a smaller variance.
+#define DEFAULT_COMPARE_SHOES 1000000
+#define COMPARE_TARGET_ERROR 0.001
+#define COMPARE_LOW_UP_CARD 6
+#define COMPARE_FIRST_STIFF 12
+#define COMPARE_LAST_STIFF 16
+#define STIFF_CONTROL_COUNT ((COMPARE_LAST_STIFF - COMPARE_FIRST_STIFF + 1) * 3)
+// The up card rank indicators leave out tens, since all ten would always add up to one.
+#define CONTROL_COUNT (TEN_RANK + STIFF_CONTROL_COUNT)
+#define POLICY_NAME_LENGTH 64
+
+// One side of a comparison: hit below a fixed value, or a strategy plug-in.
+typedef struct compare_policy
+{
+	int stand_value;
+	strategy plugin;
+	char name[POLICY_NAME_LENGTH];
+} compare_policy;
+
+// Running sums over the shoes of one task.
+// A unit is one shoe, or one shoe and its twin with --antithetic. The controls are regressed against units.
+typedef struct compare_totals
+{
+	long long shoes;
+	long long units;
+	double a;
+	double a_square;
+	double b;
+	double b_square;
+	double difference;
+	double difference_square;
+	double unit;
+	double unit_square;
+	double controls[CONTROL_COUNT];
+	double control_products[CONTROL_COUNT][CONTROL_COUNT];
+	double control_unit[CONTROL_COUNT];
+} compare_totals;
+
+typedef struct compare_context
+{
+	compare_policy *policies;
+	int num_decks;
+	int antithetic;
+	int chunk_count;
+	long long shoes;
+	uint64_t seed;
+	compare_totals *totals;
+} compare_context;
+
+// Reads a policy from the command line: a number from 2 to 21 hits below it, anything else is a strategy plug-in.
+int parse_compare_policy(const char *text, compare_policy *policy)
+{
+	char *end;
+	long value = strtol(text, &end, 10);
+
+	if (*text != '\0' && *end == '\0')
+	{
+		if (value < 2 || value > 21)
+		{
+			return 0;
+		}
+
+		policy->stand_value = (int)value;
+		load_strategy(&policy->plugin, NULL);
+		snprintf(policy->name, POLICY_NAME_LENGTH, "Hit below %ld", value);
+
+		return 1;
+	}
+
+	policy->stand_value = 0;
+	if (!load_strategy(&policy->plugin, text))
+	{
+		return 0;
+	}
+
+	snprintf(policy->name, POLICY_NAME_LENGTH, "%s", policy->plugin.name);
+
+	return 1;
+}
+
+// Shuffles the top 'depth' cards of two fresh shoes with the same draws. Where one swaps card i with j, the other
+// swaps it with i - j, so both are evenly shuffled but a shoe that starts high tends to get a twin that starts low.
+void shuffle_antithetic_decks(int *shoe, int *twin, int n, int depth, rng *r)
+{
+	int i, j;
+
+	for (i = 0; i < n; i++)
+	{
+		shoe[i] = (i + 1);
+		twin[i] = (i + 1);
+	}
+
+	for (i = (n - 1); i > 0 && i >= (n - depth); i--)
+	{
+		j = rng_bounded(r, i + 1);
+		swap_pointers(&shoe[i], &shoe[j]);
+		swap_pointers(&twin[i], &twin[i - j]);
+	}
+}
+
+// Fills the control variates for a round whose player is dealt 'first' and 'second' against 'up', with 'next' on top
+// of the shoe. (Rank indexes) The up card's rank, then for each stiff total the player can start on: against a low
+// up card, against a high one, and with a next card that would bust it.
+void get_control_values(int first, int second, int up, int next, double *controls)
+{
+	int i, total, offset;
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		controls[i] = 0.0;
+	}
+
+	if (up != TEN_RANK)
+	{
+		controls[up] = 1.0;
+	}
+
+	total = get_adjusted_value(get_rank_value(first) + get_rank_value(second), (first == ACE_RANK) + (second == ACE_RANK));
+
+	if (total >= COMPARE_FIRST_STIFF && total <= COMPARE_LAST_STIFF)
+	{
+		offset = TEN_RANK + (total - COMPARE_FIRST_STIFF) * 3;
+		controls[offset + ((up != ACE_RANK && get_rank_value(up) <= COMPARE_LOW_UP_CARD) ? 0 : 1)] = 1.0;
+		controls[offset + 2] = (next != ACE_RANK && total + get_rank_value(next) > 21);
+	}
+}
+
+// Works out the exact means of the control variates by going through every rank the four cards can have.
+// Any four cards of a shuffled shoe are alike, so skipping the hole card between them doesn't matter.
+void get_control_means(int num_decks, double *means)
+{
+	int first, second, up, next, i, counts[RANK_COUNT], total = num_decks * CARDS_IN_A_DECK;
+	double chance, controls[CONTROL_COUNT];
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		counts[i] = num_decks * 4;
+	}
+	counts[TEN_RANK] = num_decks * 16;
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		means[i] = 0.0;
+	}
+
+	for (first = 0; first < RANK_COUNT; first++)
+	{
+		for (second = 0; second < RANK_COUNT; second++)
+		{
+			for (up = 0; up < RANK_COUNT; up++)
+			{
+				for (next = 0; next < RANK_COUNT; next++)
+				{
+					chance = (double)counts[first] / total;
+					chance *= (double)(counts[second] - (second == first)) / (total - 1);
+					chance *= (double)(counts[up] - (up == first) - (up == second)) / (total - 2);
+					chance *= (double)(counts[next] - (next == first) - (next == second) - (next == up)) / (total - 3);
+
+					get_control_values(first, second, up, next, controls);
+
+					for (i = 0; i < CONTROL_COUNT; i++)
+					{
+						means[i] += chance * controls[i];
+					}
+				}
+			}
+		}
+	}
+}
+
+// Asks a policy whether to hit. 'counts' holds the ranks left in the shoe, as for fill_strategy_request().
+int get_policy_decision(compare_policy *policy, hand *player, hand *dealer, int *counts)
+{
+	int decision;
+	strategy_request request;
+
+	if (policy->stand_value > 0)
+	{
+		return (player->hand_value < policy->stand_value) ? STRATEGY_HIT : STRATEGY_STAND;
+	}
+
+	fill_strategy_request(&request, player, dealer, counts);
+	policy->plugin.decide(&request, &decision, 1);
+
+	return decision;
+}
+
+// Plays one round from the top of 'play_deck' under a policy. Returns the net result in units of the bet.
+double play_policy_round(compare_policy *policy, deck *play_deck, deck *used_deck, hand *player, hand *dealer, int *counts, rng *r)
+{
+	if (!deal_headless_round(play_deck, used_deck, player, dealer, counts, r))
+	{
+		return settle_headless_round(used_deck, player, dealer);
+	}
+
+	while (player->hand_value < 21)
+	{
+		if (get_policy_decision(policy, player, dealer, counts) != STRATEGY_HIT)
+		{
+			break;
+		}
+
+		draw_card(play_deck, used_deck, player, counts, r);
+		get_hand_value(player);
+	}
+
+	return finish_headless_round(play_deck, used_deck, player, dealer, counts, r);
+}
+
+// Plays a chunk of shoes under both policies, adding everything the estimates need to the task's totals.
+void compare_task(void *argument, int task, int worker)
+{
+	compare_context *context = argument;
+	compare_totals *totals = &context->totals[task];
+	int total_cards = context->num_decks * CARDS_IN_A_DECK, shoe_count = context->antithetic ? 2 : 1;
+	int i, j, s, p, full_counts[RANK_COUNT], counts[RANK_COUNT], *shoes[2];
+	long long n, units = (context->shoes * (task + 1)) / context->chunk_count - (context->shoes * task) / context->chunk_count;
+	double results[2], difference, unit, controls[CONTROL_COUNT], unit_controls[CONTROL_COUNT];
+	deck play_deck, used_deck;
+	hand player, dealer;
+	rng r;
+
+	(void)worker;
+
+	play_deck.deck = malloc(sizeof(int) * total_cards);
+	used_deck.deck = malloc(sizeof(int) * total_cards);
+	shoes[0] = malloc(sizeof(int) * total_cards);
+	shoes[1] = malloc(sizeof(int) * total_cards);
+
+	if (play_deck.deck == NULL || used_deck.deck == NULL || shoes[0] == NULL || shoes[1] == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'deck' - 01.\n");
+		exit(1);
+	}
+
+	memset(totals, 0, sizeof(compare_totals));
+	seed_rng(&r, context->seed + (uint64_t)task);
+	player.total_cards = 0;
+	dealer.total_cards = 0;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		full_counts[i] = context->num_decks * 4;
+	}
+	full_counts[TEN_RANK] = context->num_decks * 16;
+
+	for (n = 0; n < units; n++)
+	{
+		shuffle_antithetic_decks(shoes[0], shoes[1], total_cards, MAX_HAND_COUNT * 2, &r);
+		unit = 0.0;
+
+		for (i = 0; i < CONTROL_COUNT; i++)
+		{
+			unit_controls[i] = 0.0;
+		}
+
+		for (s = 0; s < shoe_count; s++)
+		{
+			// Both policies start from the same shoe.
+			for (p = 0; p < 2; p++)
+			{
+				memcpy(play_deck.deck, shoes[s], sizeof(int) * total_cards);
+				memcpy(counts, full_counts, sizeof(counts));
+				play_deck.total_cards = total_cards;
+				used_deck.total_cards = 0;
+
+				results[p] = play_policy_round(&context->policies[p], &play_deck, &used_deck, &player, &dealer, counts, &r);
+			}
+
+			// The player's cards are dealt from the top, the up card is the fourth card down and the next card the fifth.
+			get_control_values(get_card_rank(shoes[s][total_cards - 1]), get_card_rank(shoes[s][total_cards - 3]), get_card_rank(shoes[s][total_cards - 4]), get_card_rank(shoes[s][total_cards - 5]), controls);
+
+			difference = results[0] - results[1];
+			totals->a += results[0];
+			totals->a_square += results[0] * results[0];
+			totals->b += results[1];
+			totals->b_square += results[1] * results[1];
+			totals->difference += difference;
+			totals->difference_square += difference * difference;
+			unit += difference / shoe_count;
+
+			for (i = 0; i < CONTROL_COUNT; i++)
+			{
+				unit_controls[i] += controls[i] / shoe_count;
+			}
+		}
+
+		totals->shoes += shoe_count;
+		totals->units++;
+		totals->unit += unit;
+		totals->unit_square += unit * unit;
+
+		for (i = 0; i < CONTROL_COUNT; i++)
+		{
+			totals->controls[i] += unit_controls[i];
+			totals->control_unit[i] += unit_controls[i] * unit;
+
+			for (j = 0; j <= i; j++)
+			{
+				totals->control_products[i][j] += unit_controls[i] * unit_controls[j];
+			}
+		}
+	}
+
+	free(shoes[1]);
+	free(shoes[0]);
+	free(used_deck.deck);
+	free(play_deck.deck);
+}
+
+// Solves for the control variate coefficients with Gaussian elimination. Controls that never varied get zero.
+// 'covariance' is overwritten.
+void solve_control_coefficients(double covariance[CONTROL_COUNT][CONTROL_COUNT], double *cross, double *coefficients)
+{
+	int i, j, k, pivot, used[CONTROL_COUNT], order[CONTROL_COUNT], count = 0;
+	double a[CONTROL_COUNT][CONTROL_COUNT + 1], factor, temp;
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		coefficients[i] = 0.0;
+		used[i] = (covariance[i][i] > 1e-12);
+
+		if (used[i])
+		{
+			order[count++] = i;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < count; j++)
+		{
+			a[i][j] = covariance[order[i]][order[j]];
+		}
+
+		a[i][count] = cross[order[i]];
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		pivot = i;
+
+		for (j = i + 1; j < count; j++)
+		{
+			if (fabs(a[j][i]) > fabs(a[pivot][i]))
+			{
+				pivot = j;
+			}
+		}
+
+		for (k = 0; k <= count; k++)
+		{
+			temp = a[i][k];
+			a[i][k] = a[pivot][k];
+			a[pivot][k] = temp;
+		}
+
+		if (fabs(a[i][i]) < 1e-15)
+		{
+			continue;
+		}
+
+		for (j = 0; j < count; j++)
+		{
+			if (j != i)
+			{
+				factor = a[j][i] / a[i][i];
+
+				for (k = i; k <= count; k++)
+				{
+					a[j][k] -= factor * a[i][k];
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (fabs(a[i][i]) >= 1e-15)
+		{
+			coefficients[order[i]] = a[i][count] / a[i][i];
+		}
+	}
+}
+
+// Prints one estimate of the difference along with the rounds it would take to reach COMPARE_TARGET_ERROR.
+// 'variance' is per sample and every sample costs 'rounds_per_sample' rounds.
+void print_compare_row(const char *method, double mean, double variance, long long samples, int rounds_per_sample, double baseline)
+{
+	double error = sqrt(variance / samples), rounds = variance * rounds_per_sample / (COMPARE_TARGET_ERROR * COMPARE_TARGET_ERROR);
+
+	printf("%-26s | %+9.4f%% +/- %.4f%% | %16.0f | %8.1fx\n", method, mean * 100.0, error * 100.0, rounds, baseline / rounds);
+}
+
+// Compares two policies on the same shoes and prints the paired difference with its standard error, next to what
+// independent runs would have needed for the same accuracy.
+// Usage: blackjack --compare <policy> <policy> [--shoes n] [--decks n] [--antithetic] [--threads n] [--seed n]
+int run_compare(int argc, char *argv[])
+{
+	int i, j, num_decks, antithetic = 0, thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	long long shoes, units;
+	double n, mean_a, mean_b, variance_a, variance_b, mean, variance, unit_mean, unit_variance, baseline, adjusted, residual;
+	double means[CONTROL_COUNT], control_means[CONTROL_COUNT], cross[CONTROL_COUNT], coefficients[CONTROL_COUNT];
+	double covariance[CONTROL_COUNT][CONTROL_COUNT];
+	compare_policy policies[2];
+	compare_totals sum;
+	compare_context context;
+
+	for (i = 4; i < argc; i++)
+	{
+		antithetic |= (strcmp(argv[i], "--antithetic") == 0);
+	}
+
+	num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	shoes = get_option(argc, argv, "--shoes", DEFAULT_COMPARE_SHOES);
+
+	if (argc < 4 || num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT || shoes < 2 || thread_count < 1)
+	{
+		printf("Usage: blackjack --compare <policy> <policy> [--shoes n] [--decks %d-%d] [--antithetic] [--threads n] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		printf("A policy is a number from 2 to 21 to hit below it, or a strategy plug-in file.\n");
+		return 1;
+	}
+
+	if (!parse_compare_policy(argv[2], &policies[0]) || !parse_compare_policy(argv[3], &policies[1]))
+	{
+		printf("ERROR: A policy is a number from 2 to 21 or a strategy plug-in file.\n");
+		return 1;
+	}
+
+	// With --antithetic every unit is a shoe and its twin, so half as many are shuffled for the same number of shoes.
+	units = antithetic ? (shoes + 1) / 2 : shoes;
+	context.policies = policies;
+	context.num_decks = num_decks;
+	context.antithetic = antithetic;
+	context.shoes = units;
+	context.seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	context.chunk_count = (int)((units + SIMULATION_CHUNK_ROUNDS - 1) / SIMULATION_CHUNK_ROUNDS);
+	context.totals = malloc(sizeof(compare_totals) * context.chunk_count);
+
+	if (context.totals == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'context' - 01.\n");
+		return 1;
+	}
+
+	run_work_pool(context.chunk_count, thread_count, compare_task, &context);
+
+	// Adds the tasks up in a fixed order so the answer doesn't depend on the thread count.
+	memset(&sum, 0, sizeof(sum));
+
+	for (i = 0; i < context.chunk_count; i++)
+	{
+		sum.shoes += context.totals[i].shoes;
+		sum.units += context.totals[i].units;
+		sum.a += context.totals[i].a;
+		sum.a_square += context.totals[i].a_square;
+		sum.b += context.totals[i].b;
+		sum.b_square += context.totals[i].b_square;
+		sum.difference += context.totals[i].difference;
+		sum.difference_square += context.totals[i].difference_square;
+		sum.unit += context.totals[i].unit;
+		sum.unit_square += context.totals[i].unit_square;
+
+		for (j = 0; j < CONTROL_COUNT; j++)
+		{
+			sum.controls[j] += context.totals[i].controls[j];
+			sum.control_unit[j] += context.totals[i].control_unit[j];
+		}
+
+		for (j = 0; j < CONTROL_COUNT * CONTROL_COUNT; j++)
+		{
+			sum.control_products[j / CONTROL_COUNT][j % CONTROL_COUNT] += context.totals[i].control_products[j / CONTROL_COUNT][j % CONTROL_COUNT];
+		}
+	}
+
+	free(context.totals);
+
+	// Per shoe estimates.
+	n = (double)sum.shoes;
+	mean_a = sum.a / n;
+	mean_b = sum.b / n;
+	variance_a = (sum.a_square - n * mean_a * mean_a) / (n - 1);
+	variance_b = (sum.b_square - n * mean_b * mean_b) / (n - 1);
+	mean = sum.difference / n;
+	variance = (sum.difference_square - n * mean * mean) / (n - 1);
+
+	// Per unit estimates and the control variate regression.
+	n = (double)sum.units;
+	unit_mean = sum.unit / n;
+	unit_variance = (sum.unit_square - n * unit_mean * unit_mean) / (n - 1);
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		means[i] = sum.controls[i] / n;
+		cross[i] = (sum.control_unit[i] - n * means[i] * unit_mean) / (n - 1);
+	}
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		for (j = 0; j <= i; j++)
+		{
+			covariance[i][j] = (sum.control_products[i][j] - n * means[i] * means[j]) / (n - 1);
+			covariance[j][i] = covariance[i][j];
+		}
+	}
+
+	solve_control_coefficients(covariance, cross, coefficients);
+	get_control_means(num_decks, control_means);
+
+	adjusted = unit_mean;
+	residual = unit_variance;
+
+	for (i = 0; i < CONTROL_COUNT; i++)
+	{
+		adjusted -= coefficients[i] * (means[i] - control_means[i]);
+		residual -= coefficients[i] * cross[i];
+	}
+
+	// Independent runs play every round once per policy, so two rounds buy one sample of each.
+	baseline = (variance_a + variance_b) * 2 / (COMPARE_TARGET_ERROR * COMPARE_TARGET_ERROR);
+
+	printf("A: %s\n", policies[0].name);
+	printf("B: %s\n", policies[1].name);
+	printf("%lld shoes of %d decks, each played by both policies, seed %llu.\n", sum.shoes, num_decks, (unsigned long long)context.seed);
+	printf("A returns %+.4f%% and B %+.4f%% per round.\n\n", mean_a * 100.0, mean_b * 100.0);
+	printf("Method                     | A - B per round         | Rounds for +/- %.1f%% | Fewer rounds\n", COMPARE_TARGET_ERROR * 100.0);
+	print_compare_row("Independent runs", mean_a - mean_b, variance_a + variance_b, sum.shoes, 2, baseline);
+	print_compare_row("Common random numbers", mean, variance, sum.shoes, 2, baseline);
+
+	if (antithetic)
+	{
+		print_compare_row(" + antithetic shoes", unit_mean, unit_variance, sum.units, 4, baseline);
+	}
+
+	print_compare_row(" + control variates", adjusted, residual, sum.units, antithetic ? 4 : 2, baseline);
+
+	residual = sqrt(residual / n);
+	printf("\n%s is %s than %s by %.4f%% per round. (%.1f standard errors)\n", (adjusted >= 0.0) ? "A" : "B", "better", (adjusted >= 0.0) ? "B" : "A", fabs(adjusted) * 100.0, fabs(adjusted) / residual);
+
+	unload_strategy(&policies[1].plugin);
+	unload_strategy(&policies[0].plugin);
+
+	return 0;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------- START OF PERFECT INFORMATION OPTIMIZER ---------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+#define DEFAULT_PERFECT_PLAY_SHOES 1000
+
+typedef struct perfect_play_context
+{
+	int num_decks;
+	uint64_t seed;
+	double *totals;
+	int *rounds;
+	int *baseline_rounds;
+	double *baseline_totals;
+} perfect_play_context;
+
+// Plays the round starting at 'position' in a known shoe (in dealing order).
+// The player hits 'hits' times, then keeps hitting while below 'stand_value'. (Zero turns that off)
+// Sets 'can_hit' if the player is still allowed to draw afterwards.
+// Returns 0 if the round would need more cards than are left in the shoe.
+int play_known_round(int *shoe, int shoe_size, int position, int hits, int stand_value, double *result, int *cards_used, int *can_hit)
+{
+	int i, next = position, player_blackjack;
+	hand player, dealer, *target;
+
+	*can_hit = 0;
+
+	if ((position + INITIAL_CARD_DRAW) > shoe_size)
+	{
+		return 0;
+	}
+
+	player.total_cards = 0;
+	dealer.total_cards = 0;
+
+	// Same alternating order as the initial draw in blackjack().
+	for (i = INITIAL_CARD_DRAW; i > 0; i--)
+	{
+		target = (i % 2 == 0) ? &player : &dealer;
+		target->hand[target->total_cards] = shoe[next];
+		(target->total_cards)++;
+		next++;
+	}
+
+	get_hand_value(&player);
+	get_hand_value(&dealer);
+
+	if (dealer.hand_value == 21)
+	{
+		*result = (player.hand_value == 21) ? 0.0 : -1.0;
+		*cards_used = next - position;
+		return (hits == 0);
+	}
+
+	player_blackjack = (player.hand_value == 21);
+
+	for (i = 0; (i < hits) || ((player.hand_value < stand_value) && (player.hand_value < 21)); i++)
+	{
+		if (player.hand_value >= 21 || next >= shoe_size)
+		{
+			return 0;
+		}
+
+		player.hand[player.total_cards] = shoe[next];
+		(player.total_cards)++;
+		next++;
+		get_hand_value(&player);
+	}
+
+	*can_hit = (player.hand_value < 21);
+
+	if (player.hand_value <= 21)
+	{
+		while (dealer.hand_value < DEALER_HOLD_VALUE)
+		{
+			if (next >= shoe_size)
+			{
+				return 0;
+			}
+
+			dealer.hand[dealer.total_cards] = shoe[next];
+			(dealer.total_cards)++;
+			next++;
+			get_hand_value(&dealer);
+		}
+	}
+
+	*result = get_round_result(player.hand_value, dealer.hand_value, player_blackjack);
+	*cards_used = next - position;
+
+	return 1;
+}
+
+// Finds the best total result over a whole known shoe by dynamic programming over the shoe position.
+// best[p] is the most the player can win from the round starting at card p to the end of the shoe.
+// Rounds that would run past the end of the shoe need a reshuffle and are left out.
+double solve_known_shoe(int *shoe, int shoe_size, double *best, int *rounds, int *total_rounds)
+{
+	int position, hits, can_hit, cards_used;
+	double result, value;
+
+	best[shoe_size] = 0.0;
+	rounds[shoe_size] = 0;
+
+	for (position = shoe_size - 1; position >= 0; position--)
+	{
+		best[position] = 0.0;
+		rounds[position] = 0;
+
+		for (hits = 0, can_hit = 1; can_hit; hits++)
+		{
+			if (!play_known_round(shoe, shoe_size, position, hits, 0, &result, &cards_used, &can_hit))
+			{
+				continue;
+			}
+
+			value = result + best[position + cards_used];
+
+			if (rounds[position] == 0 || value > best[position])
+			{
+				best[position] = value;
+				rounds[position] = 1 + rounds[position + cards_used];
+			}
+		}
+	}
+
+	*total_rounds = rounds[0];
+
+	return best[0];
+}
+
+// Plays the same shoe straight through, hitting below 'stand_value', for comparison.
+double play_known_shoe(int *shoe, int shoe_size, int stand_value, int *total_rounds)
+{
+	int position = 0, can_hit, cards_used;
+	double result, total = 0.0;
+
+	*total_rounds = 0;
+
+	while (play_known_round(shoe, shoe_size, position, 0, stand_value, &result, &cards_used, &can_hit))
+	{
+		total += result;
+		position += cards_used;
+		(*total_rounds)++;
+	}
+
+	return total;
+}
+
+// Builds one shoe the same way the game does and solves it.
+void perfect_play_task(void *argument, int task, int worker)
+{
+	perfect_play_context *context = argument;
+	int i, shoe_size = context->num_decks * CARDS_IN_A_DECK, *shoe, *rounds;
+	double *best;
+	deck play_deck, used_deck;
+	rng r;
+
+	(void)worker;
+
+	play_deck.deck = malloc(sizeof(int) * shoe_size);
+	used_deck.deck = malloc(sizeof(int) * shoe_size);
+	shoe = malloc(sizeof(int) * shoe_size);
+	rounds = malloc(sizeof(int) * (shoe_size + 1));
+	best = malloc(sizeof(double) * (shoe_size + 1));
+
+	if (play_deck.deck == NULL || used_deck.deck == NULL || shoe == NULL || rounds == NULL || best == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'shoe' - 01.\n");
+		exit(1);
+	}
+
+	seed_rng(&r, context->seed + (uint64_t)task);
+	play_deck.total_cards = shoe_size;
+	used_deck.total_cards = 0;
+	create_decks(&play_deck, &used_deck, shoe_size);
+	shuffle_deck_rng(&play_deck, shoe_size, shoe_size, &r);
+
+	// Cards are dealt from the top of the play deck downward.
+	for (i = 0; i < shoe_size; i++)
+	{
+		shoe[i] = play_deck.deck[shoe_size - 1 - i];
+	}
+
+	context->totals[task] = solve_known_shoe(shoe, shoe_size, best, rounds, &context->rounds[task]);
+	context->baseline_totals[task] = play_known_shoe(shoe, shoe_size, DEFAULT_STAND_VALUE, &context->baseline_rounds[task]);
+
+	free(best);
+	free(rounds);
+	free(shoe);
+	free(used_deck.deck);
+	free(play_deck.deck);
+}
+
+// Prints the best possible result over many shoes when every card is known in advance.
+// Usage: blackjack --perfect-play [--decks n] [--shoes n] [--threads n] [--seed n]
+int run_perfect_play(int argc, char *argv[])
+{
+	int i, shoes = (int)get_option(argc, argv, "--shoes", DEFAULT_PERFECT_PLAY_SHOES);
+	int thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	long long total_rounds = 0, baseline_rounds = 0;
+	double total = 0.0, square = 0.0, baseline = 0.0, best_shoe, worst_shoe, mean, error;
+	perfect_play_context context;
+	clock_t start = clock();
+	time_t wall_start = time(NULL);
+
+	context.num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	context.seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+
+	if (context.num_decks < MIN_DECK_COUNT || context.num_decks > MAX_DECK_COUNT || shoes < 2 || thread_count < 1)
+	{
+		printf("Usage: blackjack --perfect-play [--decks %d-%d] [--shoes n] [--threads n] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	context.totals = malloc(sizeof(double) * shoes);
+	context.rounds = malloc(sizeof(int) * shoes);
+	context.baseline_totals = malloc(sizeof(double) * shoes);
+	context.baseline_rounds = malloc(sizeof(int) * shoes);
+
+	if (context.totals == NULL || context.rounds == NULL || context.baseline_totals == NULL || context.baseline_rounds == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'context' - 02.\n");
+		return 1;
+	}
+
+	run_work_pool(shoes, thread_count, perfect_play_task, &context);
+
+	best_shoe = worst_shoe = context.totals[0];
+
+	for (i = 0; i < shoes; i++)
+	{
+		total += context.totals[i];
+		square += context.totals[i] * context.totals[i];
+		total_rounds += context.rounds[i];
+		baseline += context.baseline_totals[i];
+		baseline_rounds += context.baseline_rounds[i];
+
+		if (context.totals[i] > best_shoe)
+		{
+			best_shoe = context.totals[i];
+		}
+		if (context.totals[i] < worst_shoe)
+		{
+			worst_shoe = context.totals[i];
+		}
+	}
+
+	mean = total / shoes;
+	error = sqrt((square / shoes - mean * mean) / shoes);
+
+	printf("Perfect information play over %d shoes of %d decks (seed %llu).\n\n", shoes, context.num_decks, (unsigned long long)context.seed);
+	printf("Best result per shoe: %+.3f +/- %.3f bets over %.1f rounds. (Range %+.1f to %+.1f)\n", mean, error, (double)total_rounds / shoes, worst_shoe, best_shoe);
+	printf("Upper bound on player advantage: %+.4f%% of each bet.\n", (total / total_rounds) * 100.0);
+	printf("Hitting below %d on the same shoes: %+.4f%% of each bet.\n", DEFAULT_STAND_VALUE, (baseline / baseline_rounds) * 100.0);
+	printf("Solved in %.2f seconds of CPU time, %ld seconds of wall time.\n", (double)(clock() - start) / CLOCKS_PER_SEC, (long)(time(NULL) - wall_start));
+
+	free(context.baseline_rounds);
+	free(context.baseline_totals);
+	free(context.rounds);
+	free(context.totals);
+
+	return 0;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------ START OF DEVIATION INDICES ----------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+// Finds the Hi-Lo true count at which standing starts to beat hitting for each hard total against each up card.
+// Shoes are dealt to the cut card under a policy. Every time the player has a hard total from 12 to 16, the rest of
+// the round is played twice from the same cards, once hitting then going on with the policy and once standing.
+// (Common random numbers) Both times the dealer draws the cards after the ones the hitting player took, so only the
+// player's hand differs. Dealing the standing dealer the cards straight after would give them the small cards that
+// helped the hitter, and the two results would pull apart instead of moving together. The cards after any point a
+// round stops at are as random as the next card, so neither result is biased.
+// The difference is added to a bucket for the true count the player could see at the time, and a line fitted
+// through the buckets gives the count where it crosses zero.
+#define DEFAULT_DEVIATION_SHOES 1000000
+#define DEFAULT_DEVIATION_PENETRATION 75
+#define DEVIATION_TASK_SHOES 250
+// Enough cards for any round, so one is never started that could run out of cards.
+#define DEVIATION_RESERVE_CARDS 26
+#define DEVIATION_FIRST_TOTAL 12
+#define DEVIATION_LAST_TOTAL 16
+#define DEVIATION_TOTAL_COUNT (DEVIATION_LAST_TOTAL - DEVIATION_FIRST_TOTAL + 1)
+// True counts are rounded to the nearest whole count, and anything past +/- this goes in the end buckets.
+#define DEVIATION_MAX_COUNT 10
+#define DEVIATION_BUCKET_COUNT (DEVIATION_MAX_COUNT * 2 + 1)
+#define DEVIATION_CELL_COUNT (DEVIATION_TOTAL_COUNT * RANK_COUNT * DEVIATION_BUCKET_COUNT)
+// Buckets with fewer situations are left out of the fit.
+#define DEVIATION_MIN_SAMPLES 100
+// The second fit only uses the buckets this close to where the first one crossed zero.
+#define DEVIATION_FIT_WINDOW 3
+#define DEVIATION_UNKNOWN 0
+#define DEVIATION_INDEX 1
+#define DEVIATION_ALWAYS_HIT 2
+#define DEVIATION_ALWAYS_STAND 3
+
+// Sums for one hard total, up card and true count. Each branch result is -1, 0 or +1, so the sums are whole numbers
+// and come out the same whatever order the shoes are added in.
+typedef struct deviation_cell
+{
+	long long samples;
+	long long hit;
+	long long stand;
+	long long hit_square;
+	long long stand_square;
+	long long difference_square;
+} deviation_cell;
+
+typedef struct deviation_context
+{
+	compare_policy *policy;
+	int num_decks;
+	int shoes;
+	int penetration;
+	uint64_t seed;
+	// DEVIATION_CELL_COUNT cells per worker, added together once every task is done.
+	deviation_cell *cells;
+} deviation_context;
+
+// Gets the cell of a hard total, up card rank and true count bucket.
+int get_deviation_cell(int total, int up_rank, int bucket)
+{
+	return ((total - DEVIATION_FIRST_TOTAL) * RANK_COUNT + up_rank) * DEVIATION_BUCKET_COUNT + bucket;
+}
+
+// Adds a card from a known shoe to a hand and takes it out of the counts.
+void take_known_card(int *shoe, int *next, hand *target, int *counts)
+{
+	target->hand[target->total_cards] = shoe[*next];
+	(target->total_cards)++;
+	counts[get_card_rank(shoe[*next])]--;
+	(*next)++;
+	get_hand_value(target);
+}
+
+// Finishes a round from card 'next' of a known shoe, hitting once and then playing on under the policy, or standing.
+// Hitting sets 'dealer_start' to the card after the player's, and standing deals the dealer from there.
+// Works on copies, so the hands and counts are left as they were. Returns the result in units of the bet.
+double play_deviation_branch(compare_policy *policy, int *shoe, int next, hand *player, hand *dealer, int *counts, int hit, int *dealer_start)
+{
+	int i, shoe_counts[RANK_COUNT];
+	hand player_copy = *player, dealer_copy = *dealer;
+
+	for (i = 0; i < RANK_COUNT; i++)
+	{
+		shoe_counts[i] = counts[i];
+	}
+
+	if (hit)
+	{
+		take_known_card(shoe, &next, &player_copy, shoe_counts);
+
+		while (player_copy.hand_value < 21 && get_policy_decision(policy, &player_copy, &dealer_copy, shoe_counts) == STRATEGY_HIT)
+		{
+			take_known_card(shoe, &next, &player_copy, shoe_counts);
+		}
+
+		*dealer_start = next;
+	}
+	else
+	{
+		next = *dealer_start;
+	}
+
+	if (player_copy.hand_value > 21)
+	{
+		return -1.0;
+	}
+
+	while (dealer_copy.hand_value < DEALER_HOLD_VALUE)
+	{
+		take_known_card(shoe, &next, &dealer_copy, shoe_counts);
+	}
+
+	return get_round_result(player_copy.hand_value, dealer_copy.hand_value, 0);
+}
+
+// Compares hitting and standing from where the player is now, if it's a hard total the indices cover.
+void add_deviation_situation(compare_policy *policy, int *shoe, int next, hand *player, hand *dealer, int *counts, deviation_cell *cells)
+{
+	int bucket, dealer_start, hit, stand;
+	double true_count;
+	strategy_request request;
+	deviation_cell *cell;
+
+	// The request counts the dealer's hidden card as unseen, the way the player sees the shoe.
+	fill_strategy_request(&request, player, dealer, counts);
+
+	if (request.soft || request.hand_total < DEVIATION_FIRST_TOTAL || request.hand_total > DEVIATION_LAST_TOTAL)
+	{
+		return;
+	}
+
+	true_count = get_running_count(request.shoe_counts) / ((double)request.cards_left / CARDS_IN_A_DECK);
+	bucket = (int)floor(true_count + 0.5);
+
+	if (bucket < -DEVIATION_MAX_COUNT)
+	{
+		bucket = -DEVIATION_MAX_COUNT;
+	}
+	else if (bucket > DEVIATION_MAX_COUNT)
+	{
+		bucket = DEVIATION_MAX_COUNT;
+	}
+
+	// Hard totals can't be a blackjack, so the results are whole numbers.
+	hit = (int)play_deviation_branch(policy, shoe, next, player, dealer, counts, 1, &dealer_start);
+	stand = (int)play_deviation_branch(policy, shoe, next, player, dealer, counts, 0, &dealer_start);
+
+	cell = &cells[get_deviation_cell(request.hand_total, get_card_rank(dealer->hand[1]), bucket + DEVIATION_MAX_COUNT)];
+	cell->samples++;
+	cell->hit += hit;
+	cell->stand += stand;
+	cell->hit_square += hit * hit;
+	cell->stand_square += stand * stand;
+	cell->difference_square += (hit - stand) * (hit - stand);
+}
+
+// Deals a chunk of shoes to the cut card, looking at every decision on the way.
+void deviation_task(void *argument, int task, int worker)
+{
+	deviation_context *context = argument;
+	int i, shoe_index, position, next, cut, shoe_size = context->num_decks * CARDS_IN_A_DECK, *shoe, counts[RANK_COUNT];
+	int last_shoe = (task + 1) * DEVIATION_TASK_SHOES;
+	deck play_deck, used_deck;
+	hand player, dealer, *target;
+	deviation_cell *cells = &context->cells[(size_t)worker * DEVIATION_CELL_COUNT];
+	rng r;
+
+	play_deck.deck = malloc(sizeof(int) * shoe_size);
+	used_deck.deck = malloc(sizeof(int) * shoe_size);
+	shoe = malloc(sizeof(int) * shoe_size);
+
+	if (play_deck.deck == NULL || used_deck.deck == NULL || shoe == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'shoe' - 01.\n");
+		exit(1);
+	}
+
+	cut = shoe_size * context->penetration / 100;
+
+	if (cut > shoe_size - DEVIATION_RESERVE_CARDS)
+	{
+		cut = shoe_size - DEVIATION_RESERVE_CARDS;
+	}
+
+	if (last_shoe > context->shoes)
+	{
+		last_shoe = context->shoes;
+	}
+
+	for (shoe_index = task * DEVIATION_TASK_SHOES; shoe_index < last_shoe; shoe_index++)
+	{
+		// Every shoe has its own seed, so the answer doesn't depend on how the shoes are split into tasks.
+		seed_rng(&r, context->seed + (uint64_t)shoe_index);
+		play_deck.total_cards = shoe_size;
+		used_deck.total_cards = 0;
+		create_decks(&play_deck, &used_deck, shoe_size);
+		shuffle_deck_rng(&play_deck, shoe_size, shoe_size, &r);
+		count_shoe(&play_deck, counts);
+
+		// Cards are dealt from the top of the play deck downward.
+		for (i = 0; i < shoe_size; i++)
+		{
+			shoe[i] = play_deck.deck[shoe_size - 1 - i];
+		}
+
+		for (position = 0; position < cut; position = next)
+		{
+			next = position;
+			player.total_cards = 0;
+			dealer.total_cards = 0;
+
+			// Same alternating order as the initial draw in blackjack(). The dealer's first card is the hidden one.
+			for (i = INITIAL_CARD_DRAW; i > 0; i--)
+			{
+				target = (i % 2 == 0) ? &player : &dealer;
+				take_known_card(shoe, &next, target, counts);
+			}
+
+			if (dealer.hand_value == 21)
+			{
+				continue;
+			}
+
+			while (player.hand_value < 21)
+			{
+				add_deviation_situation(context->policy, shoe, next, &player, &dealer, counts, cells);
+
+				if (get_policy_decision(context->policy, &player, &dealer, counts) != STRATEGY_HIT)
+				{
+					break;
+				}
+
+				take_known_card(shoe, &next, &player, counts);
+			}
+
+			while (player.hand_value <= 21 && dealer.hand_value < DEALER_HOLD_VALUE)
+			{
+				take_known_card(shoe, &next, &dealer, counts);
+			}
+		}
+	}
+
+	free(shoe);
+	free(used_deck.deck);
+	free(play_deck.deck);
+}
+
+// Fits hit minus stand against the true count by weighted least squares, over the buckets within 'window' of
+// 'center' that have enough situations. Returns 0 if there weren't two buckets to fit through.
+int fit_deviation_line(deviation_cell *cells, double center, int window, double *intercept, double *slope)
+{
+	int bucket, used = 0;
+	double count, mean, variance, weight, sum = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0, determinant;
+
+	for (bucket = 0; bucket < DEVIATION_BUCKET_COUNT; bucket++)
+	{
+		count = bucket - DEVIATION_MAX_COUNT;
+
+		if (cells[bucket].samples < DEVIATION_MIN_SAMPLES || fabs(count - center) > window)
+		{
+			continue;
+		}
+
+		mean = (double)(cells[bucket].hit - cells[bucket].stand) / cells[bucket].samples;
+		variance = ((double)cells[bucket].difference_square / cells[bucket].samples - mean * mean) / cells[bucket].samples;
+
+		if (variance <= 0.0)
+		{
+			continue;
+		}
+
+		weight = 1.0 / variance;
+		sum += weight;
+		sum_x += weight * count;
+		sum_y += weight * mean;
+		sum_xx += weight * count * count;
+		sum_xy += weight * count * mean;
+		used++;
+	}
+
+	determinant = sum * sum_xx - sum_x * sum_x;
+
+	if (used < 2 || determinant <= 0.0)
+	{
+		return 0;
+	}
+
+	*slope = (sum * sum_xy - sum_x * sum_y) / determinant;
+	*intercept = (sum_y - *slope * sum_x) / sum;
+
+	return 1;
+}
+
+// Finds the true count where standing starts to beat hitting, from one total and up card's buckets.
+// Returns DEVIATION_INDEX and sets 'index', or says which play wins at every count from -10 to +10.
+int find_deviation_index(deviation_cell *cells, double *index)
+{
+	double intercept, slope, crossing;
+
+	if (!fit_deviation_line(cells, 0.0, DEVIATION_MAX_COUNT, &intercept, &slope))
+	{
+		return DEVIATION_UNKNOWN;
+	}
+
+	// A higher count means more tens, which should only make hitting worse. If it doesn't, the count doesn't matter.
+	if (slope >= 0.0)
+	{
+		return (intercept > 0.0) ? DEVIATION_ALWAYS_HIT : DEVIATION_ALWAYS_STAND;
+	}
+
+	crossing = -intercept / slope;
+
+	// The line is only a rough fit away from the crossing, so it's fitted again close to it.
+	if (fabs(crossing) <= DEVIATION_MAX_COUNT && fit_deviation_line(cells, crossing, DEVIATION_FIT_WINDOW, &intercept, &slope) && slope < 0.0)
+	{
+		crossing = -intercept / slope;
+	}
+
+	if (crossing > DEVIATION_MAX_COUNT + 0.5)
+	{
+		return DEVIATION_ALWAYS_HIT;
+	}
+	if (crossing < -DEVIATION_MAX_COUNT - 0.5)
+	{
+		return DEVIATION_ALWAYS_STAND;
+	}
+
+	*index = crossing;
+
+	return DEVIATION_INDEX;
+}
+
+// Writes one entry of the index table: the count to stand at, H, S, or ? when there were too few situations.
+void format_deviation_index(char *text, size_t size, int kind, double index)
+{
+	if (kind == DEVIATION_INDEX)
+	{
+		snprintf(text, size, "%+d", (int)floor(index + 0.5));
+	}
+	else
+	{
+		snprintf(text, size, "%s", (kind == DEVIATION_ALWAYS_HIT) ? "H" : ((kind == DEVIATION_ALWAYS_STAND) ? "S" : "?"));
+	}
+}
+
+// Prints the hit/stand index of every hard total from 12 to 16 against every up card.
+// Usage: blackjack --deviations [--decks n] [--shoes n] [--penetration percent] [--policy policy] [--output file] [--threads n] [--seed n]
+int run_deviations(int argc, char *argv[])
+{
+	int i, worker, total, rank, bucket, tasks, kinds[DEVIATION_TOTAL_COUNT][RANK_COUNT];
+	int thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	// Up cards in the order they're printed: 2 - 9, ten, then ace.
+	int columns[RANK_COUNT] = {1, 2, 3, 4, 5, 6, 7, 8, TEN_RANK, ACE_RANK};
+	char *names[RANK_COUNT] = {"2", "3", "4", "5", "6", "7", "8", "9", "10", "A"};
+	char *policy_text = "17", *output = NULL, text[16];
+	long long situations = 0;
+	double indices[DEVIATION_TOTAL_COUNT][RANK_COUNT], mean, independent = 0.0, common = 0.0;
+	deviation_cell *sums, *cell;
+	deviation_context context;
+	compare_policy policy;
+	clock_t start = clock();
+	time_t wall_start = time(NULL);
+	FILE *file = NULL;
+
+	for (i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--policy") == 0 && (i + 1) < argc)
+		{
+			policy_text = argv[++i];
+		}
+		else if (strcmp(argv[i], "--output") == 0 && (i + 1) < argc)
+		{
+			output = argv[++i];
+		}
+	}
+
+	context.num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	context.shoes = (int)get_option(argc, argv, "--shoes", DEFAULT_DEVIATION_SHOES);
+	context.penetration = (int)get_option(argc, argv, "--penetration", DEFAULT_DEVIATION_PENETRATION);
+	context.seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	context.policy = &policy;
+
+	if (context.num_decks < MIN_DECK_COUNT || context.num_decks > MAX_DECK_COUNT || context.shoes < 1 || context.penetration < 1 ||
+		context.penetration > 100 || thread_count < 1)
+	{
+		printf("Usage: blackjack --deviations [--decks %d-%d] [--shoes n] [--penetration 1-100] [--policy policy] [--output file] [--threads n] [--seed n]\n",
+			MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	if (!parse_compare_policy(policy_text, &policy))
+	{
+		printf("ERROR: A policy is a number from 2 to 21 or a strategy plug-in file.\n");
+		return 1;
+	}
+
+	tasks = (context.shoes + DEVIATION_TASK_SHOES - 1) / DEVIATION_TASK_SHOES;
+	context.cells = calloc((size_t)thread_count * DEVIATION_CELL_COUNT, sizeof(deviation_cell));
+	sums = calloc(DEVIATION_CELL_COUNT, sizeof(deviation_cell));
+
+	if (context.cells == NULL || sums == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'cells' - 02.\n");
+		return 1;
+	}
+
+	run_work_pool(tasks, thread_count, deviation_task, &context);
+
+	for (worker = 0; worker < thread_count; worker++)
+	{
+		for (i = 0; i < DEVIATION_CELL_COUNT; i++)
+		{
+			cell = &context.cells[(size_t)worker * DEVIATION_CELL_COUNT + i];
+			sums[i].samples += cell->samples;
+			sums[i].hit += cell->hit;
+			sums[i].stand += cell->stand;
+			sums[i].hit_square += cell->hit_square;
+			sums[i].stand_square += cell->stand_square;
+			sums[i].difference_square += cell->difference_square;
+		}
+	}
+
+	// The variance of the difference inside each bucket, against what it would be with hitting and standing
+	// played on separate shoes.
+	for (i = 0; i < DEVIATION_CELL_COUNT; i++)
+	{
+		if (sums[i].samples == 0)
+		{
+			continue;
+		}
+
+		situations += sums[i].samples;
+		mean = (double)(sums[i].hit - sums[i].stand) / sums[i].samples;
+		common += sums[i].difference_square - sums[i].samples * mean * mean;
+		mean = (double)sums[i].hit / sums[i].samples;
+		independent += sums[i].hit_square - sums[i].samples * mean * mean;
+		mean = (double)sums[i].stand / sums[i].samples;
+		independent += sums[i].stand_square - sums[i].samples * mean * mean;
+	}
+
+	for (total = DEVIATION_FIRST_TOTAL; total <= DEVIATION_LAST_TOTAL; total++)
+	{
+		for (rank = 0; rank < RANK_COUNT; rank++)
+		{
+			bucket = get_deviation_cell(total, rank, 0);
+			kinds[total - DEVIATION_FIRST_TOTAL][rank] = find_deviation_index(&sums[bucket], &indices[total - DEVIATION_FIRST_TOTAL][rank]);
+		}
+	}
+
+	printf("Hit/stand indices for %d decks dealt to %d%% (seed %llu). Played elsewhere: %s.\n", context.num_decks, context.penetration,
+		(unsigned long long)context.seed, policy.name);
+	printf("%lld situations from %d shoes, bucketed by the Hi-Lo true count.\n\n", situations, context.shoes);
+	printf("Stand at or above the true count shown, hit below it. H: hit at every count from %d to %+d. S: stand at every count.\n\n",
+		-DEVIATION_MAX_COUNT, DEVIATION_MAX_COUNT);
+	printf("      ");
+
+	for (rank = 0; rank < RANK_COUNT; rank++)
+	{
+		printf("%5s", names[rank]);
+	}
+
+	printf("\n");
+
+	if (output != NULL)
+	{
+		file = fopen(output, "w");
+
+		if (file == NULL)
+		{
+			printf("ERROR: Could not open '%s' for writing.\n", output);
+		}
+		else
+		{
+			fprintf(file, "total");
+
+			for (rank = 0; rank < RANK_COUNT; rank++)
+			{
+				fprintf(file, ",%s", names[rank]);
+			}
+
+			fprintf(file, "\n");
+		}
+	}
+
+	for (total = DEVIATION_FIRST_TOTAL; total <= DEVIATION_LAST_TOTAL; total++)
+	{
+		printf("%-6d", total);
+
+		if (file != NULL)
+		{
+			fprintf(file, "%d", total);
+		}
+
+		for (rank = 0; rank < RANK_COUNT; rank++)
+		{
+			format_deviation_index(text, sizeof(text), kinds[total - DEVIATION_FIRST_TOTAL][columns[rank]], indices[total - DEVIATION_FIRST_TOTAL][columns[rank]]);
+			printf("%5s", text);
+
+			if (file != NULL)
+			{
+				fprintf(file, ",%s", text);
+			}
+		}
+
+		printf("\n");
+
+		if (file != NULL)
+		{
+			fprintf(file, "\n");
+		}
+	}
+
+	if (common > 0.0)
+	{
+		printf("\nPlaying both actions on the same cards needed %.1f times fewer situations than separate shoes would have.\n", independent / common);
+	}
+
+	printf("Ran in %.2f seconds of CPU time, %ld seconds of wall time.\n", (double)(clock() - start) / CLOCKS_PER_SEC, (long)(time(NULL) - wall_start));
+
+	if (file != NULL)
+	{
+		fclose(file);
+		printf("Wrote the table to '%s'.\n", output);
+	}
+
+	unload_strategy(&policy.plugin);
+	free(sums);
+	free(context.cells);
+
+	return 0;
+}
+
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------- START OF SPECTATOR FUNCTIONS -------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+#ifndef _WIN32
+// Maps the table broadcast of another process for reading. Returns NULL if there isn't one.
+table_broadcast *attach_table_broadcast(long pid)
+{
+	int fd;
+	char name[64];
+	table_broadcast *table;
+
+	get_broadcast_name(name, sizeof(name), pid);
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	table = mmap(NULL, sizeof(table_broadcast), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (table == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	if (table->magic != TABLE_BROADCAST_MAGIC)
+	{
+		printf("ERROR: '%s' is not a table broadcast.\n", name);
+		munmap(table, sizeof(table_broadcast));
+		return NULL;
+	}
+
+	return table;
+}
+
+// Copies the newest state out of a broadcast. Returns 0 if nothing new was published since 'last_published'.
+int read_table_broadcast(table_broadcast *table, unsigned int *last_published, table_state *state)
+{
+	unsigned int published, sequence;
+	table_slot *slot;
+
+	published = atomic_load_explicit(&table->published, memory_order_acquire);
+
+	if (published == *last_published)
+	{
+		return 0;
+	}
+
+	// Only the newest state is read. If the writer laps this slot while copying, the next call tries again.
+	slot = &table->slots[(published - 1) % TABLE_RING_SIZE];
+	sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+	memcpy(state, &slot->state, sizeof(table_state));
+	atomic_thread_fence(memory_order_acquire);
+
+	if ((sequence & 1) || sequence != atomic_load_explicit(&slot->sequence, memory_order_relaxed))
+	{
+		return 0;
+	}
+
+	*last_published = published;
+
+	return 1;
+}
+
+// Puts the cards from a broadcast state back into hands so blackjack_ui() can draw them. 'player' needs room for
+// MAX_SPOT_COUNT hands.
+void unpack_table_state(table_state *state, hand *player, hand *dealer)
+{
 	int i;
 
-	for (i = 0; i < iterations; i++)
+	for (i = 0; i < state->spots && i < MAX_SPOT_COUNT; i++)
+	{
+		memcpy(player[i].hand, state->player_cards[i], sizeof(player[i].hand));
+		player[i].total_cards = state->player_total_cards[i];
+		get_hand_value(&player[i]);
+	}
+
+	memcpy(dealer->hand, state->dealer_cards, sizeof(dealer->hand));
+	dealer->total_cards = state->dealer_total_cards;
+}
+#endif
+
+// Watches a table run by another process with --broadcast.
+// Usage: blackjack --spectate <pid>
+int run_spectator(int argc, char *argv[])
+{
+	#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+
+	printf("Spectating is not supported on Windows.\n");
+	return 1;
+	#else
+	unsigned int last_published = 0;
+	table_broadcast *table;
+	table_state state;
+	hand player[MAX_SPOT_COUNT], dealer;
+
+	if (argc < 3)
+	{
+		printf("Usage: blackjack --spectate <pid>\n");
+		return 1;
+	}
+
+	table = attach_table_broadcast(strtol(argv[2], NULL, 10));
+	if (table == NULL)
+	{
+		printf("No table is being broadcast by process %s.\n", argv[2]);
+		return 1;
+	}
+
+	while (!atomic_load_explicit(&table->closed, memory_order_acquire))
+	{
+		if (!read_table_broadcast(table, &last_published, &state))
+		{
+			slp(SPECTATOR_POLL_TIME);
+			continue;
+		}
+
+		unpack_table_state(&state, player, &dealer);
+
+		blackjack_ui(player, state.bets, state.spots, &dealer, state.money, state.win_amount, state.hidden);
+		printf("Spectating process %s.\n", argv[2]);
+		fflush(stdout);
+	}
+
+	printf("The table has closed.\n");
+	munmap(table, sizeof(table_broadcast));
+
+	return 0;
+	#endif
+}
+
+#ifndef _WIN32
+// Prints a consistent snapshot of a game's metrics page. Returns 0 once the game has closed.
+int print_metrics_page(char *name, long pid)
+{
+	int fd, i, open;
+	unsigned int sequence;
+	long long values[METRIC_COUNT];
+	metrics_page *page;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+	{
+		printf("No metrics are being published by process %ld.\n", pid);
+		return 0;
+	}
+
+	page = mmap(NULL, sizeof(metrics_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (page == MAP_FAILED || page->magic != METRICS_MAGIC)
+	{
+		printf("ERROR: '%s' is not a metrics page.\n", name);
+		return 0;
+	}
+
+	// Retries until the game isn't in the middle of an update. The game never waits on this.
+	do
+	{
+		sequence = atomic_load_explicit(&page->sequence, memory_order_acquire);
+
+		for (i = 0; i < METRIC_COUNT; i++)
+		{
+			values[i] = atomic_load_explicit(&page->counters[i].value, memory_order_relaxed);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+	}
+	while ((sequence & 1) || sequence != atomic_load_explicit(&page->sequence, memory_order_relaxed));
+
+	open = !atomic_load_explicit(&page->closed, memory_order_acquire);
+
+	printf("Process %ld%s\n", pid, open ? "" : " (closed)");
+	for (i = 0; i < METRIC_COUNT; i++)
+	{
+		if (i == METRIC_WAGERED || i == METRIC_MONEY || i == METRIC_WIN_AMOUNT)
+		{
+			printf("  %-22s $%lld\n", metric_names[i], values[i]);
+		}
+		else
+		{
+			printf("  %-22s %lld\n", metric_names[i], values[i]);
+		}
+	}
+
+	munmap(page, sizeof(metrics_page));
+
+	return open;
+}
+#endif
+
+// Shows the metrics of one game, or of every game publishing them when no pid is given.
+// Usage: blackjack --metrics [pid] [--watch]
+int run_metrics(int argc, char *argv[])
+{
+	#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+
+	printf("Metrics are not supported on Windows.\n");
+	return 1;
+	#else
+	int i, watch = 0, found, open;
+	long pid = 0;
+	size_t prefix_length = strlen(METRICS_NAME_PREFIX) - 1;
+	char name[512];
+	DIR *directory;
+	struct dirent *entry;
+
+	for (i = 2; i < argc; i++)
 	{
-		#ifdef _WIN32
-		printf("|    %s    |", get_suite_symbol(hand->hand[start_index]));
-		#else
-		printf("│    %s    │", get_suite_symbol(hand->hand[start_index]));
-		#endif
-		start_index++;
+		if (strcmp(argv[i], "--watch") == 0)
+		{
+			watch = 1;
+		}
+		else
+		{
+			pid = strtol(argv[i], NULL, 10);
+		}
 	}
 
-	printf("\n");
+	do
+	{
+		if (watch)
+		{
+			cls();
+		}
+
+		found = 0;
+		open = 0;
+
+		if (pid != 0)
+		{
+			get_metrics_name(name, sizeof(name), pid);
+			open = print_metrics_page(name, pid);
+			found = 1;
+		}
+		// Shared memory objects show up as files in /dev/shm on Linux.
+		else if ((directory = opendir("/dev/shm")) != NULL)
+		{
+			while ((entry = readdir(directory)) != NULL)
+			{
+				if (strncmp(entry->d_name, METRICS_NAME_PREFIX + 1, prefix_length) == 0)
+				{
+					snprintf(name, sizeof(name), "/%s", entry->d_name);
+					open |= print_metrics_page(name, strtol(entry->d_name + prefix_length, NULL, 10));
+					found = 1;
+				}
+			}
+
+			closedir(directory);
+		}
+
+		if (!found)
+		{
+			printf("No games are publishing metrics. Start one with: blackjack --publish-metrics\n");
+		}
+
+		fflush(stdout);
+
+		if (watch && open)
+		{
+			slp(METRICS_WATCH_TIME);
+		}
+	}
+	while (watch && open);
+
+	return 0;
+	#endif
 }
 
-// Prints the segment of a card with a symbol in the top left or bottom right.
-void print_symbol_segment(hand *hand, int left_bound, int iterations, int start_index, char *symbol)
+/*==============================================================================
+--------------------------------------------------------------------------------
+------------------------- START OF MULTI-TABLE VIEW ----------------------------
+--------------------------------------------------------------------------------
+==============================================================================*/
+
+#define DEFAULT_VIEW_TABLES 4
+#define MAX_VIEW_TABLES 16
+#define DEFAULT_VIEW_COLUMNS 2
+#define DEFAULT_VIEW_FPS 10
+#define DEFAULT_VIEW_STEP_TIME 700
+#define VIEW_STARTING_MONEY 1000
+#define VIEW_TILE_GAP 4
+#define VIEW_MESSAGE_LENGTH 64
+
+enum view_phase
 {
-	int i;
+	VIEW_BETTING,
+	VIEW_PLAYER,
+	VIEW_DEALER,
+	VIEW_RESULT
+};
+
+// One tile of the grid. Bot tables play themselves one action at a time. Watched tables copy another process's broadcast.
+typedef struct view_table
+{
+	deck play_deck;
+	deck used_deck;
+	// Bot tables only play the first spot. Watched tables show every spot.
+	hand player[MAX_SPOT_COUNT];
+	hand dealer;
+	int counts[RANK_COUNT];
+	int money;
+	int bet;
+	int hidden;
+	int phase;
+	int closed;
+	double next_step;
+	char message[VIEW_MESSAGE_LENGTH];
+	rng r;
+	long pid;
+	table_state watched;
+	#ifndef _WIN32
+	table_broadcast *source;
+	unsigned int last_published;
+	#endif
+	canvas tile;
+} view_table;
+
+// Collects table updates and redraws the grid at most once per frame, however many tables changed.
+typedef struct render_scheduler
+{
+	double frame_time;
+	double last_frame;
+	int dirty;
+	long long frames;
+	long long updates;
+	canvas frame;
+} render_scheduler;
+
+// Plays the next action of a bot table, so a person can follow along.
+void step_view_table(view_table *table, strategy *bot)
+{
+	int i, decision, payout;
+	double result;
+	strategy_request request;
+
+	switch (table->phase)
+	{
+		case VIEW_BETTING:
+			if (table->money < MIN_BET)
+			{
+				table->money = VIEW_STARTING_MONEY;
+			}
+
+			table->bet = MIN_BET;
+			table->money -= table->bet;
+			table->hidden = 1;
+
+			for (i = INITIAL_CARD_DRAW; i > 0; i--)
+			{
+				draw_card(&table->play_deck, &table->used_deck, (i % 2 == 0) ? &table->player[0] : &table->dealer, table->counts, &table->r);
+			}
+
+			get_hand_value(&table->dealer);
+			get_hand_value(&table->player[0]);
+
+			// A blackjack on either side ends the player's turn straight away.
+			table->phase = (table->dealer.hand_value == 21 || table->player[0].hand_value == 21) ? VIEW_DEALER : VIEW_PLAYER;
+			snprintf(table->message, VIEW_MESSAGE_LENGTH, "Bet $%d.", table->bet);
+			break;
+
+		case VIEW_PLAYER:
+			fill_strategy_request(&request, &table->player[0], &table->dealer, table->counts);
+			bot->decide(&request, &decision, 1);
+
+			if (decision == STRATEGY_HIT)
+			{
+				draw_card(&table->play_deck, &table->used_deck, &table->player[0], table->counts, &table->r);
+				get_hand_value(&table->player[0]);
+				snprintf(table->message, VIEW_MESSAGE_LENGTH, "Hit.");
+
+				if (table->player[0].hand_value >= 21)
+				{
+					table->phase = VIEW_DEALER;
+				}
+			}
+			else
+			{
+				snprintf(table->message, VIEW_MESSAGE_LENGTH, "Stand.");
+				table->phase = VIEW_DEALER;
+			}
+			break;
+
+		case VIEW_DEALER:
+			// Same order as finish_headless_round(): reveal, draw up to the hold value unless the player busted, then settle.
+			if (table->hidden)
+			{
+				table->hidden = 0;
+				snprintf(table->message, VIEW_MESSAGE_LENGTH, "Dealer reveals.");
+			}
+			else if (table->player[0].hand_value <= 21 && table->dealer.hand_value < DEALER_HOLD_VALUE)
+			{
+				draw_card(&table->play_deck, &table->used_deck, &table->dealer, table->counts, &table->r);
+				get_hand_value(&table->dealer);
+				snprintf(table->message, VIEW_MESSAGE_LENGTH, "Dealer hits.");
+			}
+			else
+			{
+				result = get_round_result(table->player[0].hand_value, table->dealer.hand_value, (table->player[0].total_cards == 2) && (table->player[0].hand_value == 21));
+				payout = (int)(table->bet * (1.0 + result));
+				table->money += payout;
+
+				if (payout > table->bet)
+				{
+					snprintf(table->message, VIEW_MESSAGE_LENGTH, "Won $%d.", payout - table->bet);
+				}
+				else if (payout == table->bet)
+				{
+					snprintf(table->message, VIEW_MESSAGE_LENGTH, "Push.");
+				}
+				else
+				{
+					snprintf(table->message, VIEW_MESSAGE_LENGTH, "Lost $%d.", table->bet);
+				}
+
+				table->phase = VIEW_RESULT;
+			}
+			break;
+
+		default:
+			disgard_hands(&table->used_deck, &table->dealer, table->player, 1);
+			table->bet = 0;
+			table->message[0] = '\0';
+			table->phase = VIEW_BETTING;
+			break;
+	}
+}
+
+// Draws a table into its tile with the game's own layout.
+void render_view_table(view_table *table, int number)
+{
+	render_target = &table->tile;
+	table->tile.length = 0;
+
+	if (table->pid != 0)
+	{
+		blackjack_ui(table->player, table->watched.bets, table->watched.spots, &table->dealer, table->watched.money, table->watched.win_amount, table->watched.hidden);
+		draw_text("Process %ld%s\n", table->pid, table->closed ? " - the table has closed." : "");
+	}
+	else
+	{
+		blackjack_ui(table->player, &table->bet, 1, &table->dealer, table->money, VIEW_STARTING_MONEY * DIFFICULTY_MULTIPLIER_1, table->hidden);
+		draw_text("Table %d: %s\n", number, table->message);
+	}
+
+	render_target = NULL;
+}
+
+// The number of characters a terminal shows for some UTF-8 text.
+int count_code_points(const char *text, int length)
+{
+	int i, count = 0;
 
-	for (i = 0; i < iterations; i++)
+	for (i = 0; i < length; i++)
 	{
-		get_card_symbol((hand->hand[start_index]), symbol);
+		if ((text[i] & 0xC0) != 0x80)
+		{
+			count++;
+		}
+	}
 
-		if (left_bound)
+	return count;
+}
+
+// Puts the tiles side by side and writes the whole grid to the screen at once.
+void draw_view_frame(render_scheduler *scheduler, view_table *tables, int table_count, int columns)
+{
+	int i, row, column, length, width, tile_width = 0, remaining;
+	const char *line, *end;
+	const char *cursor[MAX_VIEW_TABLES];
+
+	// Every tile gets the width of the widest line, so the columns line up.
+	for (i = 0; i < table_count; i++)
+	{
+		for (line = tables[i].tile.text; line != NULL && *line != '\0'; line = (*end == '\0') ? end : end + 1)
 		{
-			#ifdef _WIN32
-			printf("|%-9s|", symbol);
-			#else
-			printf("│%-9s│", symbol);
-			#endif
+			end = strchr(line, '\n');
+			if (end == NULL)
+			{
+				end = line + strlen(line);
+			}
+
+			width = count_code_points(line, (int)(end - line));
+			if (width > tile_width)
+			{
+				tile_width = width;
+			}
 		}
-		else
+	}
+
+	render_target = &scheduler->frame;
+	scheduler->frame.length = 0;
+
+	for (row = 0; row < table_count; row += columns)
+	{
+		for (column = 0; column < columns && row + column < table_count; column++)
+		{
+			cursor[column] = tables[row + column].tile.text;
+		}
+
+		do
 		{
+			remaining = 0;
+
+			for (column = 0; column < columns && row + column < table_count; column++)
+			{
+				line = cursor[column];
+				length = 0;
+
+				if (line != NULL && *line != '\0')
+				{
+					end = strchr(line, '\n');
+					length = (end != NULL) ? (int)(end - line) : (int)strlen(line);
+					cursor[column] = (end != NULL) ? end + 1 : line + length;
+					remaining |= (*cursor[column] != '\0');
+				}
+
+				draw_text("%.*s", length, (line != NULL) ? line : "");
+
+				if (column + 1 < columns && row + column + 1 < table_count)
+				{
+					draw_text("%*s", tile_width - count_code_points(line, length) + VIEW_TILE_GAP, "");
+				}
+			}
+
+			// Erases whatever was left on the line from the last frame.
 			#ifdef _WIN32
-			printf("|%9s|", symbol);
+			draw_text("\n");
 			#else
-			printf("│%9s│", symbol);
+			draw_text("\e[K\n");
 			#endif
 		}
+		while (remaining);
 
-		start_index++;
+		draw_text("\n");
 	}
 
-	printf("\n");
+	render_target = NULL;
+
+	// Moving the cursor home and drawing over the last frame doesn't flicker the way clearing does.
+	#ifdef _WIN32
+	cls();
+	#else
+	fputs("\e[H", stdout);
+	#endif
+	fwrite(scheduler->frame.text, 1, scheduler->frame.length, stdout);
+	#ifndef _WIN32
+	fputs("\e[J", stdout);
+	#endif
+	fflush(stdout);
 }
 
-// Prints the bottom segment of a card.
-void print_bottom_segment(int iterations)
+// Redraws the grid if anything changed and the last frame is at least a frame time old.
+void run_render_scheduler(render_scheduler *scheduler, view_table *tables, int table_count, int columns, double now)
 {
 	int i;
 
-	for (i = 0; i < iterations; i++)
+	if (!scheduler->dirty || now - scheduler->last_frame < scheduler->frame_time)
 	{
-		#ifdef _WIN32
-		printf("-----------");
-		#else
-		printf("└─────────┘");
-		#endif
+		return;
 	}
 
-	printf("\n");
+	for (i = 0; i < table_count; i++)
+	{
+		render_view_table(&tables[i], i + 1);
+	}
+
+	draw_view_frame(scheduler, tables, table_count, columns);
+
+	scheduler->last_frame = now;
+	scheduler->dirty = 0;
+	scheduler->frames++;
 }
 
-// Prints an unhidden row of cards to the screen.
-void print_unhidden_card_row(hand *hand, int *cards, int start_index, char *symbol, int i)
+#ifndef _WIN32
+// Finds every process broadcasting a table and attaches to as many as there are tiles.
+int attach_view_broadcasts(view_table *tables, int max_tables)
 {
-	print_top_segment(cards[i]);
-	print_symbol_segment(hand, 1, cards[i], start_index, symbol);
-	print_empty_segment(cards[i]);
-	print_empty_segment(cards[i]);
-	print_suite_segment(hand, cards[i], start_index);
-	print_empty_segment(cards[i]);
-	print_empty_segment(cards[i]);
-	print_symbol_segment(hand, 0, cards[i], start_index, symbol);
-	print_bottom_segment(cards[i]);
+	int count = 0;
+	long pid;
+	DIR *directory;
+	struct dirent *entry;
+
+	// Shared memory objects show up as files in /dev/shm on Linux.
+	directory = opendir("/dev/shm");
+	if (directory == NULL)
+	{
+		return 0;
+	}
+
+	while (count < max_tables && (entry = readdir(directory)) != NULL)
+	{
+		if (sscanf(entry->d_name, "blackjack-table-%ld", &pid) == 1 && (tables[count].source = attach_table_broadcast(pid)) != NULL)
+		{
+			tables[count].pid = pid;
+			count++;
+		}
+	}
+
+	closedir(directory);
+
+	return count;
 }
 
-// Main function that handles the printing of cards to the screen.
-void print_cards(deck *play_deck, deck *used_deck, hand *hand, int first_card_hidden)
+// Copies any new state from a watched table. Returns 1 if the tile needs redrawing.
+int update_watched_table(view_table *table)
 {
-	char *symbol;
-	int i, row, start_index, iterations, temp_card_total, cards[NUMBER_OF_ROWS];
+	if (table->closed)
+	{
+		return 0;
+	}
 
-	// Prints the "no cards" element to the screen.
-	if (hand->total_cards == 0)
+	if (atomic_load_explicit(&table->source->closed, memory_order_acquire))
 	{
-		#ifdef _WIN32
-		printf("- - - - - -\n");
-		printf("           \n");
-		printf("|         |\n");
-		printf("           \n");
-		printf("|         |\n");
-		printf("           \n");
-		printf("|         |\n");
-		printf("           \n");
-		printf("- - - - - -\n");
-		#else
-		printf("┌ ─ ─ ─ ─ ┐\n");
-		printf("           \n");
-		printf("│         │\n");
-		printf("           \n");
-		printf("│         │\n");
-		printf("           \n");
-		printf("│         │\n");
-		printf("           \n");
-		printf("└ ─ ─ ─ ─ ┘\n");
-		#endif
-		return;
+		table->closed = 1;
+		return 1;
 	}
-	else
+
+	if (!read_table_broadcast(table->source, &table->last_published, &table->watched))
 	{
-		symbol = malloc(sizeof(char) * (MAX_SYMBOL_LENGTH));
+		return 0;
+	}
+
+	unpack_table_state(&table->watched, table->player, &table->dealer);
+
+	return 1;
+}
+#endif
 
-		if (symbol == NULL)
+// Shows several tables in one terminal. Bot tables are played by a strategy at a human pace.
+// With --watch, the tiles show the tables of every process started with --broadcast instead.
+// Usage: blackjack --multi-table [--tables n] [--columns n] [--fps n] [--step ms] [--strategy file] [--decks n] [--seconds n] [--watch]
+int run_multi_table(int argc, char *argv[])
+{
+	int i, table_count, columns, fps, step_time, num_decks, seconds, total_cards, watch = 0, open;
+	char *path = NULL;
+	double now, start, step;
+	view_table tables[MAX_VIEW_TABLES];
+	render_scheduler scheduler;
+	strategy bot;
+
+	for (i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--strategy") == 0 && (i + 1) < argc)
 		{
-			// Exit the game.
-			free(used_deck->deck);
-			free(play_deck->deck);
-			printf("ERROR: Failed to allocate memory in heap space for variable 'symbol' - 01.\n");
-			exit(1);
+			path = argv[i + 1];
 		}
-
-		// Sets all the characters in the symbol string to the null terminator.
-		for (i = 0; i < MAX_SYMBOL_LENGTH; i++)
+		else if (strcmp(argv[i], "--watch") == 0)
 		{
-			symbol[i] = '\0';
+			watch = 1;
 		}
+	}
+
+	table_count = (int)get_option(argc, argv, "--tables", DEFAULT_VIEW_TABLES);
+	columns = (int)get_option(argc, argv, "--columns", DEFAULT_VIEW_COLUMNS);
+	fps = (int)get_option(argc, argv, "--fps", DEFAULT_VIEW_FPS);
+	step_time = (int)get_option(argc, argv, "--step", DEFAULT_VIEW_STEP_TIME);
+	num_decks = (int)get_option(argc, argv, "--decks", MAX_DECK_COUNT);
+	seconds = (int)get_option(argc, argv, "--seconds", 0);
+
+	if (table_count < 1 || table_count > MAX_VIEW_TABLES || columns < 1 || columns > MAX_VIEW_TABLES || fps < 1 || step_time < 0 || num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT || seconds < 0)
+	{
+		printf("Usage: blackjack --multi-table [--tables 1-%d] [--columns n] [--fps n] [--step ms] [--strategy file] [--decks %d-%d] [--seconds n] [--watch]\n", MAX_VIEW_TABLES, MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
+
+	if (!load_strategy(&bot, path))
+	{
+		return 1;
+	}
+
+	memset(tables, 0, sizeof(tables));
+	start = get_seconds();
+	total_cards = num_decks * CARDS_IN_A_DECK;
+
+	if (watch)
+	{
+		#ifdef _WIN32
+		printf("Watching broadcasts is not supported on Windows.\n");
+		return 1;
+		#else
+		table_count = attach_view_broadcasts(tables, table_count);
 
-		// Initializes all the rows in the cards array to 0.
-		for (i = 0; i < NUMBER_OF_ROWS; i++)
+		if (table_count == 0)
 		{
-			cards[i] = 0;
+			printf("No tables are being broadcast. Start one with: blackjack --broadcast\n");
+			return 1;
 		}
-
-		// Adds cards to each row until the row surpasses the maximum number of cards allowed in the row.
-		// Wraps to another row when one becomes full.
-		for (temp_card_total = (hand->total_cards), row = 0; temp_card_total > 0; temp_card_total--)
+		#endif
+	}
+	else
+	{
+		for (i = 0; i < table_count; i++)
 		{
-			if (cards[row] > (MAX_CARDS_IN_A_ROW - 1))
+			tables[i].play_deck.deck = malloc(sizeof(int) * total_cards);
+			tables[i].used_deck.deck = malloc(sizeof(int) * total_cards);
+
+			if (tables[i].play_deck.deck == NULL || tables[i].used_deck.deck == NULL)
 			{
-				row++;
+				printf("ERROR: Failed to allocate memory in heap space for variable 'tables' - 03.\n");
+				return 1;
 			}
 
-			cards[row]++;
+			tables[i].play_deck.total_cards = total_cards;
+			tables[i].money = VIEW_STARTING_MONEY;
+			tables[i].phase = VIEW_BETTING;
+
+			// Tables start a little apart from each other so they don't all move at once.
+			tables[i].next_step = start + (double)step_time * i / table_count / 1000.0;
+
+			seed_rng(&tables[i].r, (uint64_t)time(NULL) + (uint64_t)i);
+			create_decks(&tables[i].play_deck, &tables[i].used_deck, total_cards);
+			shuffle_deck_rng(&tables[i].play_deck, total_cards, total_cards, &tables[i].r);
+			count_shoe(&tables[i].play_deck, tables[i].counts);
 		}
+	}
 
-		// Add 1 to the row variable to get the total number of rows instead of the highest row index.
-		row++;
+	scheduler.frame_time = 1.0 / fps;
+	scheduler.last_frame = 0.0;
+	scheduler.dirty = 1;
+	scheduler.frames = 0;
+	scheduler.updates = 0;
+	scheduler.frame.text = NULL;
+	scheduler.frame.length = 0;
+	scheduler.frame.capacity = 0;
 
-		// Handles the main printing of cards.
-		for (i = 0; i < row; i++)
-		{
-			// Get the start index for each row of the cards array.
-			start_index = i * MAX_CARDS_IN_A_ROW;
+	cls();
+
+	do
+	{
+		now = get_seconds();
+		open = 0;
 
-			if (first_card_hidden)
+		for (i = 0; i < table_count; i++)
+		{
+			#ifndef _WIN32
+			if (watch)
 			{
-				// Row 1 has a hidden card while the rest of the rows don't.
-				if (start_index == 0)
-				{
-					#ifdef _WIN32
-					print_top_segment(cards[i]);
-					printf("|XXXXXXXXX|");
-					print_symbol_segment(hand, 1, (cards[i] - 1), start_index + 1, symbol);
-					printf("|XXXXXXXXX|");
-					print_empty_segment((cards[i]) - 1);
-					printf("|XXXXXXXXX|");
-					print_empty_segment((cards[i]) - 1);
-					printf("|XXXXXXXXX|");
-					print_suite_segment(hand, (cards[i] - 1), start_index + 1);
-					printf("|XXXXXXXXX|");
-					print_empty_segment((cards[i]) - 1);
-					printf("|XXXXXXXXX|");
-					print_empty_segment((cards[i]) - 1);
-					printf("|XXXXXXXXX|");
-					print_symbol_segment(hand, 0, (cards[i] - 1), start_index + 1, symbol);
-					print_bottom_segment(cards[i]);
-					#else
-					print_top_segment(cards[i]);
-					printf("│░░░░░░░░░│");
-					print_symbol_segment(hand, 1, (cards[i] - 1), start_index + 1, symbol);
-					printf("│░░░░░░░░░│");
-					print_empty_segment((cards[i]) - 1);
-					printf("│░░░░░░░░░│");
-					print_empty_segment((cards[i]) - 1);
-					printf("│░░░░░░░░░│");
-					print_suite_segment(hand, (cards[i] - 1), start_index + 1);
-					printf("│░░░░░░░░░│");
-					print_empty_segment((cards[i]) - 1);
-					printf("│░░░░░░░░░│");
-					print_empty_segment((cards[i]) - 1);
-					printf("│░░░░░░░░░│");
-					print_symbol_segment(hand, 0, (cards[i] - 1), start_index + 1, symbol);
-					print_bottom_segment(cards[i]);
-					#endif
-				}
-				else
+				if (update_watched_table(&tables[i]))
 				{
-					print_unhidden_card_row(hand, cards, start_index, symbol, i);
+					scheduler.dirty = 1;
+					scheduler.updates++;
 				}
+
+				open |= !tables[i].closed;
+				continue;
 			}
-			else
+			#endif
+
+			if (now >= tables[i].next_step)
 			{
-				print_unhidden_card_row(hand, cards, start_index, symbol, i);
+				step_view_table(&tables[i], &bot);
+				tables[i].next_step += step_time / 1000.0;
+				scheduler.dirty = 1;
+				scheduler.updates++;
 			}
+
+			open = 1;
 		}
 
-		// Free the memory.
-		free(symbol);
-	}
-}
+		run_render_scheduler(&scheduler, tables, table_count, columns, now);
 
-void blackjack_ui(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int money, int win_amount, int hidden, int bet)
-{
-	cls();
+		// Sleeps until the next step or frame is due, whichever comes first.
+		step = scheduler.frame_time;
+		for (i = 0; i < table_count && !watch; i++)
+		{
+			if (tables[i].next_step - now < step)
+			{
+				step = tables[i].next_step - now;
+			}
+		}
 
-	printf("Money: $%d\n", money);
-	printf("Minimum bet: $%d\n", MIN_BET);
-	printf("Current bet: $%d\n", bet);
-	printf("Required money to win: $%d\n", win_amount);
-	printf("\n");
-	printf("Note: You will lose if your money drops below the minimum bet.\n\n");
-	#ifdef _WIN32
-	printf("==============================================================\n\n");
-	#else
-	printf("♠============================================================♣\n\n");
-	#endif
-	printf("Dealer's cards:\n");
+		if (watch && step > SPECTATOR_POLL_TIME / 1000.0)
+		{
+			step = SPECTATOR_POLL_TIME / 1000.0;
+		}
 
-	// Dealer's cards.
-	print_cards(play_deck, used_deck, dealer, hidden);
+		if (step > 0.0)
+		{
+			slp((int)(step * 1000.0) + 1);
+		}
+	}
+	while (open && (seconds == 0 || now - start < seconds));
 
-	// To prevent the first player card from being hidden.
-	hidden = 0;
+	// Draws the final state of any table that changed since the last frame.
+	scheduler.last_frame = 0.0;
+	run_render_scheduler(&scheduler, tables, table_count, columns, get_seconds());
 
-	printf("\n");
-	printf("Your cards:\n");
+	printf("%lld table updates drawn in %lld frames over %.1f seconds.\n", scheduler.updates, scheduler.frames, get_seconds() - start);
 
-	// Player's cards.
-	print_cards(play_deck, used_deck, player, hidden);
+	for (i = 0; i < table_count; i++)
+	{
+		#ifndef _WIN32
+		if (tables[i].source != NULL)
+		{
+			munmap(tables[i].source, sizeof(table_broadcast));
+		}
+		#endif
 
-	printf("\n");
+		free(tables[i].tile.text);
+		free(tables[i].used_deck.deck);
+		free(tables[i].play_deck.deck);
+	}
 
-	#ifdef _WIN32
-	printf("==============================================================\n\n");
-	#else
-	printf("♦============================================================♥\n\n");
-	#endif
+	free(scheduler.frame.text);
+	unload_strategy(&bot);
+
+	return 0;
 }
 
 /*==============================================================================
 --------------------------------------------------------------------------------
------------------- END OF GRAPHICS AND ASCII ART FUNCTIONS ---------------------
+--------------------------- START OF TOURNAMENT MODE ---------------------------
 --------------------------------------------------------------------------------
 ==============================================================================*/
 
-// Main game function.
-int blackjack(deck *play_deck, deck *used_deck, hand *player, hand *dealer, int *money, int win_amount, int num_decks)
+#define DEFAULT_TOURNAMENT_PLAYERS 1000
+#define DEFAULT_TOURNAMENT_ROUNDS 20
+#define DEFAULT_TOURNAMENT_CUT 50
+#define DEFAULT_TOURNAMENT_BET 100
+#define TOURNAMENT_STARTING_MONEY 1000
+#define TOURNAMENT_DECKS 1
+#define TOURNAMENT_CHUNK_PLAYERS 256
+
+// One tournament player with their own shoe, hands and bankroll.
+typedef struct entrant
 {
-	char input;
-	int bet, lost_bet, current_index, i, j, dealer_hidden, player_active, blackjack, reshuffled, game_active = 1;
+	deck play_deck;
+	deck used_deck;
+	hand player;
+	hand dealer;
+	int counts[RANK_COUNT];
+	int money;
+	int id;
+	int human;
+	// Rounds played in the current stage. Less than the stage's rounds if the money ran out.
+	int rounds_played;
+	rng r;
+} entrant;
+
+typedef struct tournament_context
+{
+	entrant **alive;
+	int alive_count;
+	int rounds;
+	int bet;
+	strategy *bots;
+} tournament_context;
+
+// Plays a chunk of bots' rounds for one stage, a round at a time across the whole chunk, so every bot waiting on a
+// decision goes to the strategy in one call. Bots bet a flat amount, or everything they have left if that is less.
+void play_bot_rounds(entrant **bots, int count, int rounds, int flat_bet, strategy *strategy)
+{
+	int i, round, waiting, bets[TOURNAMENT_CHUNK_PLAYERS], playing[TOURNAMENT_CHUNK_PLAYERS], decisions[TOURNAMENT_CHUNK_PLAYERS];
+	int waiting_bots[TOURNAMENT_CHUNK_PLAYERS];
+	double result;
+	strategy_request requests[TOURNAMENT_CHUNK_PLAYERS];
+	entrant *bot;
 
-	while (game_active)
+	for (i = 0; i < count; i++)
 	{
-		// Set up variables for this turn.
-		dealer_hidden = 1;
-		player_active = 1;
-		bet = 0;
-		lost_bet = 0;
-		blackjack = 0;
-		reshuffled = 0;
+		bots[i]->rounds_played = 0;
+	}
 
-		// Player loses if he has no more money to bet.
-		if (*money < MIN_BET)
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < count; i++)
 		{
-			return 0;
-		}
+			bot = bots[i];
+			playing[i] = 0;
 
-		// Any call to this function will update the UI.
-		blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+			if (bot->human || bot->money < MIN_BET)
+			{
+				continue;
+			}
 
-		// Gets the player's bet amount.
-		while (player_active)
-		{
-			bet = get_number_input("How much money do you want to bet? There is no need for a dollar sign.", MIN_BET, (MAX_MONEY * DIFFICULTY_MULTIPLIER_3), 1);
+			bets[i] = (bot->money < flat_bet) ? bot->money : flat_bet;
+			bot->money -= bets[i];
+			bot->rounds_played++;
 
-			if (bet > *money)
+			if (deal_headless_round(&bot->play_deck, &bot->used_deck, &bot->player, &bot->dealer, bot->counts, &bot->r))
 			{
-				printf("You don't have that much money!\n");
+				playing[i] = 1;
 			}
 			else
 			{
-				player_active = 0;
+				// Same payout arithmetic as blackjack().
+				bot->money += (int)(bets[i] * (1.0 + settle_headless_round(&bot->used_deck, &bot->player, &bot->dealer)));
 			}
-
-			clear_scanf_buffer();
 		}
 
-		*money = *money - bet;
-
-		// Used for keeping track of where to draw from.
-		current_index = play_deck->total_cards - 1;
-
-		// Handles the initial drawing of the cards.
-		// Alternates between drawing a card for the player and dealer.
-		for (i = INITIAL_CARD_DRAW, j = 0; i > 0; i--)
+		// Each pass asks about every hand still being played, until they have all stood or reached 21.
+		do
 		{
-			// Handles the increasing of indexes in the dealer and player hand.
-			if (i == INITIAL_CARD_DRAW / 2)
+			for (i = 0, waiting = 0; i < count; i++)
 			{
-				j++;
+				if (playing[i] == 1 && bots[i]->player.hand_value < 21)
+				{
+					fill_strategy_request(&requests[waiting], &bots[i]->player, &bots[i]->dealer, bots[i]->counts);
+					waiting_bots[waiting] = i;
+					waiting++;
+				}
 			}
 
-			blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
-
-			// Recombine and shuffle the used deck into the playing deck if no cards are in it.
-			if (play_deck->total_cards == 0)
+			if (waiting > 0)
 			{
-				recombine_decks(play_deck, used_deck);
-				shuffle_deck(play_deck, play_deck->total_cards);
-				current_index = (play_deck->total_cards - 1);
-				reshuffled = 1;
+				strategy->decide(requests, decisions, waiting);
 			}
 
-			// Alternating if-else statement for adding cards to the hands.
-			if (i % 2 == 0)
-			{
-				player->hand[j] = play_deck->deck[current_index];
-				(player->total_cards)++;
-				play_deck->deck[current_index] = 0;
-				(play_deck->total_cards)--;
-				current_index--;
-			}
-			else
+			for (i = 0; i < waiting; i++)
 			{
-				dealer->hand[j] = play_deck->deck[current_index];
-				(dealer->total_cards)++;
-				play_deck->deck[current_index] = 0;
-				(play_deck->total_cards)--;
-				current_index--;
-			}
+				bot = bots[waiting_bots[i]];
 
-			// Any call to this function will sleep for the standard sleep time defined at the top.
-			// Only reason for this is to add some effect of card drawing.
-			// Otherwise, the cards would appear instantly.
-			slp(STANDARD_SLEEP_TIME);
-		}
+				if (decisions[i] != STRATEGY_HIT)
+				{
+					playing[waiting_bots[i]] = 2;
+					continue;
+				}
 
-		blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+				draw_card(&bot->play_deck, &bot->used_deck, &bot->player, bot->counts, &bot->r);
+				get_hand_value(&bot->player);
+			}
+		} while (waiting > 0);
 
-		if (reshuffled)
+		for (i = 0; i < count; i++)
 		{
-			printf("The deck was reshuffled during the initial draw.\n\n");
-			reshuffled = 0;
+			if (playing[i])
+			{
+				bot = bots[i];
+				result = finish_headless_round(&bot->play_deck, &bot->used_deck, &bot->player, &bot->dealer, bot->counts, &bot->r);
+				bot->money += (int)(bets[i] * (1.0 + result));
+			}
 		}
+	}
+}
 
-		// Recombine and shuffle the used deck into the playing deck if no cards are in it.
-		if (play_deck->total_cards == 0)
-		{
-			recombine_decks(play_deck, used_deck);
-			shuffle_deck(play_deck, play_deck->total_cards);
-			current_index = (play_deck->total_cards - 1);
-		}
+// Plays one chunk of bots for the current stage.
+void tournament_task(void *argument, int task, int worker)
+{
+	tournament_context *context = argument;
+	int start = task * TOURNAMENT_CHUNK_PLAYERS, end = start + TOURNAMENT_CHUNK_PLAYERS;
 
-		slp(STANDARD_SLEEP_TIME);
+	(void)worker;
 
-		// Gets the hand value of the player and dealer.
-		get_hand_value(dealer);
-		get_hand_value(player);
+	if (end > context->alive_count)
+	{
+		end = context->alive_count;
+	}
 
-		player_active = 1;
+	play_bot_rounds(&context->alive[start], end - start, context->rounds, context->bet, context->bots);
+}
 
-		// Both the dealer and player have blackjacks.
-		if ((dealer->hand_value == 21) && (player->hand_value == 21))
-		{
-			dealer_hidden = 0;
+// Richest first. Ties go to the player who entered first so results don't depend on the thread count.
+int compare_entrants(const void *a, const void *b)
+{
+	const entrant *x = *(entrant * const *)a, *y = *(entrant * const *)b;
 
-			blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+	if (x->money != y->money)
+	{
+		return (x->money < y->money) ? 1 : -1;
+	}
+
+	return (x->id > y->id) - (x->id < y->id);
+}
 
-			printf("Both the dealer and player got blackjacks! You get your $%d back!\n", bet);
+// Gives a human player their rounds through the normal game UI.
+void play_human_rounds(entrant *human, int rounds, int stage, int alive_count)
+{
+	int result, rounds_left = rounds;
 
-			// Disgard the cards of the player and dealer into the used deck.
-			disgard_hands(used_deck, dealer, player);
+	cls();
+	print_blackjack_ascii_art();
+	printf("Tournament stage %d: %d players left.\n", stage, alive_count);
+	printf("Player %d, you have $%d. Play %d rounds and try to finish in the top.\n", human->id + 1, human->money, rounds);
+	slp(STANDARD_SLEEP_TIME * 6);
 
-			// Return the money back to the player.
-			*money = *money + bet;
+	// An entrant only has the one hand, so tournaments are played on a single spot whatever --spots says.
+	result = blackjack(&human->play_deck, &human->used_deck, &human->player, 1, &human->dealer, &human->money, MAX_MONEY * DIFFICULTY_MULTIPLIER_3, TOURNAMENT_DECKS, &rounds_left);
+	human->rounds_played = rounds - rounds_left;
 
-			slp(STANDARD_SLEEP_TIME * 8);
+	// Leaving the game forfeits the tournament.
+	if (result == -1)
+	{
+		human->money = 0;
+	}
+}
 
-			// Starts a new round.
-			continue;
-		}
-		// The dealer got 21 and player did not, automatic win for him.
-		else if (dealer->hand_value == 21)
+// Runs an elimination tournament. Every stage, all players play the same number of rounds,
+// then the poorest part of the field is knocked out until one player is left.
+// Usage: blackjack --tournament [--players n] [--humans n] [--rounds n] [--cut percent] [--bet n] [--decks n]
+//                               [--strategy file] [--threads n] [--seed n]
+int run_tournament(int argc, char *argv[])
+{
+	int i, stage, eliminated, total_cards, human_left;
+	int player_count = (int)get_option(argc, argv, "--players", DEFAULT_TOURNAMENT_PLAYERS);
+	int human_count = (int)get_option(argc, argv, "--humans", 0);
+	int cut = (int)get_option(argc, argv, "--cut", DEFAULT_TOURNAMENT_CUT);
+	int num_decks = (int)get_option(argc, argv, "--decks", TOURNAMENT_DECKS);
+	int thread_count = (int)get_option(argc, argv, "--threads", get_default_thread_count());
+	long long hands = 0;
+	char *path = NULL;
+	uint64_t seed = (uint64_t)get_option(argc, argv, "--seed", (long long)time(NULL));
+	time_t wall_start = time(NULL);
+	entrant *entrants;
+	strategy bots;
+	tournament_context context;
+
+	for (i = 2; i < (argc - 1); i++)
+	{
+		if (strcmp(argv[i], "--strategy") == 0)
 		{
-			dealer_hidden = 0;
+			path = argv[i + 1];
+		}
+	}
 
-			blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+	context.rounds = (int)get_option(argc, argv, "--rounds", DEFAULT_TOURNAMENT_ROUNDS);
+	context.bet = (int)get_option(argc, argv, "--bet", DEFAULT_TOURNAMENT_BET);
 
-			printf("Dealer got a blackjack! You lost the bet of $%d!\n", bet);
+	if (player_count < 2 || human_count < 0 || human_count > player_count || cut < 1 || cut > 99 || context.rounds < 1 ||
+		context.bet < MIN_BET || num_decks < MIN_DECK_COUNT || num_decks > MAX_DECK_COUNT || thread_count < 1)
+	{
+		printf("Usage: blackjack --tournament [--players n] [--humans n] [--rounds n] [--cut 1-99] [--bet n] [--decks %d-%d] [--strategy file] [--threads n] [--seed n]\n", MIN_DECK_COUNT, MAX_DECK_COUNT);
+		return 1;
+	}
 
-			// Disgard the cards of the player and dealer into the used deck.
-			disgard_hands(used_deck, dealer, player);
+	if (!load_strategy(&bots, path))
+	{
+		return 1;
+	}
 
-			slp(STANDARD_SLEEP_TIME * 8);
+	total_cards = num_decks * CARDS_IN_A_DECK;
+	entrants = malloc(sizeof(entrant) * player_count);
+	context.alive = malloc(sizeof(entrant *) * player_count);
+	context.bots = &bots;
 
-			// Starts a new round.
-			continue;
-		}
-		// Player got a blackjack. No need for him to do anything else.
-		else if (player->hand_value == 21)
-		{
-			blackjack = 1;
-			player_active = 0;
-		}
+	if (entrants == NULL || context.alive == NULL)
+	{
+		printf("ERROR: Failed to allocate memory in heap space for variable 'entrants' - 01.\n");
+		return 1;
+	}
 
-		// Player gets to choose what to do.
-		while (player_active)
-		{
-			printf("Commands: (h)it (s)tand (e)xit\n\n");
-			printf("What would you like to do?\n");
+	// The first entrants are the humans. Everyone else is a bot.
+	for (i = 0; i < player_count; i++)
+	{
+		entrant *player = &entrants[i];
 
-			scanf(" %c", &input);
+		player->play_deck.deck = malloc(sizeof(int) * total_cards);
+		player->used_deck.deck = malloc(sizeof(int) * total_cards);
 
-			if (!isalpha(input))
-			{
-				printf("Please input an alphabetical letter.\n");
-			}
-			else
-			{
-				input = tolower(input);
+		if (player->play_deck.deck == NULL || player->used_deck.deck == NULL)
+		{
+			printf("ERROR: Failed to allocate memory in heap space for variable 'entrants' - 02.\n");
+			return 1;
+		}
 
-				if (input == 'e')
-				{
-					printf("Exiting the game...\n");
-					return -1;
-				}
-				else if (input == 'h')
-				{
-					// Grabs a card from the deck.
-					player->hand[player->total_cards] = play_deck->deck[current_index];
-					(player->total_cards)++;
-					play_deck->deck[current_index] = 0;
-					(play_deck->total_cards)--;
-					current_index--;
+		player->play_deck.total_cards = total_cards;
+		player->used_deck.total_cards = 0;
+		player->player.total_cards = 0;
+		player->dealer.total_cards = 0;
+		player->money = TOURNAMENT_STARTING_MONEY;
+		player->id = i;
+		player->human = (i < human_count);
 
-					// Updates the player's total card values.
-					get_hand_value(player);
+		seed_rng(&player->r, seed + (uint64_t)i);
+		create_decks(&player->play_deck, &player->used_deck, total_cards);
+		shuffle_deck_rng(&player->play_deck, total_cards, total_cards, &player->r);
 
-					blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+		count_shoe(&player->play_deck, player->counts);
+		context.alive[i] = player;
+	}
 
-					// Recombine and shuffle the used deck into the playing deck if no cards are in it.
-					if (play_deck->total_cards == 0)
-					{
-						recombine_decks(play_deck, used_deck);
-						shuffle_deck(play_deck, play_deck->total_cards);
-						current_index = (play_deck->total_cards - 1);
-						reshuffled = 1;
-					}
+	context.alive_count = player_count;
 
+	// The humans' reshuffles in blackjack() come from the game seed, so with --seed the whole tournament repeats.
+	// It is past every entrant's seed so it doesn't repeat one of their shoes.
+	game_seed = seed + (uint64_t)player_count;
 
-					// Busts the player if he goes above 21.
-					if (player->hand_value > 21)
-					{
-						player_active = 0;
-						dealer_hidden = 0;
-						lost_bet = 1;
+	for (stage = 1; context.alive_count > 1; stage++)
+	{
+		// Bots play on the thread pool first, then any humans play through the normal UI.
+		run_work_pool((context.alive_count + TOURNAMENT_CHUNK_PLAYERS - 1) / TOURNAMENT_CHUNK_PLAYERS, thread_count, tournament_task, &context);
 
-						blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+		for (i = 0; i < context.alive_count; i++)
+		{
+			if (context.alive[i]->human)
+			{
+				play_human_rounds(context.alive[i], context.rounds, stage, context.alive_count);
+			}
+		}
 
-						if (reshuffled)
-						{
-							printf("The deck has been reshuffled.\n\n");
-							reshuffled = 0;
-						}
+		for (i = 0; i < context.alive_count; i++)
+		{
+			hands += context.alive[i]->rounds_played;
+		}
+		qsort(context.alive, context.alive_count, sizeof(entrant *), compare_entrants);
 
-						printf("Dealer's total cards value: %d\n", dealer->hand_value);
-						printf("Your total cards value: %d\n\n", player->hand_value);
-						printf("You busted and lost the bet of $%d!\n", bet);
+		// Knocks out the bottom part of the field. Always at least one player goes and one stays.
+		eliminated = (int)(((long long)context.alive_count * cut + 99) / 100);
+		if (eliminated >= context.alive_count)
+		{
+			eliminated = context.alive_count - 1;
+		}
 
-						// Disgard the cards of the player and dealer into the used deck.
-						disgard_hands(used_deck, dealer, player);
+		context.alive_count -= eliminated;
 
-						slp(STANDARD_SLEEP_TIME * 8);
-					}
+		if (human_count > 0)
+		{
+			cls();
+			print_blackjack_ascii_art();
+		}
 
-					if (reshuffled)
-					{
-						printf("The deck has been reshuffled.\n\n");
-						reshuffled = 0;
-					}
+		printf("Stage %d: %d players knocked out, %d left. Leader: player %d with $%d, cut line: $%d.\n",
+			stage, eliminated, context.alive_count, context.alive[0]->id + 1, context.alive[0]->money, context.alive[context.alive_count - 1]->money);
 
-					// Player got a blackjack, no more need to draw.
-					if ((player->hand_value) == 21)
-					{
-						player_active = 0;
-					}
-				}
-				else if (input == 's')
-				{
-					player_active = 0;
-				}
-				else
-				{
-					printf("Letter '%c' is not a recognized command.\n", input);
-				}
+		for (i = 0, human_left = 0; i < context.alive_count; i++)
+		{
+			if (context.alive[i]->human)
+			{
+				printf("  Human player %d is ranked %d with $%d.\n", context.alive[i]->id + 1, i + 1, context.alive[i]->money);
+				human_left = 1;
 			}
-
-			clear_scanf_buffer();
 		}
 
-		// Starts a new turn is the player busted while drawing.
-		if (lost_bet)
+		if (human_count > 0)
 		{
-			continue;
+			if (!human_left)
+			{
+				printf("  Every human player has been knocked out.\n");
+			}
+
+			slp(STANDARD_SLEEP_TIME * 8);
 		}
+	}
 
-		dealer_hidden = 0;
+	printf("\nPlayer %d (%s) wins the tournament with $%d!\n", context.alive[0]->id + 1, context.alive[0]->human ? "human" : bots.name, context.alive[0]->money);
+	printf("%d players, %d stages, %lld player rounds in %ld seconds.\n", player_count, stage - 1, hands, (long)(time(NULL) - wall_start));
 
-		blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+	for (i = 0; i < player_count; i++)
+	{
+		free(entrants[i].used_deck.deck);
+		free(entrants[i].play_deck.deck);
+	}
 
-		slp(STANDARD_SLEEP_TIME);
+	free(context.alive);
+	free(entrants);
+	unload_strategy(&bots);
 
-		// Dealer draws until he reaches or is above the hold threshold.
-		while (dealer->hand_value < DEALER_HOLD_VALUE)
-		{
-			// Dealer draws a card.
-			dealer->hand[dealer->total_cards] = play_deck->deck[current_index];
-			(dealer->total_cards)++;
-			play_deck->deck[current_index] = 0;
-			(play_deck->total_cards)--;
-			current_index--;
+	return 0;
+}
 
-			// Updates the dealer's total card values.
-			get_hand_value(dealer);
+// Built without main() as libblackjack. (See libblackjack.h)
+#ifndef BLACKJACK_LIBRARY
+int main(int argc, char *argv[])
+{
+	char input, f_money[15], *history_path = NULL, *script_path = NULL, *transcript_path = NULL;
+	int i, j, money, difficulty, win_amount, num_decks, menu_loop, win, settings_loop = 1, iteration = 0, *dynamic_memory_location;
+	deck play_deck, used_deck, duplicate_deck;
+	hand dealer, player[MAX_SPOT_COUNT];
+	rng r;
+
+	build_card_atlas();
 
-			blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
+	// Command-line tools that run without the interactive game.
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "--house-edge") == 0)
+		{
+			return run_house_edge(argc, argv);
+		}
+		else if (strcmp(argv[1], "--compare") == 0)
+		{
+			return run_compare(argc, argv);
+		}
+		else if (strcmp(argv[1], "--perfect-play") == 0)
+		{
+			return run_perfect_play(argc, argv);
+		}
+		else if (strcmp(argv[1], "--deviations") == 0)
+		{
+			return run_deviations(argc, argv);
+		}
+		else if (strcmp(argv[1], "--spectate") == 0)
+		{
+			return run_spectator(argc, argv);
+		}
+		else if (strcmp(argv[1], "--metrics") == 0)
+		{
+			return run_metrics(argc, argv);
+		}
+		else if (strcmp(argv[1], "--simulate") == 0)
+		{
+			return run_simulation(argc, argv);
+		}
+		else if (strcmp(argv[1], "--csm-simulate") == 0)
+		{
+			return run_csm_simulation(argc, argv);
+		}
+		else if (strcmp(argv[1], "--side-bet-odds") == 0)
+		{
+			return run_side_bet_odds(argc, argv);
+		}
+		else if (strcmp(argv[1], "--engine-benchmark") == 0)
+		{
+			return run_engine_benchmark(argc, argv);
+		}
+		else if (strcmp(argv[1], "--shuffle-benchmark") == 0)
+		{
+			return run_shuffle_benchmark(argc, argv);
+		}
+		else if (strcmp(argv[1], "--layout-benchmark") == 0)
+		{
+			return run_layout_benchmark(argc, argv);
+		}
+		else if (strcmp(argv[1], "--merge-summaries") == 0)
+		{
+			return run_merge_summaries(argc, argv);
+		}
+		else if (strcmp(argv[1], "--read-results") == 0)
+		{
+			return run_read_results(argc, argv);
+		}
+		else if (strcmp(argv[1], "--query-history") == 0)
+		{
+			return run_query_history(argc, argv);
+		}
+		else if (strcmp(argv[1], "--serve") == 0)
+		{
+			return run_server(argc, argv);
+		}
+		else if (strcmp(argv[1], "--load-test") == 0)
+		{
+			return run_load_test(argc, argv);
+		}
+		else if (strcmp(argv[1], "--tournament") == 0)
+		{
+			return run_tournament(argc, argv);
+		}
+		else if (strcmp(argv[1], "--multi-table") == 0)
+		{
+			return run_multi_table(argc, argv);
+		}
+	}
 
-			// Recombine and shuffle the used deck into the playing deck if no cards are in it.
-			if (play_deck->total_cards == 0)
+	// Options for the interactive game.
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--history") == 0 && (i + 1) < argc)
+		{
+			history_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--autoplay") == 0)
+		{
+			// The strategy file is optional. Without one, the built-in strategy plays.
+			if (!load_strategy(&autoplay_strategy, ((i + 1) < argc && strncmp(argv[i + 1], "--", 2) != 0) ? argv[++i] : NULL))
 			{
-				recombine_decks(play_deck, used_deck);
-				shuffle_deck(play_deck, play_deck->total_cards);
-				current_index = (play_deck->total_cards - 1);
-				reshuffled = 1;
+				return 1;
 			}
 
-			slp(STANDARD_SLEEP_TIME);
+			autoplay = &autoplay_strategy;
 		}
-
-		blackjack_ui(play_deck, used_deck, player, dealer, *money, win_amount, dealer_hidden, bet);
-
-		if (reshuffled)
+		else if (strcmp(argv[i], "--side-bets") == 0)
 		{
-			printf("The deck was reshuffled during the dealers draw.\n\n");
-			reshuffled = 0;
+			side_bets_enabled = 1;
 		}
+		else if (strcmp(argv[i], "--seed") == 0 && (i + 1) < argc)
+		{
+			game_seed = strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--csm") == 0)
+		{
+			csm_enabled = 1;
+		}
+		else if (strcmp(argv[i], "--spots") == 0 && (i + 1) < argc)
+		{
+			spot_count = (int)strtol(argv[++i], NULL, 10);
 
-		slp(STANDARD_SLEEP_TIME);
-
-		// Dealer drew over 21. He busts.
-		if (dealer->hand_value > 21)
+			if (spot_count < 1 || spot_count > MAX_SPOT_COUNT)
+			{
+				printf("The number of spots must be between 1 and %d.\n", MAX_SPOT_COUNT);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--script") == 0 && (i + 1) < argc)
 		{
-			printf("Dealer hand value: %d\n", dealer->hand_value);
-			printf("Player hand value: %d\n\n", player->hand_value);
-			printf("The dealer busted! You won $%d!\n", (bet * 2));
-			*money = *money + (bet * 2);
+			script_path = argv[++i];
 		}
-		// Push, both hand values were the same. Player gets origional bet money back.
-		else if (dealer->hand_value == player->hand_value)
+		else if (strcmp(argv[i], "--transcript") == 0 && (i + 1) < argc)
 		{
-			printf("Push! You get your $%d back!\n", bet);
-			*money = *money + bet;
+			transcript_path = argv[++i];
 		}
-		// Player lost because the dealer had a higher hand value.
-		else if (dealer->hand_value > player->hand_value)
+		#ifdef _WIN32
+		else if (strcmp(argv[i], "--broadcast") == 0 || strcmp(argv[i], "--publish-metrics") == 0 || strcmp(argv[i], "--advisor") == 0)
 		{
-			printf("Dealer hand value: %d\n", dealer->hand_value);
-			printf("Player hand value: %d\n\n", player->hand_value);
-			printf("You lost $%d!\n", bet);
+			printf("Option '%s' is not supported on Windows.\n", argv[i]);
+			return 1;
 		}
-		// Player had the higher hand value.
-		else
+		#else
+		else if (strcmp(argv[i], "--broadcast") == 0)
 		{
-			printf("Dealer hand value: %d\n", dealer->hand_value);
-			printf("Player hand value: %d\n\n", player->hand_value);
+			if (!open_table_broadcast())
+			{
+				return 1;
+			}
 
-			// If the player gets a blackjack, he gets 1.5x his bet money. Otherwise he gets 2x.
-			if (blackjack)
+			printf("Broadcasting this table. Spectators can run: blackjack --spectate %ld\n", (long)getpid());
+			slp(STANDARD_SLEEP_TIME * 4);
+		}
+		else if (strcmp(argv[i], "--publish-metrics") == 0)
+		{
+			if (!open_metrics_page())
 			{
-				*money = (int)(*money + ((double)bet * 1.5));
-				printf("You won $%d!\n", (int)((double)bet * 1.5));
+				return 1;
 			}
-			else
+
+			printf("Publishing metrics. Read them with: blackjack --metrics %ld\n", (long)getpid());
+			slp(STANDARD_SLEEP_TIME * 4);
+		}
+		else if (strcmp(argv[i], "--advisor") == 0)
+		{
+			if (!start_advisor(exact_advice))
 			{
-				*money = *money + (bet * 2);
-				printf("You won $%d!\n", (bet * 2));
+				return 1;
 			}
 		}
+		#endif
+		else
+		{
+			printf("Unknown option '%s'.\n", argv[i]);
+			return 1;
+		}
+	}
 
-		slp(STANDARD_SLEEP_TIME * 8);
+	// The advisor works from the cards left in the play deck, which a continuous shuffler never deals from.
+	if (csm_enabled && advisor != NULL)
+	{
+		printf("Option '--advisor' can't be used with '--csm'.\n");
+		return 1;
+	}
 
-		// Disgard the cards of the player and dealer into the used deck.
-		disgard_hands(used_deck, dealer, player);
+	if (script_path != NULL)
+	{
+		// The advisor answers whenever its thread gets there, which would make every transcript different.
+		if (advisor != NULL)
+		{
+			printf("Option '--advisor' can't be used with '--script'.\n");
+			return 1;
+		}
 
-		// Player achieved the amount of money required to win.
-		if (*money >= win_amount)
+		if (freopen(script_path, "r", stdin) == NULL)
 		{
+			printf("Could not open the script '%s'.\n", script_path);
 			return 1;
 		}
+
+		script_mode = 1;
 	}
-}
 
-int main(void)
-{
-	char input, f_money[15];
-	int i, j, money, difficulty, win_amount, num_decks, menu_loop, win, settings_loop = 1, iteration = 0, *dynamic_memory_location;
-	deck play_deck, used_deck, duplicate_deck;
-	hand dealer, player;
+	if (transcript_path != NULL && freopen(transcript_path, "w", stdout) == NULL)
+	{
+		printf("Could not open the transcript '%s'.\n", transcript_path);
+		return 1;
+	}
+
+	// Scripted sessions only keep a history when asked to, so test runs don't fill up the real one.
+	if (!script_mode || history_path != NULL)
+	{
+		open_hand_history((history_path != NULL) ? history_path : HISTORY_FILE_NAME);
+	}
+
+	if (game_seed == 0)
+	{
+		game_seed = (uint64_t)time(NULL);
+	}
+
+	seed_rng(&r, game_seed);
+
+	#ifndef _WIN32
+	if (broadcast != NULL || metrics != NULL)
+	{
+		catch_shutdown_signals();
+	}
+	#endif
 
 	while (settings_loop)
 	{
@@ -1129,16 +11471,20 @@ int main(void)
 
 		// Creates the cards within the deck and shuffles them.
 		create_decks(&play_deck, &used_deck, play_deck.total_cards);
-		shuffle_deck(&play_deck, play_deck.total_cards);
+		shuffle_deck_rng(&play_deck, play_deck.total_cards, play_deck.total_cards, &r);
 
 		// Set up the player and dealer hands.
-		player.total_cards = 0;
 		dealer.total_cards = 0;
 
-		// Set the player's hand to zeros.
-		for (i = 0; i < MAX_HAND_COUNT; i++)
+		// Set the player's hands to zeros.
+		for (j = 0; j < MAX_SPOT_COUNT; j++)
 		{
-			player.hand[i] = 0;
+			player[j].total_cards = 0;
+
+			for (i = 0; i < MAX_HAND_COUNT; i++)
+			{
+				player[j].hand[i] = 0;
+			}
 		}
 
 		// Set the dealer's hand to zeros.
@@ -1208,6 +11554,12 @@ int main(void)
 		printf("Starting money: $%d\n", money);
 		printf("Required money to win: $%d\n", win_amount);
 		printf("Minimum bet (Can't be changed): $%d\n", MIN_BET);
+
+		if (spot_count > 1)
+		{
+			printf("Spots played each round: %d\n", spot_count);
+		}
+
 		#ifdef _WIN32
 		printf("=================================================\n");
 		#else
@@ -1220,7 +11572,7 @@ int main(void)
 		// Handles the player inputs in reponse to the menu.
 		while (menu_loop)
 		{
-			scanf(" %c", &input);
+			input = get_letter_input();
 
 			// Checks to see if the input character is alphabetical or not.
 			if (!isalpha(input))
@@ -1259,7 +11611,7 @@ int main(void)
 						duplicate_deck.deck[i] = play_deck.deck[i];
 					}
 
-					shuffle_deck(&play_deck, play_deck.total_cards);
+					shuffle_deck_rng(&play_deck, play_deck.total_cards, play_deck.total_cards, &r);
 
 					// Check for changes between indexes.
 					for (i = 0, j = 0; i < play_deck.total_cards; i++)
@@ -1297,7 +11649,7 @@ int main(void)
 
 	cls();
 
-	win = blackjack(&play_deck, &used_deck, &player, &dealer, &money, win_amount, num_decks);
+	win = blackjack(&play_deck, &used_deck, player, spot_count, &dealer, &money, win_amount, num_decks, NULL);
 
 	cls();
 
@@ -1324,3 +11676,4 @@ int main(void)
 
 	return 0;
 }
+#endif
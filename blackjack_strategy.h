@@ -0,0 +1,36 @@
+#ifndef BLACKJACK_STRATEGY_H
+#define BLACKJACK_STRATEGY_H
+
+// Interface for strategy plug-ins.
+// A plug-in is a shared library that exports blackjack_strategy_decide() and, optionally, blackjack_strategy_name().
+// Build one with: gcc -O2 -shared -fPIC -o my_strategy.so my_strategy.c
+// See strategies/basic_strategy.c for an example.
+
+#define STRATEGY_STAND 0
+#define STRATEGY_HIT 1
+#define STRATEGY_RANK_COUNT 10
+
+// One hit or stand decision the game needs made.
+typedef struct strategy_request
+{
+	// Value of the player's hand, as the game shows it.
+	int hand_total;
+	// 1 if an ace in the hand is still counted as 11.
+	int soft;
+	// 2 - 10, or 11 for an ace.
+	int dealer_up_card;
+	// Cards the player hasn't seen yet, including the dealer's hidden card.
+	int cards_left;
+	// The unseen cards by rank: aces, 2 - 9, then every ten-valued card.
+	int shoe_counts[STRATEGY_RANK_COUNT];
+} strategy_request;
+
+// Fills decisions[i] with STRATEGY_HIT or STRATEGY_STAND for each of the 'count' requests.
+// The game sends every table waiting on a decision in one call.
+// Tournaments call this from several threads at once, so it must not change shared state.
+typedef void (*strategy_decide_function)(const strategy_request *requests, int *decisions, int count);
+
+// Returns a short name shown by the game.
+typedef const char *(*strategy_name_function)(void);
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef LIBBLACKJACK_H
+#define LIBBLACKJACK_H
+
+#include <stdint.h>
+
+// The game's rules as a round state machine, for hosting tables outside the console game.
+// Build the library with:
+//	gcc -O2 -shared -fPIC -fvisibility=hidden -DBLACKJACK_LIBRARY -o libblackjack.so blackjack.c -pthread -lm -ldl
+//
+// Nothing here blocks, sleeps, prints or allocates. The caller owns every table, hand and deck, so one thread can
+// keep as many tables going as it has memory for. A round goes:
+//
+//	blackjack_start_round(table, bet)      Once the table needs a bet. (or blackjack_start_spots() for several hands)
+//	blackjack_step(table)                  Until it needs something else. Each step deals one card or settles.
+//	blackjack_apply(table, action)         When it needs the player to hit or stand on the hand in 'spot'.
+//
+// All three return what the table needs next. After each call, 'event' says what just happened, so a front-end
+// can draw it. Once the round is over, 'results', 'payouts' and 'payout' hold how it went until the next step clears
+// the table.
+
+// The library only exports what is declared with this. Everything else in blackjack.c stays hidden when it's built
+// with -fvisibility=hidden, so it can't clash with the host program's own functions.
+#if defined(__GNUC__)
+#define BLACKJACK_API __attribute__((visibility("default")))
+#else
+#define BLACKJACK_API
+#endif
+
+#define MAX_HAND_COUNT 15
+#define MAX_SPOT_COUNT 5
+
+// Cards are numbered 1 up to the number of cards in the shoe. A card's face and suit only depend on it modulo 52.
+typedef struct deck
+{
+	int *deck;
+	int total_cards;
+} deck;
+
+typedef struct hand
+{
+	int hand[MAX_HAND_COUNT];
+	int ace_count;
+	int hand_value;
+	int total_cards;
+} hand;
+
+// Seedable random number generator (xoshiro128**) used by the simulations so runs can be repeated.
+typedef struct rng
+{
+	uint32_t state[4];
+} rng;
+
+// A continuous shuffling machine. Cards are 1 - 52, and every card a table is done with goes straight back in, so
+// each draw is a uniformly random card from whatever is inside. The count of each card is kept in a Fenwick tree,
+// so drawing or returning a card costs O(log 52) however many decks it holds.
+#define CSM_CARD_COUNT 52
+
+typedef struct csm
+{
+	int tree[CSM_CARD_COUNT + 1];
+	int total_cards;
+} csm;
+
+// What a table needs next.
+enum blackjack_status
+{
+	BLACKJACK_NEED_BET,
+	BLACKJACK_RUNNING,
+	BLACKJACK_NEED_ACTION,
+	BLACKJACK_ROUND_OVER
+};
+
+enum blackjack_action
+{
+	BLACKJACK_STAND,
+	BLACKJACK_HIT
+};
+
+// What the last call did.
+enum blackjack_event
+{
+	BLACKJACK_EVENT_NONE,
+	// One of the four starting cards was dealt.
+	BLACKJACK_EVENT_CARD,
+	// The starting cards are all down and both hands have values.
+	BLACKJACK_EVENT_DEALT,
+	BLACKJACK_EVENT_PLAYER_CARD,
+	// The dealer's hole card was turned over.
+	BLACKJACK_EVENT_REVEAL,
+	BLACKJACK_EVENT_DEALER_CARD,
+	BLACKJACK_EVENT_SETTLED
+};
+
+enum blackjack_result
+{
+	BLACKJACK_RESULT_BOTH_BLACKJACK,
+	BLACKJACK_RESULT_DEALER_BLACKJACK,
+	BLACKJACK_RESULT_PLAYER_BUST,
+	BLACKJACK_RESULT_DEALER_BUST,
+	BLACKJACK_RESULT_PUSH,
+	BLACKJACK_RESULT_DEALER_WINS,
+	BLACKJACK_RESULT_PLAYER_WINS
+};
+
+// A round has one player hand per spot, each with its own bet, all played against the same dealer hand.
+typedef struct blackjack_table
+{
+	deck *play_deck;
+	deck *used_deck;
+	// The first of the spots' hands.
+	hand *player;
+	hand *dealer;
+	// Dealt from instead of the decks when it isn't NULL.
+	csm *shuffler;
+	rng r;
+	int phase;
+	int event;
+	// Spots in this round, and the one being played.
+	int spots;
+	int spot;
+	// 1 while the dealer's first card is face down.
+	int hidden;
+	// Times the used deck was shuffled back into the play deck during the last call.
+	int reshuffles;
+	int bets[MAX_SPOT_COUNT];
+	// 1 for a spot whose first two cards were a blackjack.
+	int blackjacks[MAX_SPOT_COUNT];
+	int results[MAX_SPOT_COUNT];
+	// What each bet pays back, including the bet itself. (0 for a loss)
+	int payouts[MAX_SPOT_COUNT];
+	// What every spot pays back together.
+	int payout;
+} blackjack_table;
+
+// Sets up a table on the caller's decks and hands. 'player' needs a hand for every spot that will be played. The play
+// deck should be shuffled, and the used deck needs room for every card in the shoe. 'seed' is for the reshuffles.
+BLACKJACK_API void blackjack_table_init(blackjack_table *table, deck *play_deck, deck *used_deck, hand *player, hand *dealer, uint64_t seed);
+
+// Fills a shuffler with 'decks' decks.
+BLACKJACK_API void blackjack_csm_init(csm *shuffler, int decks);
+
+// Deals the table's cards from a continuous shuffler from now on. The table's decks are no longer touched.
+BLACKJACK_API void blackjack_table_use_csm(blackjack_table *table, csm *shuffler);
+
+// Plays one spot.
+BLACKJACK_API int blackjack_start_round(blackjack_table *table, int bet);
+
+// Plays 'spots' spots, 1 to MAX_SPOT_COUNT. Cards go round the spots in order, then to the dealer, twice. The
+// spots are then played in order, and the dealer draws unless every spot busted.
+BLACKJACK_API int blackjack_start_spots(blackjack_table *table, const int *bets, int spots);
+
+// 'action' is BLACKJACK_HIT or BLACKJACK_STAND.
+BLACKJACK_API int blackjack_apply(blackjack_table *table, int action);
+
+BLACKJACK_API int blackjack_step(blackjack_table *table);
+
+#endif
@@ -0,0 +1,51 @@
+#include "../blackjack_strategy.h"
+
+// Example strategy plug-in: a hit/stand chart for a game without doubling or splitting.
+// Build with: gcc -O2 -shared -fPIC -o basic_strategy.so strategies/basic_strategy.c
+
+const char *blackjack_strategy_name(void)
+{
+	return "Basic strategy";
+}
+
+// Only the blackjack_strategy_ functions are looked up by the game, so helpers stay static.
+static int decide(const strategy_request *request)
+{
+	int total = request->hand_total, up = request->dealer_up_card;
+
+	if (request->soft)
+	{
+		// Soft 18 only stands against a weak dealer card.
+		if (total >= 19 || (total == 18 && up <= 8))
+		{
+			return STRATEGY_STAND;
+		}
+
+		return STRATEGY_HIT;
+	}
+
+	if (total >= 17)
+	{
+		return STRATEGY_STAND;
+	}
+	else if (total >= 13)
+	{
+		return (up <= 6) ? STRATEGY_STAND : STRATEGY_HIT;
+	}
+	else if (total == 12)
+	{
+		return (up >= 4 && up <= 6) ? STRATEGY_STAND : STRATEGY_HIT;
+	}
+
+	return STRATEGY_HIT;
+}
+
+void blackjack_strategy_decide(const strategy_request *requests, int *decisions, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		decisions[i] = decide(&requests[i]);
+	}
+}